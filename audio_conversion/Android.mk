@@ -105,6 +105,11 @@ include $(BUILD_STATIC_LIBRARY)
 component_fcttest_src_files := \
     test/AudioConversionTest.cpp
 
+# Relies on glibc allocator hooks
+component_fcttest_src_files_host := \
+    $(component_fcttest_src_files) \
+    test/AudioConversionHeapTest.cpp
+
 component_fcttest_c_includes := \
     external/tinyalsa/include \
     frameworks/av/include/media
@@ -150,7 +155,7 @@ LOCAL_MODULE := audio_conversion_fcttest_host
 LOCAL_MODULE_OWNER := intel
 LOCAL_MODULE_TAGS := optional
 
-LOCAL_SRC_FILES := $(component_fcttest_src_files)
+LOCAL_SRC_FILES := $(component_fcttest_src_files_host)
 LOCAL_C_INCLUDES := $(component_fcttest_c_includes_host)
 LOCAL_CFLAGS := $(component_fcttest_defines)
 LOCAL_STATIC_LIBRARIES := $(component_fcttest_static_lib_host)
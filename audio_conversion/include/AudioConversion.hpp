@@ -20,6 +20,7 @@
 #include <media/AudioBufferProvider.h>
 #include <NonCopyable.hpp>
 #include <list>
+#include <string>
 
 namespace intel_audio
 {
@@ -56,6 +57,18 @@ public:
      */
     android::status_t configure(const SampleSpec &ssSrc, const SampleSpec &ssDst);
 
+    /**
+     * Allocates the memory of the conversion chain for the worst case, so that no allocation
+     * happens while converting. Must be called after configure.
+     *
+     * @param[in] maxFrames maximum number of frames in the destination sample specification to
+     *                      be converted at once, either output of convert or requested to
+     *                      getConvertedBuffer.
+     *
+     * @return status OK, error code otherwise.
+     */
+    android::status_t reserve(size_t maxFrames);
+
     /**
      * Converts audio samples.
      *
@@ -100,6 +113,22 @@ public:
                                          const size_t outFrames,
                                          android::AudioBufferProvider *bufferProvider);
 
+    /**
+     * Describes the conversion chain configured, for debug purpose.
+     *
+     * @return the ordered list of converters as "remap > resample > reformat", "none" if the
+     *         source and destination sample specifications are matching.
+     */
+    std::string getConversionPlan() const;
+
+    /**
+     * Get the delay introduced by the conversion chain, i.e. the intrinsic delay of each converter
+     * and the frames converted but not consumed yet by getConvertedBuffer.
+     *
+     * @return delay in frames in the destination sample spec.
+     */
+    size_t getDelayInFrames() const;
+
 private:
     /**
      * This function pushes the converter to the list.
@@ -183,6 +212,15 @@ private:
                                                SampleSpec *ssSrc,
                                                const SampleSpec *ssDst);
 
+    /**
+     * Grows the buffer of converted frames not consumed yet by getConvertedBuffer.
+     *
+     * @param[in] outFrames frames requested to getConvertedBuffer.
+     *
+     * @return status OK, error code otherwise.
+     */
+    android::status_t allocateConvOutBuffer(size_t outFrames);
+
     /**
      * Reset the list of active converter.
      * This function must be called before reconfiguring the conversion chain.
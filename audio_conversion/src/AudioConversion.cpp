@@ -104,6 +104,49 @@ status_t AudioConversion::configure(const SampleSpec &ssSrc, const SampleSpec &s
     return tmpSsSrc == ssDst ? OK : INVALID_OPERATION;
 }
 
+status_t AudioConversion::reserve(size_t maxFrames)
+{
+    if (mActiveAudioConvList.empty()) {
+
+        return NO_ERROR;
+    }
+    status_t status = allocateConvOutBuffer(maxFrames);
+    if (status != NO_ERROR) {
+
+        return status;
+    }
+    // Source frames are rounded up, as requested by getConvertedBuffer to the buffer provider
+    size_t frames = AudioUtils::convertSrcToDstInFrames(maxFrames, mSsDst, mSsSrc);
+    for (AudioConverterListIterator it = mActiveAudioConvList.begin();
+         it != mActiveAudioConvList.end(); ++it) {
+        status = (*it)->reserve(frames, frames);
+        if (status != NO_ERROR) {
+
+            return status;
+        }
+    }
+    return NO_ERROR;
+}
+
+status_t AudioConversion::allocateConvOutBuffer(size_t outFrames)
+{
+    if (mConvOutBufferSizeInFrames >= outFrames) {
+
+        return NO_ERROR;
+    }
+    // Margin of the worst case, as conversion may output more frames than requested
+    size_t sizeInFrames = outFrames + (mMaxRate / mMinRate) * mAllocBufferMultFactor;
+    int16_t *reallocBuffer =
+        static_cast<int16_t *>(realloc(mConvOutBuffer, mSsDst.convertFramesToBytes(sizeInFrames)));
+    if (reallocBuffer == NULL) {
+        Log::Error() << __FUNCTION__ << ": (frames=" << outFrames << " ): realloc failed";
+        return NO_MEMORY;
+    }
+    mConvOutBuffer = reallocBuffer;
+    mConvOutBufferSizeInFrames = sizeInFrames;
+    return NO_ERROR;
+}
+
 status_t AudioConversion::getConvertedBuffer(void *dst,
                                              const size_t outFrames,
                                              AudioBufferProvider *bufferProvider)
@@ -121,21 +164,12 @@ status_t AudioConversion::getConvertedBuffer(void *dst,
     }
 
     //
-    // Realloc the Output of the conversion if required (with margin of the worst case)
+    // Realloc the Output of the conversion if required and not reserved
     //
-    if (mConvOutBufferSizeInFrames < outFrames) {
-
-        mConvOutBufferSizeInFrames = outFrames +
-                                     (mMaxRate / mMinRate) * mAllocBufferMultFactor;
-        int16_t *reallocBuffer =
-            static_cast<int16_t *>(realloc(mConvOutBuffer,
-                                           mSsDst.convertFramesToBytes(
-                                               mConvOutBufferSizeInFrames)));
-        if (reallocBuffer == NULL) {
-            Log::Error() << __FUNCTION__ << ": (frames=" << outFrames << " ): realloc failed";
-            return NO_MEMORY;
-        }
-        mConvOutBuffer = reallocBuffer;
+    status = allocateConvOutBuffer(outFrames);
+    if (status != NO_ERROR) {
+
+        return status;
     }
 
     size_t framesRequested = outFrames;
@@ -282,6 +316,35 @@ status_t AudioConversion::convert(const void *src,
     return status;
 }
 
+string AudioConversion::getConversionPlan() const
+{
+    static const char *const converterNames[NbSampleSpecItems] = {
+        "remap", "reformat", "resample"
+    };
+    string plan;
+    for (AudioConverterListConstIterator it = mActiveAudioConvList.begin();
+         it != mActiveAudioConvList.end(); ++it) {
+        for (int item = 0; item < NbSampleSpecItems; item++) {
+            if (*it == mAudioConverter[item]) {
+                plan += plan.empty() ? "" : " > ";
+                plan += converterNames[item];
+            }
+        }
+    }
+    return plan.empty() ? "none" : plan;
+}
+
+size_t AudioConversion::getDelayInFrames() const
+{
+    size_t delay = mConvOutFrames;
+    for (AudioConverterListConstIterator it = mActiveAudioConvList.begin();
+         it != mActiveAudioConvList.end(); ++it) {
+        delay += AudioUtils::convertSrcToDstInFrames((*it)->getDelayInFrames(),
+                                                     (*it)->getDstSampleSpec(), mSsDst);
+    }
+    return delay;
+}
+
 void AudioConversion::emptyConversionChain()
 {
     mActiveAudioConvList.clear();
@@ -72,7 +72,7 @@ status_t AudioConverter::allocateConvertBuffer(ssize_t bytes)
     mConvertBufSize = bytes +
                       (audio_bytes_per_sample(mSsDst.getFormat()) * mSsDst.getChannelCount());
 
-    free(mConvertBuf);
+    delete[] mConvertBuf;
     mConvertBuf = NULL;
 
     mConvertBuf = new char[mConvertBufSize];
@@ -85,6 +85,12 @@ status_t AudioConverter::allocateConvertBuffer(ssize_t bytes)
     return ret;
 }
 
+status_t AudioConverter::reserve(size_t inFrames, size_t &outFrames)
+{
+    outFrames = convertSrcToDstInFrames(inFrames);
+    return getOutputBuffer(inFrames) != NULL ? NO_ERROR : NO_MEMORY;
+}
+
 status_t AudioConverter::configure(const SampleSpec &ssSrc, const SampleSpec &ssDst)
 {
     mSsSrc = ssSrc;
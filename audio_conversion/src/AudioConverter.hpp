@@ -88,6 +88,30 @@ public:
                                       size_t inFrames,
                                       size_t *outFrames);
 
+    /**
+     * Allocates the internal memory of the converter for the worst case, so that no allocation
+     * happens while converting. Must be called after configure.
+     *
+     * @param[in] inFrames maximum number of input frames to be converted at once.
+     * @param[out] outFrames maximum number of output frames converted at once.
+     *
+     * @return status OK if allocation is successful, error code otherwise.
+     */
+    android::status_t reserve(size_t inFrames, size_t &outFrames);
+
+    /**
+     * Get the intrinsic delay of the converter, i.e. the frames it holds to perform the conversion
+     * (filter history for instance).
+     *
+     * @return delay in frames in the destination sample spec.
+     */
+    virtual size_t getDelayInFrames() const { return 0; }
+
+    /**
+     * @return destination audio data sample specifications.
+     */
+    const SampleSpec &getDstSampleSpec() const { return mSsDst; }
+
 protected:
     /**
      * Converts the number of frames in the destination sample spec in a number of frames in the
@@ -19,6 +19,7 @@
 
 #include "AudioReformatter.hpp"
 #include <utilities/Log.hpp>
+#include <algorithm>
 
 using audio_comms::utilities::Log;
 using namespace android;
@@ -28,6 +29,8 @@ namespace intel_audio
 
 const uint32_t AudioReformatter::mReformatterShiftLeft16 = 16;
 const uint32_t AudioReformatter::mReformatterShiftRight8 = 8;
+const float AudioReformatter::mS16FullScale = 32768.0f;
+const float AudioReformatter::mS24FullScale = 8388608.0f;
 
 AudioReformatter::AudioReformatter(SampleSpecItem sampleSpecItem)
     : AudioConverter(sampleSpecItem)
@@ -52,6 +55,24 @@ status_t AudioReformatter::configure(const SampleSpec &ssSrc, const SampleSpec &
 
         mConvertSamplesFct =
             static_cast<SampleConverter>(&AudioReformatter::convertS24over32toS16);
+    } else if ((ssSrc.getFormat() == AUDIO_FORMAT_PCM_16_BIT) &&
+               (ssDst.getFormat() == AUDIO_FORMAT_PCM_FLOAT)) {
+
+        mConvertSamplesFct = static_cast<SampleConverter>(&AudioReformatter::convertS16toFloat);
+    } else if ((ssSrc.getFormat() == AUDIO_FORMAT_PCM_FLOAT) &&
+               (ssDst.getFormat() == AUDIO_FORMAT_PCM_16_BIT)) {
+
+        mConvertSamplesFct = static_cast<SampleConverter>(&AudioReformatter::convertFloatToS16);
+    } else if ((ssSrc.getFormat() == AUDIO_FORMAT_PCM_8_24_BIT) &&
+               (ssDst.getFormat() == AUDIO_FORMAT_PCM_FLOAT)) {
+
+        mConvertSamplesFct =
+            static_cast<SampleConverter>(&AudioReformatter::convertS24over32toFloat);
+    } else if ((ssSrc.getFormat() == AUDIO_FORMAT_PCM_FLOAT) &&
+               (ssDst.getFormat() == AUDIO_FORMAT_PCM_8_24_BIT)) {
+
+        mConvertSamplesFct =
+            static_cast<SampleConverter>(&AudioReformatter::convertFloatToS24over32);
     } else {
         Log::Error() << __FUNCTION__ << ": reformatter not available";
         return INVALID_OPERATION;
@@ -104,4 +125,96 @@ status_t AudioReformatter::convertS24over32toS16(const void *src,
 
     return NO_ERROR;
 }
+
+status_t AudioReformatter::convertS16toFloat(const void *src,
+                                             void *dst,
+                                             const size_t inFrames,
+                                             size_t *outFrames)
+{
+    const int16_t *src16 = static_cast<const int16_t *>(src);
+    float *dstFloat = static_cast<float *>(dst);
+    size_t n = inFrames * mSsSrc.getChannelCount();
+
+    for (size_t sampleIndex = 0; sampleIndex < n; sampleIndex++) {
+
+        dstFloat[sampleIndex] = src16[sampleIndex] / mS16FullScale;
+    }
+
+    // Transformation is "iso" frames
+    *outFrames = inFrames;
+
+    return NO_ERROR;
+}
+
+status_t AudioReformatter::convertFloatToS16(const void *src,
+                                             void *dst,
+                                             const size_t inFrames,
+                                             size_t *outFrames)
+{
+    const float *srcFloat = static_cast<const float *>(src);
+    int16_t *dst16 = static_cast<int16_t *>(dst);
+    size_t n = inFrames * mSsSrc.getChannelCount();
+
+    for (size_t sampleIndex = 0; sampleIndex < n; sampleIndex++) {
+
+        dst16[sampleIndex] = static_cast<int16_t>(clamp(srcFloat[sampleIndex] * mS16FullScale,
+                                                        mS16FullScale));
+    }
+
+    // Transformation is "iso" frames
+    *outFrames = inFrames;
+
+    return NO_ERROR;
+}
+
+status_t AudioReformatter::convertS24over32toFloat(const void *src,
+                                                   void *dst,
+                                                   const size_t inFrames,
+                                                   size_t *outFrames)
+{
+    const uint32_t *src32 = static_cast<const uint32_t *>(src);
+    float *dstFloat = static_cast<float *>(dst);
+    size_t n = inFrames * mSsSrc.getChannelCount();
+
+    for (size_t sampleIndex = 0; sampleIndex < n; sampleIndex++) {
+
+        // Only the 24 least significant bits are relevant, sign extended from bit 23.
+        int32_t sample = static_cast<int32_t>(src32[sampleIndex] << mReformatterShiftRight8) >>
+                         mReformatterShiftRight8;
+        dstFloat[sampleIndex] = sample / mS24FullScale;
+    }
+
+    // Transformation is "iso" frames
+    *outFrames = inFrames;
+
+    return NO_ERROR;
+}
+
+status_t AudioReformatter::convertFloatToS24over32(const void *src,
+                                                   void *dst,
+                                                   const size_t inFrames,
+                                                   size_t *outFrames)
+{
+    const float *srcFloat = static_cast<const float *>(src);
+    int32_t *dst32 = static_cast<int32_t *>(dst);
+    size_t n = inFrames * mSsSrc.getChannelCount();
+
+    for (size_t sampleIndex = 0; sampleIndex < n; sampleIndex++) {
+
+        dst32[sampleIndex] = static_cast<int32_t>(clamp(srcFloat[sampleIndex] * mS24FullScale,
+                                                        mS24FullScale));
+    }
+
+    // Transformation is "iso" frames
+    *outFrames = inFrames;
+
+    return NO_ERROR;
+}
+
+float AudioReformatter::clamp(float sample, float fullScale)
+{
+    // Rounded to nearest, full scale itself is out of range for signed integers.
+    sample += sample < 0 ? -0.5f : 0.5f;
+    return std::max(-fullScale, std::min(sample, fullScale - 1));
+}
 }  // namespace intel_audio
@@ -76,6 +76,86 @@ private:
                                             const size_t inFrames,
                                             size_t *outFrames);
 
+    /**
+     * Converts (Reformats) audio samples.
+     *
+     * Reformatting is made from signed 16-bits depth format to float format in [-1.0, 1.0[.
+     *
+     * @param[in]  src Source buffer containing audio samples to reformat.
+     * @param[out] dst Destination buffer for reformatted audio samples.
+     * @param[in]  inFrames number of input frames.
+     * @param[out] outFrames output frames processed.
+     *
+     * @return status NO_ERROR is always returned.
+     */
+    android::status_t convertS16toFloat(const void *src,
+                                        void *dst,
+                                        const size_t inFrames,
+                                        size_t *outFrames);
+
+    /**
+     * Converts (Reformats) audio samples.
+     *
+     * Reformatting is made from float format to signed 16-bits depth format, samples out of
+     * [-1.0, 1.0[ being clipped.
+     *
+     * @param[in]  src Source buffer containing audio samples to reformat.
+     * @param[out] dst Destination buffer for reformatted audio samples.
+     * @param[in]  inFrames number of input frames.
+     * @param[out] outFrames output frames processed.
+     *
+     * @return status NO_ERROR is always returned.
+     */
+    android::status_t convertFloatToS16(const void *src,
+                                        void *dst,
+                                        const size_t inFrames,
+                                        size_t *outFrames);
+
+    /**
+     * Converts (Reformats) audio samples.
+     *
+     * Reformatting is made from signed 24-bits depth format to float format in [-1.0, 1.0[.
+     *
+     * @param[in]  src Source buffer containing audio samples to reformat.
+     * @param[out] dst Destination buffer for reformatted audio samples.
+     * @param[in]  inFrames number of input frames.
+     * @param[out] outFrames output frames processed.
+     *
+     * @return status NO_ERROR is always returned.
+     */
+    android::status_t convertS24over32toFloat(const void *src,
+                                              void *dst,
+                                              const size_t inFrames,
+                                              size_t *outFrames);
+
+    /**
+     * Converts (Reformats) audio samples.
+     *
+     * Reformatting is made from float format to signed 24-bits depth format, samples out of
+     * [-1.0, 1.0[ being clipped.
+     *
+     * @param[in]  src Source buffer containing audio samples to reformat.
+     * @param[out] dst Destination buffer for reformatted audio samples.
+     * @param[in]  inFrames number of input frames.
+     * @param[out] outFrames output frames processed.
+     *
+     * @return status NO_ERROR is always returned.
+     */
+    android::status_t convertFloatToS24over32(const void *src,
+                                              void *dst,
+                                              const size_t inFrames,
+                                              size_t *outFrames);
+
+    /**
+     * Rounds a scaled float sample to the nearest integer value within the signed range.
+     *
+     * @param[in] sample float sample scaled to the full scale of the destination format.
+     * @param[in] fullScale of the destination format.
+     *
+     * @return sample rounded and clipped to [-fullScale, fullScale - 1].
+     */
+    static float clamp(float sample, float fullScale);
+
     /**
      * Used to do 8-bits right shitfs during reformatting operation.
      */
@@ -85,5 +165,8 @@ private:
      * Used to do 16-bits left shitfs during reformatting operation.
      */
     static const uint32_t mReformatterShiftLeft16;
+
+    static const float mS16FullScale; /**< float value of the signed 16-bits full scale. */
+    static const float mS24FullScale; /**< float value of the signed 24-bits full scale. */
 };
 }  // namespace intel_audio
@@ -28,6 +28,32 @@ template <>
 struct AudioRemapper::formatSupported<int16_t> {};
 template <>
 struct AudioRemapper::formatSupported<uint32_t> {};
+template <>
+struct AudioRemapper::formatSupported<float> {};
+
+template <>
+float AudioRemapper::getAveragedSrcFrame<float>(const float *src) const
+{
+    uint32_t validSrcChannels = 0;
+    float dst = 0;
+
+    // Float samples are averaged in float, not to be truncated.
+    for (uint32_t iSrcChannels = 0; iSrcChannels < mSsSrc.getChannelCount(); iSrcChannels++) {
+
+        if (mSsSrc.getChannelsPolicy(iSrcChannels) != SampleSpec::Ignore) {
+
+            dst += src[iSrcChannels];
+            validSrcChannels += 1;
+        }
+    }
+
+    if (validSrcChannels) {
+
+        dst = dst / validSrcChannels;
+    }
+
+    return dst;
+}
 
 AudioRemapper::AudioRemapper(SampleSpecItem sampleSpecItem)
     : AudioConverter(sampleSpecItem)
@@ -54,6 +80,11 @@ status_t AudioRemapper::configure(const SampleSpec &ssSrc, const SampleSpec &ssD
         ret = configure<uint32_t>();
         break;
 
+    case AUDIO_FORMAT_PCM_FLOAT:
+
+        ret = configure<float>();
+        break;
+
     default:
 
         ret = INVALID_OPERATION;
@@ -61,7 +61,7 @@ private:
      * Selects the appropriate remap operation to use according to the source
      * and destination sample specifications.
      *
-     * @tparam type Audio data format from S16 to S32.
+     * @tparam type Audio data format from S16 to S32 or float.
      *
      * @return error code.
      */
@@ -73,7 +73,7 @@ private:
      *
      * Convert a stereo source into a mono destination in typed format.
      *
-     * @tparam type Audio data format from S16 to S32, no other type allowed.
+     * @tparam type Audio data format from S16 to S32 or float, no other type allowed.
      * @param[in] src the source buffer.
      * @param[out] dst the destination buffer, the caller must ensure the destination
      *             is large enough.
@@ -93,7 +93,7 @@ private:
      *
      * Convert a mono source into a stereo destination in typed format.
      *
-     * @tparam type Audio data format from S16 to S32, no other type allowed.
+     * @tparam type Audio data format from S16 to S32 or float, no other type allowed.
      * @param[in] src the source buffer.
      * @param[out] dst the destination buffer, the caller must ensure the destination
      *             is large enough.
@@ -114,7 +114,7 @@ private:
      * Convert a stereo source into a stereo destination in typed format
      * with different channels policy.
      *
-     * @tparam type Audio data format from S16 to S32, no other type allowed.
+     * @tparam type Audio data format from S16 to S32 or float, no other type allowed.
      * @param[in] src the source buffer.
      * @param[out] dst the destination buffer, the caller must ensure the destination
      *             is large enough.
@@ -135,7 +135,7 @@ private:
      * Gets destination channel from the source sample according to the destination
      * channel policy.
      *
-     * @tparam type Audio data format from S16 to S32, no other type allowed.
+     * @tparam type Audio data format from S16 to S32 or float, no other type allowed.
      * @param[in] src16 the source frame.
      * @param[in] channel the channel of the destination.
      *
@@ -150,7 +150,7 @@ private:
      * Gets an averaged value of the source audio frame taking into
      * account the policy of the source channels.
      *
-     * @tparam type Audio data format from S16 to S32, no other type allowed.
+     * @tparam type Audio data format from S16 to S32 or float, no other type allowed.
      * @param[in] src16 the source frame.
      *
      * @return destination channel sample.
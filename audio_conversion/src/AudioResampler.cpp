@@ -80,6 +80,15 @@ status_t AudioResampler::configure(const SampleSpec &ssSrc, const SampleSpec &ss
     return OK;
 }
 
+size_t AudioResampler::getDelayInFrames() const
+{
+    if (mResampler == NULL) {
+
+        return 0;
+    }
+    return mSsDst.convertUsecToframes(mResampler->delay_ns(mResampler) / 1000);
+}
+
 status_t AudioResampler::resampleFrames(const void *src,
                                         void *dst,
                                         const size_t inFrames,
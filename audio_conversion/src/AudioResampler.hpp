@@ -35,6 +35,13 @@ public:
 
     virtual ~AudioResampler();
 
+    /**
+     * Get the delay introduced by the filter of the resampler.
+     *
+     * @return delay in frames in the destination sample spec.
+     */
+    virtual size_t getDelayInFrames() const;
+
 private:
     /**
      * Configures the resampler.
@@ -0,0 +1,143 @@
+/*
+ * Copyright (C) 2015 Intel Corporation
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <AudioConversion.hpp>
+#include <SampleSpec.hpp>
+#include <AudioUtils.hpp>
+#include <media/AudioBufferProvider.h>
+#include <gtest/gtest.h>
+#include <utils/Errors.h>
+#include <stdlib.h>
+#include <vector>
+
+/**
+ * Host only: glibc allocator hooks, counting the heap allocations while armed.
+ */
+extern "C" {
+void *__libc_malloc(size_t size);
+void *__libc_realloc(void *ptr, size_t size);
+void *__libc_calloc(size_t count, size_t size);
+}
+
+static volatile bool heapWatchEnabled = false;
+static volatile uint32_t heapAllocationCount = 0;
+
+static void accountHeapAllocation()
+{
+    if (heapWatchEnabled) {
+        heapAllocationCount = heapAllocationCount + 1;
+    }
+}
+
+void *malloc(size_t size)
+{
+    accountHeapAllocation();
+    return __libc_malloc(size);
+}
+
+void *realloc(void *ptr, size_t size)
+{
+    accountHeapAllocation();
+    return __libc_realloc(ptr, size);
+}
+
+void *calloc(size_t count, size_t size)
+{
+    accountHeapAllocation();
+    return __libc_calloc(count, size);
+}
+
+namespace intel_audio
+{
+
+/**
+ * Provides endlessly the same buffer of silence.
+ */
+class SilenceBufferProvider : public android::AudioBufferProvider
+{
+public:
+    SilenceBufferProvider(const SampleSpec &sampleSpec, size_t frames)
+        : mSampleSpec(sampleSpec),
+          mSilence(sampleSpec.convertFramesToBytes(frames), 0)
+    {}
+
+    virtual android::status_t getNextBuffer(android::AudioBufferProvider::Buffer *buffer,
+                                            int64_t /*pts*/)
+    {
+        size_t frames = mSampleSpec.convertBytesToFrames(mSilence.size());
+        if (buffer->frameCount > frames) {
+            buffer->frameCount = frames;
+        }
+        buffer->raw = &mSilence[0];
+        return android::NO_ERROR;
+    }
+
+    virtual void releaseBuffer(Buffer * /*buffer*/) {}
+
+private:
+    SampleSpec mSampleSpec;
+    std::vector<char> mSilence;
+};
+
+/**
+ * Once reserved, neither convert nor getConvertedBuffer may allocate, as they are called from
+ * the audio thread.
+ */
+TEST(AudioConversion, noHeapAllocationOnceReserved)
+{
+    const size_t maxFrames = 1920;
+    const SampleSpec stereo16At48k(2, AUDIO_FORMAT_PCM_16_BIT, 48000);
+    const SampleSpec mono16At44k(1, AUDIO_FORMAT_PCM_16_BIT, 44100);
+
+    AudioConversion audioConversion;
+    ASSERT_EQ(android::OK, audioConversion.configure(mono16At44k, stereo16At48k));
+    ASSERT_EQ(android::OK, audioConversion.reserve(maxFrames));
+
+    size_t srcFrames = AudioUtils::convertSrcToDstInFrames(maxFrames, stereo16At48k,
+                                                           mono16At44k);
+    std::vector<char> src(mono16At44k.convertFramesToBytes(srcFrames), 0);
+    std::vector<char> dst(stereo16At48k.convertFramesToBytes(maxFrames));
+    SilenceBufferProvider provider(mono16At44k, srcFrames);
+
+    // Results are checked once the watch disarmed, as a failing expectation may allocate.
+    uint32_t failedConversionCount = 0;
+    size_t maxConvertedFrames = 0;
+    heapAllocationCount = 0;
+    heapWatchEnabled = true;
+    for (size_t iteration = 0; iteration < 100; iteration++) {
+        void *convertedBuffer = &dst[0];
+        size_t convertedFrames = 0;
+        if (audioConversion.convert(&src[0], &convertedBuffer, srcFrames,
+                                    &convertedFrames) != android::OK ||
+            convertedFrames == 0 || convertedBuffer != &dst[0]) {
+            failedConversionCount++;
+        }
+        if (convertedFrames > maxConvertedFrames) {
+            maxConvertedFrames = convertedFrames;
+        }
+        if (audioConversion.getConvertedBuffer(&dst[0], maxFrames - iteration % 7,
+                                               &provider) != android::OK) {
+            failedConversionCount++;
+        }
+    }
+    heapWatchEnabled = false;
+
+    EXPECT_EQ(0u, failedConversionCount);
+    EXPECT_LE(maxConvertedFrames, maxFrames);
+    EXPECT_EQ(0u, heapAllocationCount);
+}
+
+} // namespace intel_audio
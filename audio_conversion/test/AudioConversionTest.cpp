@@ -19,6 +19,7 @@
 #include <SampleSpec.hpp>
 #include <AudioUtils.hpp>
 #include <media/AudioBufferProvider.h>
+#include <audio_utils/resampler.h>
 #include <gtest/gtest.h>
 #include <utils/Errors.h>
 
@@ -560,6 +561,96 @@ INSTANTIATE_TEST_CASE_P(reformatS24leToS16,
                             )
                         );
 
+const int16_t sourceBufS16ToFloat[] = {
+    0, 16384,
+    -16384, -32768,
+    8192, -8192
+};
+
+const float expectedDstBufS16ToFloat[] = {
+    0.0f, 0.5f,
+    -0.5f, -1.0f,
+    0.25f, -0.25f
+};
+
+/**
+ * Test a reformating from S16 to float format in iso-channels and rate.
+ */
+INSTANTIATE_TEST_CASE_P(reformatS16leToFloat,
+                        AudioConversionT,
+                        ::testing::Values(
+                            AudioConversionParam(
+                                SampleSpec(2, AUDIO_FORMAT_PCM_16_BIT, 48000),
+                                SampleSpec(2, AUDIO_FORMAT_PCM_FLOAT, 48000),
+                                sourceBufS16ToFloat,
+                                sizeof(sourceBufS16ToFloat),
+                                expectedDstBufS16ToFloat,
+                                sizeof(expectedDstBufS16ToFloat),
+                                false
+                                )
+                            )
+                        );
+
+const float sourceBufFloatToS16[] = {
+    0.0f, 0.5f,
+    -0.5f, -1.0f,
+    1.5f, -1.5f
+};
+
+const int16_t expectedDstBufFloatToS16[] = {
+    0, 16384,
+    -16384, -32768,
+    32767, -32768
+};
+
+/**
+ * Test a reformating from float to S16 format in iso-channels and rate, with clipping.
+ */
+INSTANTIATE_TEST_CASE_P(reformatFloatToS16le,
+                        AudioConversionT,
+                        ::testing::Values(
+                            AudioConversionParam(
+                                SampleSpec(2, AUDIO_FORMAT_PCM_FLOAT, 48000),
+                                SampleSpec(2, AUDIO_FORMAT_PCM_16_BIT, 48000),
+                                sourceBufFloatToS16,
+                                sizeof(sourceBufFloatToS16),
+                                expectedDstBufFloatToS16,
+                                sizeof(expectedDstBufFloatToS16),
+                                false
+                                )
+                            )
+                        );
+
+const uint32_t sourceBufS24ToFloat[] = {
+    0x00000000, 0x00400000,
+    0x00C00000, 0xFF800000,
+    0x00200000, 0x00E00000
+};
+
+const float expectedDstBufS24ToFloat[] = {
+    0.0f, 0.5f,
+    -0.5f, -1.0f,
+    0.25f, -0.25f
+};
+
+/**
+ * Test a reformating from S24 to float format in iso-channels and rate.
+ */
+INSTANTIATE_TEST_CASE_P(reformatS24leToFloat,
+                        AudioConversionT,
+                        ::testing::Values(
+                            AudioConversionParam(
+                                SampleSpec(2, AUDIO_FORMAT_PCM_8_24_BIT, 48000),
+                                SampleSpec(2, AUDIO_FORMAT_PCM_FLOAT, 48000),
+                                sourceBufS24ToFloat,
+                                sizeof(sourceBufS24ToFloat),
+                                expectedDstBufS24ToFloat,
+                                sizeof(expectedDstBufS24ToFloat),
+                                false
+                                )
+                            )
+                        );
+
 const uint16_t sourceBuf11[] = {
     10, 20,
     5, 1,
@@ -974,4 +1065,59 @@ TEST(AudioConversion, frameExactApi)
     // @todo: quality check of output
 }
 
+/**
+ * Test the description of the conversion chain, down conversions being done before resampling.
+ */
+TEST(AudioConversion, conversionPlan)
+{
+    AudioConversion audioConversion;
+    EXPECT_EQ("none", audioConversion.getConversionPlan());
+
+    const SampleSpec stereo16At48k(2, AUDIO_FORMAT_PCM_16_BIT, 48000);
+    EXPECT_EQ(0, audioConversion.configure(stereo16At48k, stereo16At48k));
+    EXPECT_EQ("none", audioConversion.getConversionPlan());
+
+    const SampleSpec mono16At8k(1, AUDIO_FORMAT_PCM_16_BIT, 8000);
+    EXPECT_EQ(0, audioConversion.configure(mono16At8k, stereo16At48k));
+    EXPECT_EQ("resample > remap", audioConversion.getConversionPlan());
+
+    const SampleSpec stereo24At44k(2, AUDIO_FORMAT_PCM_8_24_BIT, 44100);
+    EXPECT_EQ(0, audioConversion.configure(stereo24At44k, stereo16At48k));
+    EXPECT_EQ("reformat > resample", audioConversion.getConversionPlan());
+}
+
+TEST(AudioConversion, conversionDelay)
+{
+    AudioConversion audioConversion;
+    EXPECT_EQ(0u, audioConversion.getDelayInFrames());
+
+    const SampleSpec stereo16At48k(2, AUDIO_FORMAT_PCM_16_BIT, 48000);
+    const SampleSpec mono16At48k(1, AUDIO_FORMAT_PCM_16_BIT, 48000);
+    EXPECT_EQ(0, audioConversion.configure(stereo16At48k, mono16At48k));
+    EXPECT_EQ(0u, audioConversion.getDelayInFrames());
+
+    // Only the resampler holds frames in its filter history
+    const SampleSpec stereo16At8k(2, AUDIO_FORMAT_PCM_16_BIT, 8000);
+    struct resampler_itfe *resampler;
+    ASSERT_EQ(0, create_resampler(8000, 48000, 2, RESAMPLER_QUALITY_DEFAULT, NULL, &resampler));
+    const size_t filterDelay = stereo16At48k.convertUsecToframes(
+        resampler->delay_ns(resampler) / 1000);
+    release_resampler(resampler);
+    EXPECT_EQ(0, audioConversion.configure(stereo16At8k, stereo16At48k));
+    EXPECT_EQ(filterDelay, audioConversion.getDelayInFrames());
+
+    // 10 frames requested, 2 source frames rounded up converted into 12 frames: 2 frames held
+    const uint16_t sourceBuf[] = {
+        10, 20, 5, 1, 3, 8, 12, 15
+    };
+    int16_t dstBuf[stereo16At48k.convertFramesToBytes(10) / sizeof(int16_t)];
+    MyAudioBufferProvider bufferProvider(&sourceBuf[0], sizeof(sourceBuf) / sizeof(uint16_t));
+    EXPECT_EQ(0, audioConversion.getConvertedBuffer(dstBuf, 10, &bufferProvider));
+    EXPECT_EQ(filterDelay + 2, audioConversion.getDelayInFrames());
+
+    // Frames held consumed first
+    EXPECT_EQ(0, audioConversion.getConvertedBuffer(dstBuf, 2, &bufferProvider));
+    EXPECT_EQ(filterDelay, audioConversion.getDelayInFrames());
+}
+
 } // namespace intel_audio
@@ -17,6 +17,7 @@
 
 #include "AudioHalConf.hpp"
 #include "Parameter.hpp"
+#include <RoutingParameters.hpp>
 #include <Pfw.hpp>
 #include <NonCopyable.hpp>
 #include <KeyValuePairs.hpp>
@@ -148,6 +149,18 @@ public:
      */
     android::status_t setParameters(const std::string &keyValuePairs, bool &hasChanged);
 
+    /**
+     * Sets the routing parameters of the streams to the parameters of the same keys, without
+     * going through their literal representation.
+     *
+     * @param[in] parameters aggregated over the streams.
+     * @param[out] hasChanged: return true if the platform has changed due to new param,
+     *                         false otherwise
+     *
+     * @return OK if these parameters were applied correctly, error code otherwise.
+     */
+    android::status_t setRoutingParameters(const RoutingParameters &parameters, bool &hasChanged);
+
     /**
      * Get the global parameters of Audio HAL.
      *
@@ -157,6 +170,13 @@ public:
      */
     std::string getParameters(const std::string &keys);
 
+    /**
+     * Get the values of the criteria of both Audio and Route PFW, for debug purposes.
+     *
+     * @return criteria with their literal and numerical values, one per line.
+     */
+    std::string getCriteriaState() const;
+
     /**
      * Print debug information from target debug files
      */
@@ -316,6 +336,15 @@ private:
      */
     void clearKeys(KeyValuePairs *pairs);
 
+    /**
+     * Sets a numerical value to the parameters of an android-parameter key.
+     *
+     * @param[in] key of the android parameter.
+     * @param[in] value to set.
+     * @param[in,out] hasChanged: set to true if the value of a parameter has changed.
+     */
+    void setParameterValue(const std::string &key, uint32_t value, bool &hasChanged);
+
     /**
      * Load the criterion configuration file.
      *
@@ -18,6 +18,7 @@
 
 #include <NonCopyable.hpp>
 #include <map>
+#include <stdint.h>
 #include <string>
 
 namespace intel_audio
@@ -92,6 +93,16 @@ public:
      */
     virtual bool setValue(const std::string &value) = 0;
 
+    /**
+     * Sets a numerical value to the parameter, as received from the typed routing parameters.
+     * By default, the value goes through its literal representation.
+     *
+     * @param[in] value to set.
+     *
+     * @return true if set is successful, false otherwise.
+     */
+    virtual bool setNumericalValue(uint32_t value);
+
     /**
      * Gets the value from the Parameter. The value returned must be in the domain
      * of the android parameter.
@@ -25,6 +25,7 @@
 #include <Criterion.hpp>
 #include <CriterionType.hpp>
 #include <ParameterMgrHelper.hpp>
+#include <Parameters.hpp>
 #include <property/Property.hpp>
 #include "NaiveTokenizer.h"
 #include <algorithm>
@@ -229,6 +230,55 @@ status_t AudioPlatformState::setParameters(const string &keyValuePairs, bool &ha
     return ret;
 }
 
+void AudioPlatformState::setParameterValue(const std::string &key, uint32_t value,
+                                           bool &hasChanged)
+{
+    for (std::vector<Parameter *>::iterator it = mParameterVector.begin();
+         it != mParameterVector.end(); ++it) {
+        Parameter *param = *it;
+        if (param->getKey() != key || !param->setNumericalValue(value)) {
+            // Unchanged values are not reported as errors, contrary to the string path.
+            continue;
+        }
+        hasChanged = true;
+        if (param->getType() == Parameter::CriterionParameter) {
+            criterionHasChanged(param->getName());
+        }
+    }
+}
+
+status_t AudioPlatformState::setRoutingParameters(const RoutingParameters &parameters,
+                                                  bool &hasChanged)
+{
+    for (size_t direction = 0; direction < Direction::gNbDirections; direction++) {
+        const RoutingParameters::StreamsParameters &streams = parameters.streams[direction];
+        if (!streams.isSet) {
+            continue;
+        }
+        Log::Verbose() << __FUNCTION__ << ": " << Parameters::gKeyDevices[direction] << "="
+                       << streams.devices << " " << Parameters::gKeyFlags[direction] << "="
+                       << streams.flagMask << " " << Parameters::gKeyUseCases[direction] << "="
+                       << streams.useCaseMask;
+        if (direction == Direction::Output) {
+            setParameterValue(Parameters::gKeyAndroidMode, parameters.mode, hasChanged);
+        } else {
+            setParameterValue(Parameters::gKeyVoipBandType, parameters.band, hasChanged);
+            setParameterValue(Parameters::gKeyPreProcRequested, parameters.preProcRequested,
+                              hasChanged);
+        }
+        setParameterValue(Parameters::gKeyUseCases[direction], streams.useCaseMask, hasChanged);
+        setParameterValue(Parameters::gKeyDevices[direction], streams.devices, hasChanged);
+        setParameterValue(Parameters::gKeyFlags[direction], streams.flagMask, hasChanged);
+    }
+    if (!hasChanged) {
+        return android::OK;
+    }
+    // Same commit as setParameters, any change of Audio PFW must be done within the routing.
+    getPfw<Route>()->commitCriteriaAndApplyConfiguration();
+    stageCriterion<Route>(gStateChangedCriterion, 0);
+    return android::OK;
+}
+
 void AudioPlatformState::criterionHasChanged(const std::string &event)
 {
     if (event == gAndroidModeCriterion) {
@@ -248,6 +298,12 @@ string AudioPlatformState::getParameters(const string &keys)
     return returnedPairs.toString();
 }
 
+string AudioPlatformState::getCriteriaState() const
+{
+    return "  Audio PFW criteria:\n" + getPfw<Audio>()->getCriteriaState() +
+           "  Route PFW criteria:\n" + getPfw<Route>()->getCriteriaState();
+}
+
 void AudioPlatformState::setPlatformStateEvent(const string &eventStateName)
 {
     uint32_t stateChanged = getPfw<Route>()->getCriterion(gStateChangedCriterion);
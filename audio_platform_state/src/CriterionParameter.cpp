@@ -16,6 +16,7 @@
 
 #include "CriterionParameter.hpp"
 #include <IStreamInterface.hpp>
+#include <CriterionType.hpp>
 #include <convert.hpp>
 #include <utilities/Log.hpp>
 
@@ -46,6 +47,21 @@ bool CriterionParameter::setValue(const std::string &value)
     return mCriterion.setValue(literalValue);
 }
 
+bool CriterionParameter::setNumericalValue(uint32_t value)
+{
+    if (!mMappingValuesMap.empty()) {
+        return Parameter::setNumericalValue(value);
+    }
+    const CriterionType *criterionType = mCriterion.getCriterionType();
+    if (!criterionType->isInclusive() && !criterionType->isNumericValueValid(value)) {
+        Log::Warning() << __FUNCTION__
+                       << ": invalid value(" << value << ") for " << getKey();
+        return false;
+    }
+    Log::Verbose() << __FUNCTION__ << ": " << getName() << "=" << value;
+    return mCriterion.setValue(value);
+}
+
 bool CriterionParameter::getValue(std::string &value) const
 {
     std::string criterionLiteralValue = mCriterion.getValue<std::string>();
@@ -39,6 +39,16 @@ public:
 
     virtual bool setValue(const std::string &value);
 
+    /**
+     * Sets the numerical value to the criterion as it, unless a mapping is provided, in which
+     * case the value is an android parameter value to be mapped.
+     *
+     * @param[in] value to set.
+     *
+     * @return true if the criterion has changed, false if unchanged or invalid value.
+     */
+    virtual bool setNumericalValue(uint32_t value);
+
     virtual bool getValue(std::string &value) const;
 
     /**
@@ -16,6 +16,7 @@
 
 #include "Parameter.hpp"
 #include <AudioCommsAssert.hpp>
+#include <convert.hpp>
 #include <utilities/Log.hpp>
 
 using std::string;
@@ -33,6 +34,15 @@ void Parameter::setMappingValuePair(const string &name, const string &value)
     mMappingValuesMap[name] = value;
 }
 
+bool Parameter::setNumericalValue(uint32_t value)
+{
+    string literal;
+    if (!audio_comms::utilities::convertTo(value, literal)) {
+        return false;
+    }
+    return setValue(literal);
+}
+
 bool Parameter::getLiteralValueFromParam(const string &androidParam, string &literalValue) const
 {
     if (mMappingValuesMap.empty()) {
@@ -27,6 +27,7 @@
 #include <ParameterMgrHelper.hpp>
 #include <property/Property.hpp>
 #include <algorithm>
+#include <sstream>
 #include <convert.hpp>
 #include <cutils/bitops.h>
 #include <cutils/config_utils.h>
@@ -508,6 +509,18 @@ uint32_t Pfw<Trait>::getCriterion(const string &name) const
     return criterion->getValue<uint32_t>();
 }
 
+template <class Trait>
+string Pfw<Trait>::getCriteriaState() const
+{
+    std::ostringstream state;
+    for (CriterionMapConstIterator it = mCriteria.begin(); it != mCriteria.end(); ++it) {
+        const Criterion *criterion = it->second;
+        state << "    " << it->first << ": " << criterion->getValue<std::string>()
+              << " (0x" << std::hex << criterion->getValue<uint32_t>() << std::dec << ")\n";
+    }
+    return state.str();
+}
+
 template <class Trait>
 void Pfw<Trait>::loadCriterion(cnode &root, std::vector<Parameter *> &parameterVector)
 {
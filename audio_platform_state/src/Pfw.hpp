@@ -121,6 +121,11 @@ public:
 
     uint32_t getCriterion(const std::string &name) const;
 
+    /**
+     * @return the criteria of this PFW with their literal and numerical values, one per line.
+     */
+    std::string getCriteriaState() const;
+
     /**
      * Apply the configuration of the platform on the route parameter manager.
      * Once all the criteria have been set, the client of the platform state must call
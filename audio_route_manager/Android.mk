@@ -152,6 +152,35 @@ include $(OPTIONAL_QUALITY_COVERAGE_JUMPER)
 
 include $(BUILD_HOST_SHARED_LIBRARY)
 
+#######################################################################
+# Component Functional Test Host Build
+
+include $(CLEAR_VARS)
+
+LOCAL_MODULE := audio_route_manager_fcttest_host
+LOCAL_MODULE_OWNER := intel
+LOCAL_MODULE_TAGS := optional
+
+LOCAL_SRC_FILES := test/StreamRouteCollectionTest.cpp
+LOCAL_C_INCLUDES := \
+    $(LOCAL_PATH) \
+    $(component_includes_dir_host) \
+    external/gtest/include
+LOCAL_CFLAGS := $(component_cflags)
+LOCAL_STATIC_LIBRARIES := \
+    $(component_static_lib_host) \
+    libgtest_host \
+    libgtest_main_host
+LOCAL_SHARED_LIBRARIES := \
+    libaudioroutemanager_host \
+    $(component_shared_lib_host)
+
+include $(OPTIONAL_QUALITY_COVERAGE_JUMPER)
+# Cannot use $(BUILD_HOST_NATIVE_TEST) because of compilation flag
+# misalignment against gtest mk files
+
+include $(BUILD_HOST_EXECUTABLE)
+
 #######################################################################
 # Build for target to export headers
 
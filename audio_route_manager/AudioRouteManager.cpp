@@ -24,6 +24,9 @@
 #include <IoStream.hpp>
 #include <BitField.hpp>
 #include <cutils/bitops.h>
+#include <stdio.h>
+#include <algorithm>
+#include <sstream>
 #include <string>
 
 #include <utilities/Log.hpp>
@@ -43,6 +46,9 @@ namespace intel_audio
 AudioRouteManager::AudioRouteManager()
     : mEventThread(new CEventThread(this)),
       mIsStarted(false),
+      mIsRoutingRequested(false),
+      mRoutingPassStageDurations(),
+      mLastRoutingPassTime(0),
       mPlatformState(NULL)
 {
 }
@@ -138,8 +144,11 @@ void AudioRouteManager::reconsiderRoutingUnsafe(bool isSynchronous)
         return;
     }
 
-    AUDIOCOMMS_ASSERT(!mEventThread->inThreadContext(), "Failure: not in correct thread context!");
+    // Asynchronous requests may be issued from the event thread, e.g. by routing timer listeners.
+    AUDIOCOMMS_ASSERT(!isSynchronous || !mEventThread->inThreadContext(),
+                      "Failure: not in correct thread context!");
 
+    mIsRoutingRequested = true;
     if (!isSynchronous) {
         // Trigs the processing of the list
         mEventThread->trig(NULL);
@@ -208,15 +217,30 @@ void AudioRouteManager::doReconsiderRouting()
 
 void AudioRouteManager::executeRouting()
 {
+    mStreamRouteMap.resetRoutingDurations();
+    nsecs_t stageStart = systemTime();
+
     executeMuteRoutingStage();
+    stageStart = accountRoutingPassStage(MuteStage, stageStart);
 
     executeDisableRoutingStage();
+    stageStart = accountRoutingPassStage(DisableStage, stageStart);
 
     executeConfigureRoutingStage();
+    stageStart = accountRoutingPassStage(ConfigureStage, stageStart);
 
     executeEnableRoutingStage();
+    stageStart = accountRoutingPassStage(EnableStage, stageStart);
 
     executeUnmuteRoutingStage();
+    mLastRoutingPassTime = accountRoutingPassStage(UnmuteStage, stageStart);
+}
+
+nsecs_t AudioRouteManager::accountRoutingPassStage(RoutingPassStage stage, nsecs_t stageStart)
+{
+    nsecs_t stageEnd = systemTime();
+    mRoutingPassStageDurations[stage] = stageEnd - stageStart;
+    return stageEnd;
 }
 
 void AudioRouteManager::resetRouting()
@@ -315,9 +339,59 @@ bool AudioRouteManager::onHangup(int)
     return false;
 }
 
+void AudioRouteManager::armRoutingTimer(uint32_t delayMs, IRoutingTimerListener &listener)
+{
+    {
+        android::Mutex::Autolock lock(mRoutingTimerLock);
+        mRoutingTimers[&listener] = systemTime() + ms2ns(delayMs);
+    }
+    AutoR lock(mRoutingLock);
+    if (!mIsStarted) {
+        Log::Warning() << __FUNCTION__ << ": Route Manager not started, timer will not expire";
+        return;
+    }
+    // Alarm of the event thread is updated from its own context
+    mEventThread->trig(NULL);
+}
+
+void AudioRouteManager::disarmRoutingTimer(IRoutingTimerListener &listener)
+{
+    android::Mutex::Autolock lock(mRoutingTimerLock);
+    mRoutingTimers.erase(&listener);
+}
+
+void AudioRouteManager::updateRoutingAlarmL()
+{
+    if (mRoutingTimers.empty()) {
+        mEventThread->cancelAlarm();
+        return;
+    }
+    nsecs_t earliestExpiry = mRoutingTimers.begin()->second;
+    for (std::map<IRoutingTimerListener *, nsecs_t>::const_iterator it = mRoutingTimers.begin();
+         it != mRoutingTimers.end(); ++it) {
+        earliestExpiry = std::min(earliestExpiry, it->second);
+    }
+    // Alarm granularity is the millisecond, round up not to expire too early
+    nsecs_t delay = earliestExpiry - systemTime();
+    mEventThread->setAlarmMs(delay > 0 ? ns2ms(delay + ms2ns(1) - 1) : 1);
+}
+
 void AudioRouteManager::onAlarm()
 {
-    Log::Debug() << __FUNCTION__;
+    Log::Verbose() << __FUNCTION__;
+    android::Mutex::Autolock lock(mRoutingTimerLock);
+    nsecs_t now = systemTime();
+    std::map<IRoutingTimerListener *, nsecs_t>::iterator it = mRoutingTimers.begin();
+    while (it != mRoutingTimers.end()) {
+        if (it->second > now) {
+            ++it;
+            continue;
+        }
+        IRoutingTimerListener *listener = it->first;
+        mRoutingTimers.erase(it++);
+        listener->onRoutingTimer();
+    }
+    updateRoutingAlarmL();
 }
 
 void AudioRouteManager::onPollError()
@@ -326,11 +400,17 @@ void AudioRouteManager::onPollError()
 
 bool AudioRouteManager::onProcess(void *, uint32_t)
 {
-    AutoW lock(mRoutingLock);
-    doReconsiderRouting();
-
-    // Notify all potential observer of Route Manager Subject
-    notify();
+    {
+        AutoW lock(mRoutingLock);
+        if (mIsRoutingRequested) {
+            mIsRoutingRequested = false;
+            doReconsiderRouting();
+        }
+        // Notify all potential observer of Route Manager Subject
+        notify();
+    }
+    android::Mutex::Autolock lock(mRoutingTimerLock);
+    updateRoutingAlarmL();
 
     return false;
 }
@@ -387,6 +467,21 @@ uint32_t AudioRouteManager::getPeriodInUs(const IoStream &stream) const
     return route->getPeriodInUs();
 }
 
+uint32_t AudioRouteManager::getPeriodInUsForConfig(bool isOut, uint32_t flagMask,
+                                                   uint32_t useCaseMask, audio_devices_t devices,
+                                                   const SampleSpec &sampleSpec) const
+{
+    AutoR lock(mRoutingLock);
+    const AudioStreamRoute *route = mStreamRouteMap.findMatchingRouteForConfig(
+        isOut, flagMask, useCaseMask, devices, sampleSpec);
+    if (route == NULL) {
+        Log::Error() << __FUNCTION__ << ": no route found for stream with flags=0x" << std::hex
+                     << flagMask << ", use case =" << useCaseMask;
+        return 0;
+    }
+    return route->getPeriodInUs();
+}
+
 uint32_t AudioRouteManager::getLatencyInUs(const IoStream &stream) const
 {
     AutoR lock(mRoutingLock);
@@ -475,12 +570,75 @@ status_t AudioRouteManager::setParameters(const std::string &keyValuePair, bool
     return ret;
 }
 
+status_t AudioRouteManager::setRoutingParameters(const RoutingParameters &parameters,
+                                                 bool isSynchronous)
+{
+    AutoW lock(mRoutingLock);
+    bool hasChanged = false;
+    status_t ret = mPlatformState->setRoutingParameters(parameters, hasChanged);
+    if (hasChanged) {
+        reconsiderRoutingUnsafe(isSynchronous);
+    }
+    return ret;
+}
+
 std::string AudioRouteManager::getParameters(const std::string &keys) const
 {
     AutoR lock(mRoutingLock);
     return mPlatformState->getParameters(keys);
 }
 
+template <Direction::Values dir>
+void AudioRouteManager::dumpRouteMasksUnsafe(std::ostream &state) const
+{
+    state << "    " << (dir == Direction::Output ? "Output" : "Input") << " routes:"
+          << "\n      enabled: " << routeMaskToString<dir>(mRouteMap.enabledRouteMask(dir))
+          << "\n      previously enabled: "
+          << routeMaskToString<dir>(mRouteMap.prevEnabledRouteMask(dir))
+          << "\n      need reconfiguration: "
+          << routeMaskToString<dir>(mRouteMap.needReflowRouteMask(dir))
+          << "\n      need rerouting: "
+          << routeMaskToString<dir>(mRouteMap.needRepathRouteMask(dir)) << "\n";
+}
+
+void AudioRouteManager::dumpStateUnsafe(std::ostream &state) const
+{
+    static const char *const stageNames[gNbRoutingPassStages] = {
+        "mute", "disable", "configure", "enable", "unmute"
+    };
+    state << "  Route Manager:\n";
+    dumpRouteMasksUnsafe<Direction::Output>(state);
+    dumpRouteMasksUnsafe<Direction::Input>(state);
+    if (mLastRoutingPassTime != 0) {
+        state << "    last routing pass: " << ns2ms(systemTime() - mLastRoutingPassTime)
+              << " ms ago";
+        for (uint32_t i = 0; i < gNbRoutingPassStages; i++) {
+            state << (i == 0 ? ", " : " / ") << stageNames[i] << " "
+                  << ns2us(mRoutingPassStageDurations[i]) << " us";
+        }
+        state << "\n";
+    }
+    state << "    Stream routes:\n";
+    mStreamRouteMap.dumpState(state);
+    state << mPlatformState->getCriteriaState();
+}
+
+void AudioRouteManager::dump(int fd) const
+{
+    std::ostringstream state;
+    {
+        // Snapshot taken under the routing lock, written once released not to block the routing
+        // on the dump output.
+        AutoR lock(mRoutingLock);
+        if (mIsStarted) {
+            dumpStateUnsafe(state);
+        } else {
+            state << "  Route Manager not started\n";
+        }
+    }
+    dprintf(fd, "%s", state.str().c_str());
+}
+
 bool AudioRouteManager::addRoute(AudioRoute *route, const string &portSrc, const string &portDst,
                                  bool isOut)
 {
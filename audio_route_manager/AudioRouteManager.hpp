@@ -38,8 +38,11 @@
 #include <EventListener.h>
 #include <NonCopyable.hpp>
 #include <utils/RWLock.h>
+#include <utils/Mutex.h>
+#include <utils/Timers.h>
 #include <list>
 #include <map>
+#include <ostream>
 #include <vector>
 
 namespace intel_audio
@@ -74,6 +77,8 @@ private:
     }
 
     virtual void reconsiderRouting(bool isSynchronous = false);
+    virtual void armRoutingTimer(uint32_t delayMs, IRoutingTimerListener &listener);
+    virtual void disarmRoutingTimer(IRoutingTimerListener &listener);
     virtual android::status_t setVoiceVolume(float gain);
     virtual IoStream *getVoiceOutputStream()
     {
@@ -82,13 +87,19 @@ private:
     }
     virtual uint32_t getLatencyInUs(const IoStream &stream) const;
     virtual uint32_t getPeriodInUs(const IoStream &stream) const;
+    virtual uint32_t getPeriodInUsForConfig(bool isOut, uint32_t flagMask, uint32_t useCaseMask,
+                                            audio_devices_t devices,
+                                            const SampleSpec &sampleSpec) const;
     virtual bool supportStreamConfig(const IoStream &stream) const;
     virtual AudioCapabilities getCapabilities(const IoStream &stream) const;
     virtual android::status_t setParameters(const std::string &keyValuePair,
                                             bool isSynchronous = false);
+    virtual android::status_t setRoutingParameters(const RoutingParameters &parameters,
+                                                   bool isSynchronous = false);
 
     virtual std::string getParameters(const std::string &keys) const;
     virtual void printPlatformFwErrorInfo() const {}
+    virtual void dump(int fd) const;
 
     /// From Route Interface
     virtual void addPort(const std::string &name);
@@ -222,6 +233,44 @@ private:
      */
     void executeRouting();
 
+    /** Stages of a routing pass, as timed for debug purposes. */
+    enum RoutingPassStage
+    {
+        MuteStage = 0,
+        DisableStage,
+        ConfigureStage,
+        EnableStage,
+        UnmuteStage,
+        gNbRoutingPassStages
+    };
+
+    /**
+     * Stores the duration of a stage of the current routing pass.
+     *
+     * @param[in] stage that has just been executed.
+     * @param[in] stageStart start time of the stage.
+     *
+     * @return end time of the stage, i.e. start time of the next one.
+     */
+    nsecs_t accountRoutingPassStage(RoutingPassStage stage, nsecs_t stageStart);
+
+    /**
+     * Appends the route masks of a direction to a debug snapshot.
+     * Must be called with routing lock held.
+     *
+     * @tparam dir Direction of the routes.
+     * @param[in,out] state snapshot to append to.
+     */
+    template <Direction::Values dir>
+    void dumpRouteMasksUnsafe(std::ostream &state) const;
+
+    /**
+     * Appends the routing state to a debug snapshot. Must be called with routing lock held.
+     *
+     * @param[in,out] state snapshot to append to.
+     */
+    void dumpStateUnsafe(std::ostream &state) const;
+
     /**
      * Mute the routes.
      * Mute action will be applied on route pointed by ClosingRoutes criterion.
@@ -297,6 +346,12 @@ private:
      */
     void reset();
 
+    /**
+     * Arms the alarm of the event thread on the earliest routing timer, or cancels it if no timer
+     * is armed. Must be called from the event thread context with routing timer lock held.
+     */
+    void updateRoutingAlarmL();
+
     /// from IEventListener
     virtual bool onEvent(int);
     virtual bool onError(int);
@@ -322,6 +377,29 @@ private:
 
     mutable android::RWLock mRoutingLock; /**< lock to protect the routing. */
 
+    /**
+     * Routing reconsideration requested, as the event thread may also be triggered to update the
+     * standby alarm. Protected by the routing lock.
+     */
+    bool mIsRoutingRequested;
+
+    /** Expiry time of the routing timers, per listener. */
+    std::map<IRoutingTimerListener *, nsecs_t> mRoutingTimers;
+
+    /**
+     * Lock to protect the routing timers. Held while notifying the listeners, so that a listener
+     * disarming its timer is guaranteed not to be notified anymore.
+     * Lock order: routing timer lock first, then the locks taken by the listeners, i.e. the patch
+     * collection lock of the device, the routing lock and the stream locks. Must thus never be
+     * taken with any of them held.
+     */
+    android::Mutex mRoutingTimerLock;
+
+    /** Durations of the stages of the last routing pass, for debug purposes. */
+    nsecs_t mRoutingPassStageDurations[gNbRoutingPassStages];
+
+    nsecs_t mLastRoutingPassTime; /**< End time of the last routing pass, 0 if none. */
+
     AudioPlatformState *mPlatformState; /**< Platform state handler for Route / Audio PFW. */
 };
 
@@ -23,6 +23,7 @@
 #include <AudioCommsAssert.hpp>
 #include <utilities/Log.hpp>
 #include <tinyalsa/asoundlib.h>
+#include <algorithm>
 
 using std::string;
 using audio_comms::utilities::Log;
@@ -136,9 +137,84 @@ const StreamRouteConfig AudioStreamRoute::getRouteConfig() const
     config.rate = mCurrentRate;
     config.format = mCurrentFormat;
     config.channels = popcount(mCurrentChannelMask);
+
+    StreamRouteConfig::LatencyProfile profile = getCurrentLatencyProfile();
+    uint64_t bufferSize = profile.periodSize * profile.periodCount;
+    uint64_t defaultBufferSize = mConfig.periodSize * mConfig.periodCount;
+    if (defaultBufferSize != 0 && bufferSize != defaultBufferSize) {
+        // Thresholds within the ring buffer follow the profile, boundaries are left untouched.
+        if (config.startThreshold <= defaultBufferSize) {
+            config.startThreshold = config.startThreshold * bufferSize / defaultBufferSize;
+        }
+        if (config.stopThreshold <= defaultBufferSize) {
+            config.stopThreshold = config.stopThreshold * bufferSize / defaultBufferSize;
+        }
+        if (mConfig.periodSize != 0) {
+            config.availMin =
+                static_cast<uint64_t>(config.availMin) * profile.periodSize / mConfig.periodSize;
+        }
+    }
+    config.periodSize = profile.periodSize;
+    config.periodCount = profile.periodCount;
     return config;
 }
 
+StreamRouteConfig::LatencyProfile AudioStreamRoute::getCurrentLatencyProfile() const
+{
+    if (mConfig.latencyProfiles.empty()) {
+        StreamRouteConfig::LatencyProfile profile = { mConfig.periodSize, mConfig.periodCount };
+        return profile;
+    }
+    return mConfig.latencyProfiles[std::min<uint32_t>(mCurrentLatencyProfile,
+                                                      mConfig.latencyProfiles.size() - 1)];
+}
+
+uint32_t AudioStreamRoute::selectLatencyProfile(const IoStream &stream)
+{
+    if (mConfig.latencyProfiles.empty()) {
+        return 0;
+    }
+    uint32_t highestProfile = mConfig.latencyProfiles.size() - 1;
+    uint32_t flags = stream.getFlagMask();
+    uint32_t baseProfile = std::min(mConfig.defaultLatencyProfile, highestProfile);
+    if ((stream.isOut() && (flags & AUDIO_OUTPUT_FLAG_FAST)) ||
+        (!stream.isOut() && (flags & AUDIO_INPUT_FLAG_FAST))) {
+        baseProfile = 0;
+    } else if (stream.isOut() && (flags & AUDIO_OUTPUT_FLAG_DEEP_BUFFER)) {
+        baseProfile = highestProfile;
+    }
+
+    nsecs_t now = systemTime();
+    if (mXrunsInWindow >= mXrunsBeforeStepUp && (now - mXrunWindowStart) <= mXrunWindow &&
+        baseProfile + mLatencyStep < highestProfile) {
+        ++mLatencyStep;
+        mXrunsInWindow = 0;
+        mLastLatencyStepTime = now;
+        Log::Info() << __FUNCTION__ << ": repeated xruns on route " << getName()
+                    << ", stepping up latency (step=" << mLatencyStep << ")";
+    } else if (mLatencyStep > 0 &&
+               (now - std::max<nsecs_t>(mLastXrunTime, mLastLatencyStepTime)) >
+               mQuietPeriodBeforeStepDown) {
+        --mLatencyStep;
+        mLastLatencyStepTime = now;
+        Log::Info() << __FUNCTION__ << ": no xrun on route " << getName()
+                    << ", stepping down latency (step=" << mLatencyStep << ")";
+    }
+    return std::min(baseProfile + mLatencyStep, highestProfile);
+}
+
+bool AudioStreamRoute::onXrun()
+{
+    nsecs_t now = systemTime();
+    mLastXrunTime = now;
+    if ((now - mXrunWindowStart) > mXrunWindow) {
+        mXrunWindowStart = now;
+        mXrunsInWindow = 0;
+    }
+    return ++mXrunsInWindow == mXrunsBeforeStepUp &&
+           mCurrentLatencyProfile + 1 < mConfig.latencyProfiles.size();
+}
+
 void AudioStreamRoute::updateStreamRouteConfig(const StreamRouteConfig &config)
 {
     Log::Verbose() << __FUNCTION__
@@ -158,6 +234,12 @@ void AudioStreamRoute::updateStreamRouteConfig(const StreamRouteConfig &config)
                    << "\n\t  format control=" << config.dynamicFormatsControl
                    << "\n\t  rate control=" << config.dynamicRatesControl;
     mConfig = config;
+    if (!mAudioDevice->isOpened()) {
+        // Until a stream is routed, latency is reported according to the default profile.
+        mCurrentLatencyProfile = mConfig.latencyProfiles.empty() ? 0 :
+                                 std::min<uint32_t>(mConfig.defaultLatencyProfile,
+                                                    mConfig.latencyProfiles.size() - 1);
+    }
     if (!StreamRouteConfig::isDynamic(config.rate)) {
         mCapabilities.supportedRates.push_back(config.rate);
         mCurrentRate = config.rate;
@@ -178,6 +260,7 @@ android::status_t AudioStreamRoute::route(bool isPreEnable)
 {
     if (isPreEnable == isPreEnableRequired()) {
 
+        mCurrentLatencyProfile = mNewLatencyProfile;
         android::status_t err = mAudioDevice->open(getCardName(), getPcmDeviceId(),
                                                    getRouteConfig(), isOut());
         if (err) {
@@ -268,6 +351,7 @@ bool AudioStreamRoute::setStream(IoStream &stream)
                      stream.getFormat() : mCapabilities.getDefaultFormat();
     mCurrentChannelMask = mCapabilities.supportChannelMask(stream.getChannels()) ?
                           stream.getChannels() : mCapabilities.getDefaultChannelMask();
+    mNewLatencyProfile = selectLatencyProfile(stream);
 
     mNewStream->setNewStreamRoute(this);
     return true;
@@ -290,6 +374,15 @@ bool AudioStreamRoute::isMatchingWithStream(const IoStream &stream) const
            supportStreamConfig(stream);
 }
 
+bool AudioStreamRoute::isMatchingWithConfig(bool isOut, uint32_t flagMask, uint32_t useCaseMask,
+                                            const SampleSpec &sampleSpec) const
+{
+    return (isOut == this->isOut()) &&
+           areFlagsMatching(flagMask) &&
+           areUseCasesMatching(useCaseMask) &&
+           supportConfig(sampleSpec);
+}
+
 bool AudioStreamRoute::supportDevices(audio_devices_t streamDeviceMask) const
 {
     return streamDeviceMask != AUDIO_DEVICE_NONE &&
@@ -350,12 +443,13 @@ void AudioStreamRoute::addEffectSupported(const std::string &effect)
 
 uint32_t AudioStreamRoute::getLatencyInUs() const
 {
-    return getSampleSpec().convertFramesToUsec(mConfig.periodSize * mConfig.periodCount);
+    StreamRouteConfig::LatencyProfile profile = getCurrentLatencyProfile();
+    return getSampleSpec().convertFramesToUsec(profile.periodSize * profile.periodCount);
 }
 
 uint32_t AudioStreamRoute::getPeriodInUs() const
 {
-    return getSampleSpec().convertFramesToUsec(mConfig.periodSize);
+    return getSampleSpec().convertFramesToUsec(getCurrentLatencyProfile().periodSize);
 }
 
 } // namespace intel_audio
@@ -22,8 +22,10 @@
 #include <AudioUtils.hpp>
 #include <SampleSpec.hpp>
 #include <IoStream.hpp>
-#include <list>
 #include <utils/Errors.h>
+#include <utils/Timers.h>
+#include <atomic>
+#include <list>
 
 namespace intel_audio
 {
@@ -90,6 +92,17 @@ public:
         return mAudioDevice;
     }
 
+    /**
+     * Get the name of the route.
+     * From IStreamRoute, intended to be called by the stream.
+     *
+     * @return name of the route.
+     */
+    virtual const std::string &getName() const
+    {
+        return AudioRoute::getName();
+    }
+
     /**
      * Get amount of silence delay upon stream opening.
      * From IStreamRoute, intended to be called by the stream.
@@ -154,6 +167,20 @@ public:
      */
     bool isMatchingWithStream(const IoStream &stream) const;
 
+    /**
+     * Checks if the stream route matches the attributes of a stream not created yet, i.e. the
+     * direction, the flags, the use case and the sample specification, no effect requested.
+     *
+     * @param[in] isOut direction of the stream.
+     * @param[in] flagMask flags of the stream.
+     * @param[in] useCaseMask use cases of the stream.
+     * @param[in] sampleSpec sample specification of the stream.
+     *
+     * @return true if the route matches, false otherwise.
+     */
+    bool isMatchingWithConfig(bool isOut, uint32_t flagMask, uint32_t useCaseMask,
+                              const SampleSpec &sampleSpec) const;
+
     /**
      * Checks if the stream route capabilities are matching with the stream sample specification
      * i.e. format, subformat, sample rate, channel count, specific encoded format...
@@ -169,6 +196,19 @@ public:
      * @return true if the config is supported, false otherwise.
      */
     inline bool supportStreamConfig(const IoStream &stream) const
+    {
+        return supportConfig(stream.streamSampleSpec());
+    }
+
+    /**
+     * Checks if the stream route capabilities are matching with a sample specification, as
+     * supportStreamConfig does for the one of a stream.
+     *
+     * @param[in] sampleSpec to be checked against this route
+     *
+     * @return true if the config is supported, false otherwise.
+     */
+    inline bool supportConfig(const SampleSpec &sampleSpec) const
     {
         // Ugly WA: the policy tries to open a stream to retrieve the capabilities BEFORE
         // broadcastingcapabilities CONNECT message used by us to trig the discovery of the
@@ -179,8 +219,8 @@ public:
             mCapabilities.supportedRates.empty()) {
             const_cast<AudioStreamRoute *>(this)->loadCapabilities();
         }
-        return supportRate(stream.getSampleRate()) && supportFormat(stream.getFormat()) &&
-               supportChannelMask(stream.getChannels());
+        return supportRate(sampleSpec.getSampleRate()) && supportFormat(sampleSpec.getFormat()) &&
+               supportChannelMask(sampleSpec.getChannelMask());
     }
 
     /**
@@ -210,7 +250,8 @@ public:
 
     virtual bool needRepath() const
     {
-        return stillUsed() && (mRoutingStageRequested.test(Path) || mCurrentStream != mNewStream);
+        return stillUsed() && (mRoutingStageRequested.test(Path) || mCurrentStream != mNewStream ||
+                               mCurrentLatencyProfile != mNewLatencyProfile);
     }
 
     /**
@@ -253,11 +294,16 @@ public:
     /**
      * Get the latency associated with this route.
      * More precisely, it returns the size of the ring buffer configured when using this stream
-     * route, which is a worst case.
+     * route with its current latency profile, which is a worst case.
      *
      * @return latency in microseconds.
      */
-    uint32_t getLatencyInUs() const;
+    virtual uint32_t getLatencyInUs() const;
+
+    virtual uint32_t getDelayInFrames() const
+    {
+        return getSampleSpec().convertUsecToframes(mConfig.delayInUs);
+    }
 
     /**
      * Get the period size associated to this route.
@@ -270,6 +316,14 @@ public:
 
     AudioCapabilities getCapabilities() const { return mCapabilities; }
 
+    /**
+     * Accounts an xrun of the attached stream within the xrun window of the route.
+     * From IStreamRoute, intended to be called by the stream.
+     *
+     * @return true once per window when enough xruns happened to step up the latency profile.
+     */
+    virtual bool onXrun();
+
     /**
      * Checks if the devices assigned by the policy to the stream are matching the devices supported
      * by the stream route
@@ -278,6 +332,46 @@ public:
      */
     bool supportDevices(audio_devices_t streamDeviceMask) const;
 
+    /**
+     * @return stream assigned to this route by the current routing pass, NULL if none.
+     */
+    const IoStream *getNewStream() const
+    {
+        return mNewStream;
+    }
+
+    /**
+     * @return stream currently attached to this route, NULL if none.
+     */
+    const IoStream *getCurrentStream() const
+    {
+        return mCurrentStream;
+    }
+
+    /**
+     * Accounts the time spent in the route or unroute hooks during the current routing pass.
+     *
+     * @param[in] duration of the hook.
+     */
+    void addRoutingDuration(nsecs_t duration)
+    {
+        mRoutingDuration += duration;
+    }
+
+    void resetRoutingDuration()
+    {
+        mRoutingDuration = 0;
+    }
+
+    /**
+     * @return time spent in the route and unroute hooks during the last routing pass, 0 if this
+     *         route was not involved.
+     */
+    nsecs_t getRoutingDuration() const
+    {
+        return mRoutingDuration;
+    }
+
 protected:
     IoStream *mCurrentStream; /**< Current stream attached to this route. */
     IoStream *mNewStream; /**< New stream that will be attached to this route after rerouting. */
@@ -303,8 +397,9 @@ private:
 
     inline bool reformatterSupported(const audio_format_t format) const
     {
-        // We only support convertion to/from S16 from/to S8_24 respectively
-        return ((format == AUDIO_FORMAT_PCM_16_BIT) || (format == AUDIO_FORMAT_PCM_8_24_BIT)) &&
+        // We only support convertion between S16, S8_24 and float, the route being S16 or S8_24
+        return ((format == AUDIO_FORMAT_PCM_16_BIT) || (format == AUDIO_FORMAT_PCM_8_24_BIT) ||
+                (format == AUDIO_FORMAT_PCM_FLOAT)) &&
                ((mCapabilities.getDefaultFormat() == AUDIO_FORMAT_PCM_16_BIT) ||
                 (mCapabilities.getDefaultFormat() == AUDIO_FORMAT_PCM_8_24_BIT));
     }
@@ -390,6 +485,24 @@ private:
      */
     android::status_t detachCurrentStream();
 
+    /**
+     * Selects the latency profile to apply to a stream.
+     * The base profile is the lowest latency one for fast streams, the highest one for deep
+     * buffer streams and the default profile set by the Route Parameter Manager otherwise.
+     * An adaptive step is added on top of it: raised after repeated xruns within the xrun
+     * window, lowered after a quiet period.
+     *
+     * @param[in] stream to be attached to the route.
+     *
+     * @return index of the latency profile.
+     */
+    uint32_t selectLatencyProfile(const IoStream &stream);
+
+    /**
+     * @return period size and count of the current latency profile.
+     */
+    StreamRouteConfig::LatencyProfile getCurrentLatencyProfile() const;
+
     StreamRouteConfig mConfig; /**< Configuration of the audio stream route. */
 
     IAudioDevice *mAudioDevice; /**< Platform dependant audio device. */
@@ -397,6 +510,23 @@ private:
     uint32_t mCurrentRate = 0;
     audio_format_t mCurrentFormat = AUDIO_FORMAT_DEFAULT;
     audio_channel_mask_t mCurrentChannelMask = AUDIO_CHANNEL_NONE;
+
+    uint32_t mCurrentLatencyProfile = 0; /**< latency profile of the audio device. */
+    uint32_t mNewLatencyProfile = 0; /**< latency profile selected for the new stream. */
+    uint32_t mLatencyStep = 0; /**< adaptive step above the base latency profile. */
+    nsecs_t mLastLatencyStepTime = 0; /**< time of the last change of the adaptive step. */
+
+    nsecs_t mRoutingDuration = 0; /**< time spent routing during the last routing pass. */
+
+    /** Xruns accounted from the audio thread, read from the routing thread. */
+    std::atomic<uint32_t> mXrunsInWindow{0};
+    std::atomic<nsecs_t> mXrunWindowStart{0};
+    std::atomic<nsecs_t> mLastXrunTime{0};
+
+    /** Xruns within the window that trigger a step up of the latency profile. */
+    static const uint32_t mXrunsBeforeStepUp = 3;
+    static const nsecs_t mXrunWindow = 10000000000LL; /**< 10 seconds. */
+    static const nsecs_t mQuietPeriodBeforeStepDown = 60000000000LL; /**< 60 seconds. */
 };
 
 } // namespace intel_audio
@@ -17,6 +17,7 @@
 
 #include "ElementCollection.hpp"
 #include "AudioRoute.hpp"
+#include <Direction.hpp>
 
 namespace intel_audio
 {
@@ -18,7 +18,9 @@
 #include "RouteCollection.hpp"
 #include "AudioStreamRoute.hpp"
 #include <IoStream.hpp>
+#include <utils/Timers.h>
 #include <list>
+#include <ostream>
 
 namespace intel_audio
 {
@@ -53,6 +55,7 @@ public:
      * This mask depends on the direction of the stream:
      *      -Output stream: output Flags
      *      -Input stream: input source.
+     * Otherwise, it falls back on a mirror of a stream already associated to another route.
      *
      * @param[in] route applicable route to be associated to a stream.
      *
@@ -68,9 +71,56 @@ public:
                 }
             }
         }
+        return setMirrorForRoute(route);
+    }
+
+    /**
+     * Find and set a mirror of a stream already associated to another route, so that the stream
+     * is rendered on both routes (fan-out). Only considered if the route supports some devices
+     * selected by the policy for the stream that no route associated to the stream or to its
+     * mirrors supports.
+     *
+     * @param[in] route applicable route not matching any stream left to associate.
+     *
+     * @return true if a mirror was found and attached to the route, false otherwise.
+     */
+    bool setMirrorForRoute(AudioStreamRoute &route)
+    {
+        for (const auto &stream : mOrderedStreamList[route.isOut()]) {
+            if (!stream->isStarted() || !stream->isNewRouteAvailable() ||
+                !route.isMatchingWithStream(*stream)) {
+                continue;
+            }
+            audio_devices_t missingDevices = stream->getDevices() & ~getNewRoutesDevices(*stream);
+            if ((route.getSupportedDeviceMask() & missingDevices) == 0) {
+                continue;
+            }
+            IoStream *mirror = stream->getAvailableMirror();
+            if (mirror != NULL) {
+                return route.setStream(*mirror);
+            }
+        }
         return false;
     }
 
+    /**
+     * @param[in] stream for which the devices are requested.
+     *
+     * @return devices supported by the routes associated to the stream or to its mirrors by the
+     *         current routing pass.
+     */
+    audio_devices_t getNewRoutesDevices(const IoStream &stream) const
+    {
+        audio_devices_t devices = AUDIO_DEVICE_NONE;
+        for (const auto &it : Base::mElements) {
+            const IoStream *newStream = it.second->getNewStream();
+            if (newStream != NULL && newStream->getMirroredStream() == &stream) {
+                devices |= it.second->getSupportedDeviceMask();
+            }
+        }
+        return devices;
+    }
+
     IoStream *getVoiceStreamRoute()
     {
         // We take the first stream that corresponds to the primary output.
@@ -132,7 +182,9 @@ public:
                 audio_comms::utilities::Log::Verbose() << __FUNCTION__
                                                        << ": Route " << route->getName()
                                                        << " to be disabled";
+                nsecs_t start = systemTime();
                 route->unroute(isPostDisable);
+                route->addRoutingDuration(systemTime() - start);
             }
         }
     }
@@ -156,10 +208,12 @@ public:
                 audio_comms::utilities::Log::Verbose() << __FUNCTION__
                                                        << ": Route" << route->getName()
                                                        << " to be enabled";
+                nsecs_t start = systemTime();
                 if (route->route(isPreEnable) != android::OK) {
                     audio_comms::utilities::Log::Error() << "\t error while routing "
                                                          << route->getName();
                 }
+                route->addRoutingDuration(systemTime() - start);
             }
         }
     }
@@ -183,6 +237,39 @@ public:
         return NULL;
     }
 
+    /**
+     * Find the route a stream not created yet would be assigned to, preferably one supporting its
+     * devices.
+     *
+     * @param[in] isOut direction of the stream.
+     * @param[in] flagMask flags of the stream.
+     * @param[in] useCaseMask use cases of the stream.
+     * @param[in] devices of the stream.
+     * @param[in] sampleSpec sample specification of the stream.
+     *
+     * @return matching route, NULL if none.
+     */
+    const AudioStreamRoute *findMatchingRouteForConfig(bool isOut, uint32_t flagMask,
+                                                       uint32_t useCaseMask,
+                                                       audio_devices_t devices,
+                                                       const SampleSpec &sampleSpec) const
+    {
+        const AudioStreamRoute *matchingRoute = NULL;
+        for (const auto &it : Base::mElements) {
+            const AudioStreamRoute *streamRoute = it.second;
+            if (!streamRoute->isMatchingWithConfig(isOut, flagMask, useCaseMask, sampleSpec)) {
+                continue;
+            }
+            if (streamRoute->supportDevices(devices)) {
+                return streamRoute;
+            }
+            if (matchingRoute == NULL) {
+                matchingRoute = streamRoute;
+            }
+        }
+        return matchingRoute;
+    }
+
     /**
      * Handle the change of state of a device to whom it concerns by loading / resetting
      * capabilities of route(s) supporting this device.
@@ -226,6 +313,40 @@ public:
         enableRoutes(true);
     }
 
+    /**
+     * Resets the routing duration of the routes at the beginning of a routing pass.
+     */
+    void resetRoutingDurations()
+    {
+        for (const auto &it : Base::mElements) {
+            it.second->resetRoutingDuration();
+        }
+    }
+
+    /**
+     * Appends the state of the stream routes to a debug snapshot, i.e. whether they are used,
+     * the attributes of the stream attached to them and the time spent routing them during the
+     * last routing pass.
+     *
+     * @param[in,out] state snapshot to append to.
+     */
+    void dumpState(std::ostream &state) const
+    {
+        for (const auto &it : Base::mElements) {
+            const auto route = it.second;
+            state << "    " << it.first << ": " << (route->isUsed() ? "used" : "unused");
+            const IoStream *stream = route->getCurrentStream();
+            if (stream != NULL) {
+                state << ", stream flags 0x" << std::hex << stream->getFlagMask()
+                      << ", use cases 0x" << stream->getUseCaseMask() << std::dec;
+            }
+            if (route->getRoutingDuration() != 0) {
+                state << ", last routing " << ns2us(route->getRoutingDuration()) << " us";
+            }
+            state << "\n";
+        }
+    }
+
     /**
      * array of list of streams opened.
      */
@@ -46,6 +46,35 @@ public:
 
     virtual IAudioDevice *getAudioDevice() = 0;
 
+    /**
+     * @return name of the stream route, as declared in the Route Parameter Manager.
+     */
+    virtual const std::string &getName() const = 0;
+
+    /**
+     * Get the latency of the stream route, i.e. the size of the ring buffer with the latency
+     * profile applied when opening the audio device.
+     *
+     * @return latency in microseconds.
+     */
+    virtual uint32_t getLatencyInUs() const = 0;
+
+    /**
+     * Get the intrinsic delay of the stream route beyond the ring buffer (DSP, codec...).
+     *
+     * @return delay in frames in the sample specifications of the route.
+     */
+    virtual uint32_t getDelayInFrames() const = 0;
+
+    /**
+     * Notifies the stream route of an xrun on the attached stream.
+     * Called from the audio thread of the stream, it must not block.
+     *
+     * @return true if the latency profile of the route needs to be reconsidered, i.e. the stream
+     *         shall request a routing reconsideration, false otherwise.
+     */
+    virtual bool onXrun() = 0;
+
     virtual ~IStreamRoute() {}
 };
 
@@ -75,6 +75,33 @@ struct StreamRouteConfig
      */
     uint32_t supportedDeviceMask;
 
+    /**
+     * Ring buffer configuration of a latency profile.
+     */
+    struct LatencyProfile
+    {
+        uint32_t periodSize; /**< period size in frames. */
+        uint32_t periodCount; /**< number of periods of the ring buffer. */
+    };
+
+    /**
+     * Latency profiles supported by the stream route, ordered from the lowest to the highest
+     * latency. If empty, the ring buffer is configured with periodSize and periodCount.
+     */
+    std::vector<LatencyProfile> latencyProfiles;
+
+    /**
+     * Index of the latency profile applicable by default. It is set by the Route Parameter Manager
+     * and may depend on platform criteria (screen state, use cases...).
+     */
+    uint32_t defaultLatencyProfile;
+
+    /**
+     * Intrinsic delay of the stream route beyond the ring buffer, e.g. DSP or codec processing, in
+     * microseconds. Accounted in the latency and presentation position of the attached stream.
+     */
+    uint32_t delayInUs;
+
     static bool isDynamic(uint32_t param) { return param == 0; }
 };
 
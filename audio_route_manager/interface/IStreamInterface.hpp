@@ -17,6 +17,7 @@
 
 #include "StreamRouteConfig.hpp"
 #include "AudioCapabilities.hpp"
+#include "RoutingParameters.hpp"
 #include <utils/Errors.h>
 #include <string>
 
@@ -25,6 +26,27 @@ namespace intel_audio
 
 class IoStream;
 
+/**
+ * Listener of a timer of the route manager, notified from the routing thread, e.g. by streams
+ * deferring the closure of their audio device upon standby, or by the device coalescing the
+ * routing updates of successive patches.
+ */
+struct IRoutingTimerListener
+{
+    /**
+     * Called upon expiry of the timer armed by the listener, from the routing thread context
+     * without routing lock held, but with the timer lock held: the listener may take the device,
+     * routing and stream locks, but shall not arm or disarm any timer.
+     * The timer of a listener is not disarmed on its behalf: the listener shall disarm it before
+     * starting its teardown, i.e. before releasing any state used by this notification and
+     * before the destructor of a derived class runs.
+     */
+    virtual void onRoutingTimer() = 0;
+
+protected:
+    virtual ~IRoutingTimerListener() {}
+};
+
 struct IStreamInterface
 {
     /**
@@ -58,6 +80,26 @@ struct IStreamInterface
      */
     virtual void reconsiderRouting(bool isSynchronous = false) = 0;
 
+    /**
+     * Arms the timer of a listener, driven by the routing thread.
+     * If the timer of this listener is already armed, it is rearmed with the new delay.
+     * Takes the timer lock: must not be called with the device, routing or stream locks held.
+     *
+     * @param[in] delayMs delay in milliseconds before the listener is notified.
+     * @param[in] listener to be notified upon expiry.
+     */
+    virtual void armRoutingTimer(uint32_t delayMs, IRoutingTimerListener &listener) = 0;
+
+    /**
+     * Disarms the timer of a listener. Once returned, the listener is guaranteed not to be
+     * notified anymore, including by a notification in flight which is waited for, so it must be
+     * called before starting the teardown of the listener.
+     * Takes the timer lock: must not be called with the device, routing or stream locks held.
+     *
+     * @param[in] listener whose timer is to be disarmed.
+     */
+    virtual void disarmRoutingTimer(IRoutingTimerListener &listener) = 0;
+
     /**
      * Sets the voice volume.
      * Called from AudioSystem/Policy to apply the volume on the voice call stream which is
@@ -108,6 +150,22 @@ struct IStreamInterface
      */
     virtual uint32_t getPeriodInUs(const IoStream &stream) const = 0;
 
+    /**
+     * Get the period size of the route a stream would be assigned to, before the stream is
+     * created, e.g. to report the buffer size of a configuration.
+     *
+     * @param[in] isOut direction of the stream.
+     * @param[in] flagMask flags of the stream.
+     * @param[in] useCaseMask use cases of the stream.
+     * @param[in] devices of the stream, a route supporting them being preferred.
+     * @param[in] sampleSpec sample specification of the stream.
+     *
+     * @return period size in microseconds, 0 if no route matches.
+     */
+    virtual uint32_t getPeriodInUsForConfig(bool isOut, uint32_t flagMask, uint32_t useCaseMask,
+                                            audio_devices_t devices,
+                                            const SampleSpec &sampleSpec) const = 0;
+
     /**
      * Checks whether the stream and its audio configuration that it wishes to use match
      * with a stream route.
@@ -134,6 +192,18 @@ struct IStreamInterface
     virtual android::status_t setParameters(const std::string &keyValuePair,
                                             bool isSynchronous = false) = 0;
 
+    /**
+     * Sets the routing parameters of the streams, sparing the formatting and parsing of the
+     * key value pairs of setParameters, kept for the external callers.
+     *
+     * @param[in] parameters aggregated over the streams by the audio device.
+     * @param[in] isSynchronous: if set, re routing shall be synchronous.
+     *
+     * @return OK if success, error code otherwise.
+     */
+    virtual android::status_t setRoutingParameters(const RoutingParameters &parameters,
+                                                   bool isSynchronous = false) = 0;
+
     virtual std::string getParameters(const std::string &keys) const = 0;
 
     /**
@@ -141,6 +211,14 @@ struct IStreamInterface
      */
     virtual void printPlatformFwErrorInfo() const = 0;
 
+    /**
+     * Dumps a snapshot of the routing state, i.e. the routes enabled, the streams attached to the
+     * stream routes, the timing of the last routing pass and the criteria of the platform state.
+     *
+     * @param[in] fd file descriptor used as dump output.
+     */
+    virtual void dump(int fd) const = 0;
+
     protected:
         virtual ~IStreamInterface() {}
 };
@@ -0,0 +1,100 @@
+/*
+ * Copyright (C) 2015 Intel Corporation
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#pragma once
+
+#include <Direction.hpp>
+#include <stdint.h>
+
+namespace intel_audio
+{
+
+/**
+ * Routing parameters aggregated over the streams by the audio device, i.e. the typed counterpart
+ * of the devices, flags, use cases, band, pre processing and mode keys of setParameters.
+ * Parameters of a direction are only applied if this direction is set.
+ */
+struct RoutingParameters
+{
+    /** Parameters aggregated over the streams of a direction. */
+    struct StreamsParameters
+    {
+        StreamsParameters()
+            : isSet(false), devices(0), flagMask(0), useCaseMask(0)
+        {}
+
+        bool isSet;
+        uint32_t devices;
+        uint32_t flagMask;
+        uint32_t useCaseMask;
+    };
+
+    RoutingParameters()
+        : band(0), preProcRequested(0), mode(0)
+    {}
+
+    /** @return true if no direction is set, i.e. nothing to apply. */
+    bool isEmpty() const
+    {
+        return !streams[Direction::Input].isSet && !streams[Direction::Output].isSet;
+    }
+
+    /**
+     * @param[in] direction of the parameters to check, only the ones of the direction are
+     *                      considered.
+     * @param[in] applied parameters last applied.
+     *
+     * @return true if the parameters of the direction were already applied, false otherwise.
+     */
+    bool isApplied(Direction::Values direction, const RoutingParameters &applied) const
+    {
+        const StreamsParameters &requested = streams[direction];
+        const StreamsParameters &current = applied.streams[direction];
+        if (!current.isSet || current.devices != requested.devices ||
+            current.flagMask != requested.flagMask ||
+            current.useCaseMask != requested.useCaseMask) {
+            return false;
+        }
+        if (direction == Direction::Output) {
+            return applied.mode == mode;
+        }
+        return applied.band == band && applied.preProcRequested == preProcRequested;
+    }
+
+    /**
+     * Records the parameters of the directions set, once applied.
+     *
+     * @param[in] parameters applied.
+     */
+    void setApplied(const RoutingParameters &parameters)
+    {
+        if (parameters.streams[Direction::Output].isSet) {
+            streams[Direction::Output] = parameters.streams[Direction::Output];
+            mode = parameters.mode;
+        }
+        if (parameters.streams[Direction::Input].isSet) {
+            streams[Direction::Input] = parameters.streams[Direction::Input];
+            band = parameters.band;
+            preProcRequested = parameters.preProcRequested;
+        }
+    }
+
+    StreamsParameters streams[Direction::gNbDirections]; /**< Indexed by Direction::Values. */
+    uint32_t band; /**< VoIP band of the active input, applied along with the input streams. */
+    uint32_t preProcRequested; /**< Effects of the inputs, applied along with the input streams. */
+    uint32_t mode; /**< Android mode, applied along with the output streams. */
+};
+
+} // namespace intel_audio
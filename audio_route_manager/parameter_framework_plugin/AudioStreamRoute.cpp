@@ -27,6 +27,7 @@
 #include "RouteMappingKeys.hpp"
 #include "RouteSubsystem.hpp"
 #include <AudioCommsAssert.hpp>
+#include <cstdlib>
 #include <cstring>
 
 using std::memcmp;
@@ -37,6 +38,7 @@ const string AudioStreamRoute::mOutputDirection = "out";
 const string AudioStreamRoute::mStreamType = "streamRoute";
 const string AudioStreamRoute::mPortDelimiter = "-";
 const string AudioStreamRoute::mStringDelimiter = ",";
+const string AudioStreamRoute::mLatencyProfileDelimiter = ":";
 const string AudioStreamRoute::mChannelPolicyCopy = "copy";
 const string AudioStreamRoute::mChannelPolicyIgnore = "ignore";
 const string AudioStreamRoute::mChannelPolicyAverage = "average";
@@ -104,6 +106,34 @@ AudioStreamRoute::parseChannelPolicyString(const std::string &channelPolicy)
     return channelPolicyVector;
 }
 
+std::vector<StreamRouteConfig::LatencyProfile>
+AudioStreamRoute::parseLatencyProfileString(const std::string &latencyProfiles)
+{
+    std::vector<StreamRouteConfig::LatencyProfile> latencyProfileVector;
+    Tokenizer mappingTok(latencyProfiles, mStringDelimiter);
+    std::vector<string> subStrings = mappingTok.split();
+
+    for (size_t i = 0; i < subStrings.size(); i++) {
+
+        Tokenizer profileTok(subStrings[i], mLatencyProfileDelimiter);
+        std::vector<string> periodStrings = profileTok.split();
+        if (periodStrings.size() != 2) {
+
+            // Not valid latency profile
+            continue;
+        }
+        StreamRouteConfig::LatencyProfile profile;
+        profile.periodSize = strtoul(periodStrings[0].c_str(), NULL, 0);
+        profile.periodCount = strtoul(periodStrings[1].c_str(), NULL, 0);
+        if (profile.periodSize == 0 || profile.periodCount == 0) {
+
+            continue;
+        }
+        latencyProfileVector.push_back(profile);
+    }
+    return latencyProfileVector;
+}
+
 bool AudioStreamRoute::sendToHW(string & /*error*/)
 {
     Config config;
@@ -134,6 +164,9 @@ bool AudioStreamRoute::sendToHW(string & /*error*/)
     streamConfig.channelsPolicy.erase(streamConfig.channelsPolicy.begin(),
                                       streamConfig.channelsPolicy.end());
     streamConfig.channelsPolicy = parseChannelPolicyString(std::string(config.channelsPolicy));
+    streamConfig.latencyProfiles = parseLatencyProfileString(std::string(config.latencyProfiles));
+    streamConfig.defaultLatencyProfile = config.defaultLatencyProfile;
+    streamConfig.delayInUs = config.delayInUs;
 
     Tokenizer effectTok(string(config.effectSupported), mStringDelimiter);
     std::vector<string> subStrings = effectTok.split();
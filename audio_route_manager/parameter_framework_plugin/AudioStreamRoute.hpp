@@ -67,6 +67,9 @@ private:
         char dynamicChannelMapsControl[mMaxStringSize];
         char dynamicFormatsControl[mMaxStringSize];
         char dynamicRatesControl[mMaxStringSize];
+        uint32_t defaultLatencyProfile; /**< index of the latency profile applicable by default. */
+        char latencyProfiles[mMaxStringSize]; /**< latency profiles supported. */
+        uint32_t delayInUs; /**< DSP / codec delay beyond the ring buffer in microseconds. */
     } __attribute__((packed));
 
 public:
@@ -97,6 +100,17 @@ private:
     std::vector<intel_audio::SampleSpec::ChannelsPolicy>
     parseChannelPolicyString(const std::string &channelPolicy);
 
+    /**
+     * Parse a concatenated list of latency profiles separated by a coma. Each profile is given
+     * as period size and period count separated by a colon.
+     *
+     * @param[in] latencyProfiles std::string of concatenated latency profiles.
+     *
+     * @return std::vector of latency profiles.
+     */
+    std::vector<intel_audio::StreamRouteConfig::LatencyProfile>
+    parseLatencyProfileString(const std::string &latencyProfiles);
+
     const RouteSubsystem *mRouteSubsystem; /**< Route subsytem plugin. */
     intel_audio::IRouteInterface *mRouteInterface; /**< Interface to communicate with Route Mgr. */
 
@@ -112,6 +126,7 @@ private:
     static const uint32_t mDualPorts = 2; /**< both port are mentionnent for this route. */
     static const std::string mPortDelimiter; /**< Delimiter to parse a list of ports. */
     static const std::string mStringDelimiter; /**< Delimiter to parse strings. */
+    static const std::string mLatencyProfileDelimiter; /**< Delimiter of period size / count. */
     static const std::string mChannelPolicyCopy; /**< copy channel policy tag. */
     static const std::string mChannelPolicyIgnore; /**< ignore channel policy tag. */
     static const std::string mChannelPolicyAverage; /**< average channel policy tag. */
@@ -0,0 +1,203 @@
+/*
+ * Copyright (C) 2015 Intel Corporation
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "StreamRouteCollection.hpp"
+#include "AudioStreamRoute.hpp"
+#include <IoStream.hpp>
+#include <gtest/gtest.h>
+#include <string>
+#include <vector>
+
+namespace intel_audio
+{
+
+static const audio_devices_t speakerDevice = AUDIO_DEVICE_OUT_SPEAKER;
+static const audio_devices_t headsetDevice = AUDIO_DEVICE_OUT_WIRED_HEADSET;
+static const audio_devices_t hdmiDevice = AUDIO_DEVICE_OUT_AUX_DIGITAL;
+
+/**
+ * Output stream never attached to its route, only selected by the routing pass.
+ */
+class StreamStub : public IoStream
+{
+public:
+    StreamStub(audio_devices_t devices, const StreamStub *mirroredStream = NULL)
+        : mIsStarted(true),
+          mMirroredStream(mirroredStream)
+    {
+        setSampleRate(mSampleRate);
+        setFormat(AUDIO_FORMAT_PCM_16_BIT);
+        setChannels(AUDIO_CHANNEL_OUT_STEREO);
+        setDevices(devices);
+    }
+
+    virtual bool isOut() const { return true; }
+    virtual audio_port_role_t getRole() const { return AUDIO_PORT_ROLE_SOURCE; }
+    virtual bool isStarted() const { return mIsStarted; }
+    virtual bool isRoutedByPolicy() const { return true; }
+    virtual uint32_t getFlagMask() const { return AUDIO_OUTPUT_FLAG_PRIMARY; }
+    virtual uint32_t getUseCaseMask() const { return 0; }
+
+    virtual IoStream *getAvailableMirror()
+    {
+        for (auto mirror : mMirrors) {
+            if (!mirror->isNewRouteAvailable()) {
+                return mirror;
+            }
+        }
+        return NULL;
+    }
+
+    virtual const IoStream *getMirroredStream() const
+    {
+        return mMirroredStream != NULL ? mMirroredStream : this;
+    }
+
+    virtual uint32_t getBufferSizeInBytes() const { return 0; }
+    virtual size_t getBufferSizeInFrames() const { return 0; }
+    virtual android::status_t pcmReadFrames(void *, size_t, std::string &) const
+    {
+        return android::INVALID_OPERATION;
+    }
+    virtual android::status_t pcmWriteFrames(void *, ssize_t, std::string &) const
+    {
+        return android::INVALID_OPERATION;
+    }
+    virtual android::status_t pcmStop() const { return android::OK; }
+    virtual android::status_t pcmRecover() { return android::DEAD_OBJECT; }
+    virtual android::status_t getFramesAvailable(size_t &, struct timespec &) const
+    {
+        return android::INVALID_OPERATION;
+    }
+
+    bool mIsStarted;
+    std::vector<StreamStub *> mMirrors;
+
+    static const uint32_t mSampleRate = 48000;
+
+private:
+    const StreamStub *mMirroredStream;
+};
+
+class StreamRouteCollectionTest : public ::testing::Test
+{
+protected:
+    StreamRouteCollectionTest()
+        : mStream(speakerDevice | hdmiDevice),
+          mMirror(AUDIO_DEVICE_NONE, &mStream),
+          mSpeakerRoute(addRoute("speaker", speakerDevice)),
+          mHeadsetRoute(addRoute("headset", headsetDevice)),
+          mHdmiRoute(addRoute("hdmi", hdmiDevice))
+    {
+        mStream.mMirrors.push_back(&mMirror);
+        mRoutes.addStream(mStream);
+    }
+
+    AudioStreamRoute &addRoute(const std::string &name, audio_devices_t devices)
+    {
+        StreamRouteConfig config = StreamRouteConfig();
+        config.cardName = "";
+        config.channels = 2;
+        config.rate = StreamStub::mSampleRate;
+        config.format = AUDIO_FORMAT_PCM_16_BIT;
+        config.flagMask = AUDIO_OUTPUT_FLAG_PRIMARY;
+        config.supportedDeviceMask = devices;
+
+        AudioStreamRoute *route = new AudioStreamRoute(name, true);
+        route->updateStreamRouteConfig(config);
+        mRoutes.addElement(name, route);
+        return *route;
+    }
+
+    StreamStub mStream;
+    StreamStub mMirror;
+    StreamRouteCollection mRoutes; /**< Owns the routes. */
+    AudioStreamRoute &mSpeakerRoute;
+    AudioStreamRoute &mHeadsetRoute;
+    AudioStreamRoute &mHdmiRoute;
+};
+
+TEST_F(StreamRouteCollectionTest, NewRoutesDevices)
+{
+    EXPECT_EQ(static_cast<audio_devices_t>(AUDIO_DEVICE_NONE), mRoutes.getNewRoutesDevices(mStream));
+
+    ASSERT_TRUE(mSpeakerRoute.setStream(mStream));
+    EXPECT_EQ(speakerDevice, mRoutes.getNewRoutesDevices(mStream));
+
+    // Devices of the routes of the mirrors are accounted to the mirrored stream.
+    ASSERT_TRUE(mHdmiRoute.setStream(mMirror));
+    EXPECT_EQ(speakerDevice | hdmiDevice, mRoutes.getNewRoutesDevices(mStream));
+
+    mSpeakerRoute.resetAvailability();
+    EXPECT_EQ(hdmiDevice, mRoutes.getNewRoutesDevices(mStream));
+}
+
+TEST_F(StreamRouteCollectionTest, MirrorOnRouteOfMissingDevices)
+{
+    ASSERT_TRUE(mRoutes.setStreamForRoute(mSpeakerRoute));
+    EXPECT_EQ(&mStream, mSpeakerRoute.getNewStream());
+
+    EXPECT_TRUE(mRoutes.setMirrorForRoute(mHdmiRoute));
+    EXPECT_EQ(&mMirror, mHdmiRoute.getNewStream());
+}
+
+TEST_F(StreamRouteCollectionTest, NoMirrorOnRouteOfUnrequestedDevices)
+{
+    ASSERT_TRUE(mRoutes.setStreamForRoute(mSpeakerRoute));
+
+    EXPECT_FALSE(mRoutes.setMirrorForRoute(mHeadsetRoute));
+    EXPECT_EQ(NULL, mHeadsetRoute.getNewStream());
+    EXPECT_FALSE(mMirror.isNewRouteAvailable());
+}
+
+TEST_F(StreamRouteCollectionTest, NoMirrorOnRouteOfDevicesAlreadyServed)
+{
+    AudioStreamRoute &otherHdmiRoute = addRoute("hdmi2", hdmiDevice);
+    StreamStub otherMirror(AUDIO_DEVICE_NONE, &mStream);
+    mStream.mMirrors.push_back(&otherMirror);
+    ASSERT_TRUE(mRoutes.setStreamForRoute(mSpeakerRoute));
+    ASSERT_TRUE(mRoutes.setMirrorForRoute(mHdmiRoute));
+
+    EXPECT_FALSE(mRoutes.setMirrorForRoute(otherHdmiRoute));
+    EXPECT_EQ(NULL, otherHdmiRoute.getNewStream());
+    EXPECT_FALSE(otherMirror.isNewRouteAvailable());
+}
+
+TEST_F(StreamRouteCollectionTest, NoMirrorOfStreamWithoutRoute)
+{
+    // Mirrors only fan out a stream already routed by the current routing pass.
+    EXPECT_FALSE(mRoutes.setMirrorForRoute(mHdmiRoute));
+    EXPECT_EQ(NULL, mHdmiRoute.getNewStream());
+}
+
+TEST_F(StreamRouteCollectionTest, NoMirrorOfStoppedStream)
+{
+    ASSERT_TRUE(mSpeakerRoute.setStream(mStream));
+    mStream.mIsStarted = false;
+
+    EXPECT_FALSE(mRoutes.setMirrorForRoute(mHdmiRoute));
+}
+
+TEST_F(StreamRouteCollectionTest, NoMirrorLeft)
+{
+    ASSERT_TRUE(mRoutes.setStreamForRoute(mSpeakerRoute));
+    mStream.mMirrors.clear();
+
+    EXPECT_FALSE(mRoutes.setMirrorForRoute(mHdmiRoute));
+    EXPECT_EQ(NULL, mHdmiRoute.getNewStream());
+}
+
+} // namespace intel_audio
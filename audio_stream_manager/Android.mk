@@ -30,7 +30,12 @@ component_src_files :=  \
     src/Device.cpp \
     src/StreamIn.cpp \
     src/StreamOut.cpp \
+    src/StreamOutMirror.cpp \
     src/CompressedStreamOut.cpp \
+    src/EchoReference.cpp \
+    src/EchoDelayEstimator.cpp \
+    src/MaskAggregator.cpp \
+    src/CapturePrefetcher.cpp \
     src/Patch.cpp \
     src/Port.cpp
 
@@ -200,7 +205,9 @@ include $(BUILD_NATIVE_TEST)
 #######################################################################
 include $(CLEAR_VARS)
 
-LOCAL_SRC_FILES:= test/FunctionalTestHost.cpp
+LOCAL_SRC_FILES:= \
+    test/FunctionalTestHost.cpp \
+    test/MaskAggregatorTest.cpp \
 
 LOCAL_C_INCLUDES := \
     test \
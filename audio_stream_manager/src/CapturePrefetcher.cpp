@@ -0,0 +1,215 @@
+/*
+ * Copyright (C) 2015 Intel Corporation
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#define LOG_TAG "AudioCapturePrefetcher"
+
+#include "CapturePrefetcher.hpp"
+#include <utilities/Log.hpp>
+#include <algorithm>
+#include <sched.h>
+#include <string.h>
+#include <unistd.h>
+
+using android::status_t;
+using android::Mutex;
+using audio_comms::utilities::Log;
+using std::memory_order_relaxed;
+using std::memory_order_acquire;
+using std::memory_order_release;
+
+namespace intel_audio
+{
+
+CapturePrefetcher::CapturePrefetcher(Source &source, StreamStats &stats)
+    : mSource(source),
+      mStats(stats),
+      mIsRunning(false),
+      mIsExitRequested(false),
+      mSourceError(android::OK),
+      mFrameSize(0),
+      mSampleRate(0),
+      mPeriodSizeInFrames(0),
+      mRingSizeInFrames(0),
+      mDepthInFrames(0),
+      mIsKeepingLatest(false),
+      mWriteFrames(0),
+      mWritingFrames(0),
+      mReadFrames(0),
+      mIsClientWaiting(false)
+{
+}
+
+CapturePrefetcher::~CapturePrefetcher()
+{
+    stop();
+}
+
+status_t CapturePrefetcher::start(size_t frameSize, uint32_t sampleRate, size_t periodFrames,
+                                  size_t depthFrames, bool keepLatest)
+{
+    if (mIsRunning || frameSize == 0 || sampleRate == 0 || periodFrames == 0) {
+        return android::INVALID_OPERATION;
+    }
+    mFrameSize = frameSize;
+    mSampleRate = sampleRate;
+    mPeriodSizeInFrames = periodFrames;
+    mDepthInFrames = std::max(depthFrames, periodFrames);
+    mIsKeepingLatest = keepLatest;
+    // In keep-latest mode, the period being written does not overwrite the readable frames.
+    mRingSizeInFrames = mDepthInFrames + (keepLatest ? periodFrames : 0);
+    mRing.resize(mRingSizeInFrames * mFrameSize);
+    mPeriodBuffer.resize(mPeriodSizeInFrames * mFrameSize);
+    mWriteFrames = 0;
+    mWritingFrames = 0;
+    mReadFrames = 0;
+    mSourceError = android::OK;
+    mIsExitRequested = false;
+
+    if (pthread_create(&mThread, NULL, threadLoop, this) != 0) {
+        Log::Error() << __FUNCTION__ << ": could not create prefetch thread";
+        return android::NO_INIT;
+    }
+    mIsRunning = true;
+    Log::Debug() << __FUNCTION__ << ": period " << mPeriodSizeInFrames << " frames, depth "
+                 << mRingSizeInFrames << " frames";
+    return android::OK;
+}
+
+void CapturePrefetcher::stop()
+{
+    if (!mIsRunning) {
+        return;
+    }
+    mIsExitRequested.store(true, memory_order_release);
+    pthread_join(mThread, NULL);
+    mIsRunning = false;
+    Log::Debug() << __FUNCTION__;
+}
+
+void *CapturePrefetcher::threadLoop(void *context)
+{
+    CapturePrefetcher *prefetcher = static_cast<CapturePrefetcher *>(context);
+
+    struct sched_param param;
+    param.sched_priority = mThreadPriority;
+    if (pthread_setschedparam(pthread_self(), SCHED_FIFO, &param) != 0) {
+        Log::Warning() << __FUNCTION__ << ": could not set SCHED_FIFO, prefetching anyway";
+    }
+    while (!prefetcher->mIsExitRequested.load(memory_order_acquire) && prefetcher->prefetch()) {
+    }
+    return NULL;
+}
+
+bool CapturePrefetcher::prefetch()
+{
+    size_t framesRead = 0;
+    status_t status = mSource.readPrefetchFrames(mPeriodBuffer.data(), mPeriodSizeInFrames,
+                                                 framesRead);
+    if (status == android::NO_INIT) {
+        // No audio device yet, paced on the period not to spin.
+        usleep(mPeriodSizeInFrames * 1000000LL / mSampleRate);
+        return true;
+    }
+    if (status == android::OK) {
+        uint64_t writeFrames = mWriteFrames.load(memory_order_relaxed);
+        size_t writtenFrames = framesRead;
+        if (mIsKeepingLatest) {
+            // Announced before overwriting, for the client to detect the frames it was reading.
+            mWritingFrames.store(writeFrames + writtenFrames, memory_order_relaxed);
+            std::atomic_thread_fence(memory_order_release);
+        } else {
+            size_t freeFrames = mRingSizeInFrames -
+                                (writeFrames - mReadFrames.load(memory_order_acquire));
+            writtenFrames = std::min(framesRead, freeFrames);
+        }
+        size_t offset = writeFrames % mRingSizeInFrames;
+        size_t firstChunk = std::min(writtenFrames, mRingSizeInFrames - offset);
+        memcpy(mRing.data() + offset * mFrameSize, mPeriodBuffer.data(), firstChunk * mFrameSize);
+        memcpy(mRing.data(), mPeriodBuffer.data() + firstChunk * mFrameSize,
+               (writtenFrames - firstChunk) * mFrameSize);
+        mWriteFrames.store(writeFrames + writtenFrames);
+
+        if (writtenFrames < framesRead) {
+            // Client too late, its oldest frames are kept.
+            mStats.onOverflow(framesRead - writtenFrames);
+        }
+    } else {
+        Log::Error() << __FUNCTION__ << ": prefetch stopped (err=" << status << ")";
+        mSourceError = status;
+    }
+    if (mIsClientWaiting.load()) {
+        Mutex::Autolock lock(mDataLock);
+        mDataCond.signal();
+    }
+    return status == android::OK;
+}
+
+uint64_t CapturePrefetcher::getOldestFrame(uint64_t writeFrames) const
+{
+    return (mIsKeepingLatest && writeFrames > mRingSizeInFrames) ?
+           writeFrames - mRingSizeInFrames : 0;
+}
+
+size_t CapturePrefetcher::getReadableFrames() const
+{
+    uint64_t writeFrames = mWriteFrames.load();
+    return writeFrames - std::max(mReadFrames.load(memory_order_relaxed),
+                                  getOldestFrame(writeFrames + mPeriodSizeInFrames));
+}
+
+status_t CapturePrefetcher::read(void *buffer, size_t frames, nsecs_t timeout, size_t &framesRead)
+{
+    framesRead = 0;
+    if (getReadableFrames() < frames) {
+        nsecs_t deadline = systemTime() + timeout;
+        Mutex::Autolock lock(mDataLock);
+        mIsClientWaiting.store(true);
+        // Checked once flagged, the thread signals any frame prefetched from now on.
+        while (getReadableFrames() < frames && mSourceError == android::OK) {
+            nsecs_t remaining = deadline - systemTime();
+            if (remaining <= 0) {
+                break;
+            }
+            mDataCond.waitRelative(mDataLock, remaining);
+        }
+        mIsClientWaiting.store(false);
+    }
+    status_t status = mSourceError;
+    if (status != android::OK) {
+        return status;
+    }
+
+    uint64_t readFrames;
+    do {
+        uint64_t writeFrames = mWriteFrames.load(memory_order_acquire);
+        // Late client in keep-latest mode: skips the frames overwritten meanwhile.
+        readFrames = std::max(mReadFrames.load(memory_order_relaxed),
+                              getOldestFrame(writeFrames + mPeriodSizeInFrames));
+        framesRead = std::min<uint64_t>(frames, writeFrames - readFrames);
+        size_t offset = readFrames % mRingSizeInFrames;
+        size_t firstChunk = std::min(framesRead, mRingSizeInFrames - offset);
+        char *dst = static_cast<char *>(buffer);
+        memcpy(dst, mRing.data() + offset * mFrameSize, firstChunk * mFrameSize);
+        memcpy(dst + firstChunk * mFrameSize, mRing.data(),
+               (framesRead - firstChunk) * mFrameSize);
+        std::atomic_thread_fence(memory_order_acquire);
+        // Copied again if overwritten meanwhile by the thread, in keep-latest mode only.
+    } while (readFrames < getOldestFrame(mWritingFrames.load(memory_order_relaxed)));
+    mReadFrames.store(readFrames + framesRead, memory_order_release);
+    return android::OK;
+}
+
+} // namespace intel_audio
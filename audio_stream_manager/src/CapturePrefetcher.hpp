@@ -0,0 +1,171 @@
+/*
+ * Copyright (C) 2015 Intel Corporation
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#pragma once
+
+#include <StreamStats.hpp>
+#include <NonCopyable.hpp>
+#include <utils/Condition.h>
+#include <utils/Errors.h>
+#include <utils/Mutex.h>
+#include <utils/Timers.h>
+#include <atomic>
+#include <vector>
+#include <pthread.h>
+#include <stdint.h>
+
+namespace intel_audio
+{
+
+/**
+ * Drains the audio device of an input stream from a dedicated SCHED_FIFO thread, period by
+ * period, into a lock-free ring consumed by the client thread. The capture is thus not exposed
+ * to the scheduling latency of the client thread, as long as the ring does not overflow.
+ * The client is woken up as soon as the frames it waits for are prefetched.
+ * In keep-latest mode, the thread never waits for the client and overwrites the oldest frames
+ * instead, so that the ring always holds the latest captured frames (e.g. hotword pre-roll).
+ */
+class CapturePrefetcher : private audio_comms::utilities::NonCopyable
+{
+public:
+    /**
+     * Provides the captured frames to the prefetch thread.
+     */
+    class Source
+    {
+    public:
+        /**
+         * Reads frames from the audio device, blocking until available.
+         * Called from the prefetch thread.
+         *
+         * @param[out] buffer destination of the frames.
+         * @param[in] frames requested.
+         * @param[out] framesRead frames actually read.
+         *
+         * @return OK if successful, NO_INIT if no audio device is available yet, error code
+         *         otherwise, in which case the prefetch thread exits.
+         */
+        virtual android::status_t readPrefetchFrames(void *buffer, size_t frames,
+                                                     size_t &framesRead) = 0;
+
+    protected:
+        virtual ~Source() {}
+    };
+
+    /**
+     * @param[in] source of the captured frames.
+     * @param[in] stats of the stream, to account the overflows of the ring.
+     */
+    CapturePrefetcher(Source &source, StreamStats &stats);
+
+    ~CapturePrefetcher();
+
+    /**
+     * Allocates the ring and starts the prefetch thread.
+     *
+     * @param[in] frameSize size of a frame in bytes.
+     * @param[in] sampleRate of the frames, to pace the thread while no audio device is available.
+     * @param[in] periodFrames frames read at once from the audio device.
+     * @param[in] depthFrames capacity of the ring.
+     * @param[in] keepLatest true to overwrite the oldest frames rather than accounting an overflow
+     *                       when the client is late.
+     *
+     * @return OK if started, error code otherwise.
+     */
+    android::status_t start(size_t frameSize, uint32_t sampleRate, size_t periodFrames,
+                            size_t depthFrames, bool keepLatest = false);
+
+    /**
+     * Stops the prefetch thread and drops the frames of the ring.
+     * Shall not be called with the stream lock held, as the thread may wait for it.
+     */
+    void stop();
+
+    bool isRunning() const { return mIsRunning; }
+
+    size_t getPeriodSizeInFrames() const { return mPeriodSizeInFrames; }
+
+    size_t getDepthInFrames() const { return mDepthInFrames; }
+
+    /**
+     * @return frames prefetched and not consumed yet by the client, limited to the depth of the
+     *         ring in keep-latest mode.
+     */
+    size_t getReadableFrames() const;
+
+    /**
+     * Consumes prefetched frames, waiting for them at most the given timeout.
+     * Called from the client thread only. In keep-latest mode, starts from the oldest frame still
+     * held by the ring if the client is late.
+     *
+     * @param[out] buffer destination of the frames.
+     * @param[in] frames requested.
+     * @param[in] timeout maximum time to wait for the frames, in nanoseconds.
+     * @param[out] framesRead frames actually read, less than requested upon timeout.
+     *
+     * @return OK if successful, error reported by the source otherwise.
+     */
+    android::status_t read(void *buffer, size_t frames, nsecs_t timeout, size_t &framesRead);
+
+private:
+    static void *threadLoop(void *context);
+
+    /**
+     * Prefetches a period, called from the prefetch thread.
+     *
+     * @return false if the thread shall exit.
+     */
+    bool prefetch();
+
+    /**
+     * @param[in] writeFrames end of the frames written or being written by the thread.
+     *
+     * @return first frame not overwritten yet by the thread, 0 out of keep-latest mode.
+     */
+    uint64_t getOldestFrame(uint64_t writeFrames) const;
+
+    Source &mSource;
+    StreamStats &mStats;
+
+    pthread_t mThread;
+    std::atomic<bool> mIsRunning; /**< Updated on start and stop only. */
+    std::atomic<bool> mIsExitRequested;
+    std::atomic<android::status_t> mSourceError; /**< Error which stopped the prefetch. */
+
+    std::vector<char> mRing;
+    std::vector<char> mPeriodBuffer; /**< Read from the source, copied to the ring. */
+    size_t mFrameSize;
+    uint32_t mSampleRate;
+    size_t mPeriodSizeInFrames;
+    size_t mRingSizeInFrames;
+    size_t mDepthInFrames; /**< Ring size, minus the period being written in keep-latest mode. */
+    bool mIsKeepingLatest;
+    std::atomic<uint64_t> mWriteFrames; /**< Frames prefetched, written by the thread only. */
+    /** End of the frames being written by the thread, in keep-latest mode only. */
+    std::atomic<uint64_t> mWritingFrames;
+    std::atomic<uint64_t> mReadFrames; /**< Frames consumed, written by the client only. */
+
+    /**
+     * Wake-on-data: the client waits on the condition only when the ring lacks frames, and
+     * flags it so that the thread signals only when a client is waiting.
+     */
+    android::Mutex mDataLock;
+    android::Condition mDataCond;
+    std::atomic<bool> mIsClientWaiting;
+
+    static const int mThreadPriority = 2; /**< SCHED_FIFO priority of the prefetch thread. */
+};
+
+} // namespace intel_audio
@@ -529,6 +529,30 @@ android::status_t CompressedStreamOut::getRenderPosition(uint32_t &dspFrames) co
     return android::OK;
 }
 
+status_t CompressedStreamOut::dump(int fd) const
+{
+    static const char *const stateNames[] = {
+        "closed", "idle", "playing", "paused", "draining"
+    };
+    Mutex::Locker locker(mCodecLock);
+    SstState::Enum state = mState;
+
+    dprintf(fd, "  Compressed output stream %p (io handle %d):\n", this, getIoHandle());
+    dprintf(fd, "    state: %s%s%s, buffer size: %zu bytes, volume: %.2f\n", stateNames[state],
+            mRecoveryOnGoing ? " (recovering)" : "", mIsInFlushedState ? " (flushed)" : "",
+            mBufferSize, mVolume);
+    dprintf(fd, "    codec: format 0x%x, %d ch, %d Hz, %d bits, %d bps\n",
+            static_cast<uint32_t>(mCodec.format), mCodec.numChannels, mCodec.sampleRate,
+            mCodec.bitsPerSample, mCodec.avgBitRate);
+    if (mCompress != NULL && (state == SstState::PLAYING || state == SstState::PAUSED)) {
+        unsigned long renderedFrames;
+        unsigned int samplingRate;
+        if (compress_get_tstamp(mCompress, &renderedFrames, &samplingRate) == 0) {
+            dprintf(fd, "    rendered: %lu frames at %u Hz\n", renderedFrames, samplingRate);
+        }
+    }
+    return android::OK;
+}
 
 status_t CompressedStreamOut::setCallback(stream_callback_t callback, void *cookie)
 {
@@ -93,7 +93,7 @@ public:
 
     virtual android::status_t standby();
 
-    virtual android::status_t dump(int) const { return android::OK; }
+    virtual android::status_t dump(int fd) const;
 
     virtual android::status_t setParameters(const std::string &keyValuePairs);
 
@@ -20,13 +20,19 @@
 #include "StreamIn.hpp"
 #include "StreamOut.hpp"
 #include "CompressedStreamOut.hpp"
+#include "EchoReference.hpp"
 #include <AudioCommsAssert.hpp>
+#include <BitField.hpp>
 #include <hardware/audio.h>
 #include <Parameters.hpp>
 #include <RouteManagerInstance.hpp>
 #include <hardware/audio_effect.h>
+#include <property/Property.hpp>
 #include <utilities/Log.hpp>
+#include <stdio.h>
+#include <sstream>
 #include <string>
+#include <vector>
 
 /**
  * Introduce a primary flag for input as well to manage route applicability for stream symetrically.
@@ -35,16 +41,28 @@ static const audio_input_flags_t AUDIO_INPUT_FLAG_PRIMARY = static_cast<audio_in
 
 using namespace std;
 using android::status_t;
+using audio_comms::utilities::BitField;
 using audio_comms::utilities::Log;
 using audio_comms::utilities::Mutex;
+using audio_comms::utilities::Property;
 
 namespace intel_audio
 {
 
+const std::string Device::mHotwordPrerollProp = "media.audio.input.hotword_preroll_ms";
+const std::string Device::mPatchCoalescingProp = "media.audio.patch_coalescing_ms";
+
 Device::Device()
     : mEchoReference(NULL),
+      mCalibratedEchoPathDelay(mUncalibratedEchoPathDelay),
       mStreamInterface(NULL),
-      mPrimaryOutput(NULL)
+      mPrimaryOutput(NULL),
+      mLoopback(NULL),
+      mLoopbackInput(NULL),
+      mHotwordPreroll(NULL),
+      mHotwordPrerollClient(NULL),
+      mIsSourceUpdateDeferred(false),
+      mIsSinkUpdateDeferred(false)
 {
     // Retrieve the Stream Interface
     mStreamInterface = RouteManagerInstance::getStreamInterface();
@@ -63,13 +81,66 @@ Device::Device()
     mStreamInterface->reconsiderRouting(true);
 
     Log::Debug() << __FUNCTION__ << ": Route Manager Service successfully started";
+
+    startHotwordPreroll();
 }
 
 Device::~Device()
 {
+    // A pending patch update shall not fire on a device being destroyed.
+    mStreamInterface->disarmRoutingTimer(*this);
+    stopHotwordPreroll();
     mStreamInterface->stopService();
 }
 
+void Device::startHotwordPreroll()
+{
+    uint32_t durationMs = Property<uint32_t>(mHotwordPrerollProp, 0).getValue();
+    if (durationMs == 0) {
+        return;
+    }
+    audio_config_t config;
+    config.sample_rate = mHotwordPrerollSampleRate;
+    config.channel_mask = AUDIO_CHANNEL_IN_MONO;
+    config.format = AUDIO_FORMAT_PCM_16_BIT;
+
+    // Not tracked as opened streams, its route is requested apart, see prepareStreamsParameters.
+    StreamIn *preroll = new StreamIn(this, AUDIO_IO_HANDLE_NONE, AUDIO_INPUT_FLAG_PRIMARY,
+                                     AUDIO_SOURCE_HOTWORD, AUDIO_DEVICE_IN_BUILTIN_MIC);
+    status_t err = preroll->set(config);
+    if (err != android::OK) {
+        Log::Error() << __FUNCTION__ << ": set error, hotword pre-roll disabled";
+        delete preroll;
+        return;
+    }
+    mStreamInterface->addStream(*preroll);
+    mHotwordPreroll = preroll;
+    if (mHotwordPreroll->startPreroll(durationMs) != android::OK) {
+        Log::Error() << __FUNCTION__ << ": hotword pre-roll disabled";
+        stopHotwordPreroll();
+        return;
+    }
+    Log::Debug() << __FUNCTION__ << ": hotword pre-roll of " << durationMs << " ms started";
+}
+
+void Device::stopHotwordPreroll()
+{
+    if (mHotwordPreroll == NULL) {
+        return;
+    }
+    StreamIn *preroll = mHotwordPreroll;
+    // Reset first not to request its route anymore while stopping.
+    mHotwordPreroll = NULL;
+    Stream &stream = *preroll;
+    mStreamInterface->disarmRoutingTimer(stream);
+    preroll->stopPreroll();
+    mStreamInterface->removeStream(*preroll);
+    mPatchCollectionLock.lock();
+    removeContributionUnsafe(*preroll);
+    mPatchCollectionLock.unlock();
+    delete preroll;
+}
+
 status_t Device::initCheck() const
 {
     return mStreamInterface ? android::OK : android::NO_INIT;
@@ -111,7 +182,9 @@ android::status_t Device::openOutputStream(audio_io_handle_t handle,
             return err;
         }
         stream = out;
+        mPatchCollectionLock.lock();
         mStreams[handle] = out;
+        mPatchCollectionLock.unlock();
         return android::OK;
     }
     StreamOut *out = new StreamOut(this, handle, flags, devices);
@@ -126,7 +199,9 @@ android::status_t Device::openOutputStream(audio_io_handle_t handle,
         delete out;
         return android::BAD_VALUE;
     }
+    mPatchCollectionLock.lock();
     mStreams[handle] = out;
+    mPatchCollectionLock.unlock();
 
     if (mPrimaryOutput == NULL && hasPrimaryFlags(*out)) {
         mPrimaryOutput = out;
@@ -146,8 +221,16 @@ void Device::closeOutputStream(StreamOutInterface *out)
         Log::Error() << __FUNCTION__ << ": invalid stream handle";
         return;
     }
+    // A deferred standby shall neither be pending nor in flight while the stream is torn down.
+    Stream &stream = static_cast<StreamOut &>(*out);
+    mStreamInterface->disarmRoutingTimer(stream);
     // Informs the route manager of stream destruction
     mStreamInterface->removeStream(static_cast<StreamOut &>(*out));
+    // Stopped before its contribution is removed, not to be contributed again upon destruction.
+    static_cast<StreamOut *>(out)->setStandby(true);
+    mPatchCollectionLock.lock();
+    removeContributionUnsafe(static_cast<StreamOut &>(*out));
+    mPatchCollectionLock.unlock();
     audio_io_handle_t handle = static_cast<StreamOut *>(out)->getIoHandle();
     if (mStreams.find(handle) == mStreams.end()) {
         Log::Error() << __FUNCTION__ << ": requesting to deleted an output stream with io handle= "
@@ -156,8 +239,11 @@ void Device::closeOutputStream(StreamOutInterface *out)
         if (isPrimaryOutput(*mStreams[handle])) {
             mPrimaryOutput = NULL;
         }
+        mPatchCollectionLock.lock();
         mStreams.erase(handle);
+        mPatchCollectionLock.unlock();
     }
+    Mutex::Locker locker(mStreamDumpLock);
     delete out;
 }
 
@@ -179,6 +265,20 @@ android::status_t Device::openInputStream(audio_io_handle_t handle,
     // If no flags is provided for input, use primary by default
     flags = (flags == AUDIO_INPUT_FLAG_NONE) ? AUDIO_INPUT_FLAG_PRIMARY : flags;
 
+    bool isServedByPreroll = source == AUDIO_SOURCE_HOTWORD && mHotwordPreroll != NULL &&
+                             mHotwordPrerollClient == NULL;
+    if (isServedByPreroll &&
+        (config.sample_rate != mHotwordPreroll->getSampleRate() ||
+         config.format != mHotwordPreroll->getFormat() ||
+         config.channel_mask != mHotwordPreroll->getChannels())) {
+        Log::Warning() << __FUNCTION__ << ": hotword stream shall be opened with the pre-roll "
+                       << "configuration";
+        config.sample_rate = mHotwordPreroll->getSampleRate();
+        config.format = mHotwordPreroll->getFormat();
+        config.channel_mask = mHotwordPreroll->getChannels();
+        return android::BAD_VALUE;
+    }
+
     StreamIn *in = new StreamIn(this, handle, flags, source, devices);
     status_t err = in->set(config);
     if (err != android::OK) {
@@ -191,7 +291,21 @@ android::status_t Device::openInputStream(audio_io_handle_t handle,
         delete in;
         return android::BAD_VALUE;
     }
+    if (devices == AUDIO_DEVICE_IN_LOOPBACK) {
+        err = openLoopback(*in);
+        if (err != android::OK) {
+            delete in;
+            return err;
+        }
+    }
+    mPatchCollectionLock.lock();
     mStreams[handle] = in;
+    mPatchCollectionLock.unlock();
+
+    if (isServedByPreroll) {
+        in->setPrerollSource(mHotwordPreroll);
+        mHotwordPrerollClient = in;
+    }
 
     // Informs the route manager of stream creation
     mStreamInterface->addStream(*in);
@@ -207,18 +321,72 @@ void Device::closeInputStream(StreamInInterface *in)
         Log::Error() << __FUNCTION__ << ": invalid stream handle";
         return;
     }
+    // A deferred standby shall neither be pending nor in flight while the stream is torn down.
+    Stream &stream = static_cast<StreamIn &>(*in);
+    mStreamInterface->disarmRoutingTimer(stream);
     // Informs the route manager of stream destruction
     mStreamInterface->removeStream(static_cast<StreamIn &>(*in));
+    // Stopped before its contribution is removed, not to be contributed again upon destruction.
+    static_cast<StreamIn *>(in)->setStandby(true);
+    mPatchCollectionLock.lock();
+    removeContributionUnsafe(static_cast<StreamIn &>(*in));
+    mPatchCollectionLock.unlock();
     audio_io_handle_t handle = static_cast<StreamIn *>(in)->getIoHandle();
     if (mStreams.find(handle) == mStreams.end()) {
         Log::Error() << __FUNCTION__ << ": requesting to deleted an input stream with io handle= "
                      << handle << " not tracked by Primary HAL";
     } else {
+        mPatchCollectionLock.lock();
         mStreams.erase(handle);
+        mPatchCollectionLock.unlock();
+    }
+    if (in == mHotwordPrerollClient) {
+        mHotwordPrerollClient = NULL;
     }
+    if (in == mLoopbackInput) {
+        closeLoopback();
+    }
+    Mutex::Locker locker(mStreamDumpLock);
     delete in;
 }
 
+status_t Device::openLoopback(StreamIn &in)
+{
+    if (mLoopback != NULL) {
+        Log::Error() << __FUNCTION__ << ": loopback already opened";
+        return android::INVALID_OPERATION;
+    }
+    if (mPrimaryOutput == NULL) {
+        Log::Error() << __FUNCTION__ << ": no primary output to loop back";
+        return android::NO_INIT;
+    }
+    StreamOut *out = static_cast<StreamOut *>(mPrimaryOutput);
+    EchoReference *loopback = new EchoReference(in.streamSampleSpec(), out->streamSampleSpec());
+    status_t status = loopback->init();
+    if (status != android::OK) {
+        Log::Error() << __FUNCTION__ << ": Could not create loopback";
+        delete loopback;
+        return status;
+    }
+    mLoopback = loopback;
+    mLoopbackInput = &in;
+    in.setLoopback(mLoopback);
+    out->addLoopback(mLoopback);
+    return android::OK;
+}
+
+void Device::closeLoopback()
+{
+    if (mPrimaryOutput != NULL) {
+        // Not written anymore by the playback thread once removed.
+        static_cast<StreamOut *>(mPrimaryOutput)->removeLoopback(mLoopback);
+    }
+    mLoopbackInput->setLoopback(NULL);
+    delete mLoopback;
+    mLoopback = NULL;
+    mLoopbackInput = NULL;
+}
+
 status_t Device::setMicMute(bool mute)
 {
     Log::Verbose() << __FUNCTION__ << ": " << (mute ? "true" : "false");
@@ -236,6 +404,90 @@ status_t Device::getMicMute(bool &muted) const
     return pair.get(Parameters::gKeyMicMute, muted);
 }
 
+status_t Device::dump(const int fd) const
+{
+    bool isMicMuted = false;
+    getMicMute(isMicMuted);
+
+    // Snapshot taken under the patch collection lock, written once released.
+    std::ostringstream state;
+    mPatchCollectionLock.lock();
+    audio_mode_t mode = mMode;
+    size_t streamCount = mStreams.size();
+    size_t patchCount = mPatches.size();
+    for (PatchCollection::const_iterator it = mPatches.begin(); it != mPatches.end(); ++it) {
+        dumpPatchUnsafe(it->second, state);
+    }
+    dumpRoutingParametersUnsafe(Direction::Output, state);
+    dumpRoutingParametersUnsafe(Direction::Input, state);
+    mPatchCollectionLock.unlock();
+
+    dprintf(fd, "Intel Audio HAL:\n");
+    dprintf(fd, "  mode: %d, mic mute: %s, streams: %zu, patches: %zu\n", mode,
+            isMicMuted ? "on" : "off", streamCount, patchCount);
+    dprintf(fd, "%s", state.str().c_str());
+    mStreamInterface->dump(fd);
+
+    // Streams dumped once the patch collection lock released, pinned by the stream dump lock as a
+    // closed stream is only deleted under it.
+    Mutex::Locker locker(mStreamDumpLock);
+    std::vector<const Stream *> streams;
+    mPatchCollectionLock.lock();
+    for (StreamCollection::const_iterator it = mStreams.begin(); it != mStreams.end(); ++it) {
+        streams.push_back(it->second);
+    }
+    mPatchCollectionLock.unlock();
+    for (std::vector<const Stream *>::const_iterator it = streams.begin(); it != streams.end();
+         ++it) {
+        (*it)->dump(fd);
+    }
+    return android::OK;
+}
+
+void Device::dumpPatchUnsafe(const Patch &patch, std::ostream &state) const
+{
+    state << "  Patch " << patch.getHandle() << ": source devices 0x" << std::hex
+          << patch.getDevices(AUDIO_PORT_ROLE_SOURCE) << ", sink devices 0x"
+          << patch.getDevices(AUDIO_PORT_ROLE_SINK) << std::dec;
+    const Port *mixPort = patch.getMixPort(AUDIO_PORT_ROLE_SOURCE);
+    if (mixPort == NULL) {
+        mixPort = patch.getMixPort(AUDIO_PORT_ROLE_SINK);
+    }
+    if (mixPort != NULL) {
+        const audio_port_config &config = mixPort->getConfig();
+        state << ", mix io handle " << mixPort->getMixIoHandle() << " (" << config.sample_rate
+              << " Hz, channel mask 0x" << std::hex << config.channel_mask << ", format 0x"
+              << static_cast<uint32_t>(config.format) << std::dec << ")";
+    }
+    state << "\n";
+}
+
+void Device::dumpRoutingParametersUnsafe(Direction::Values direction,
+                                         std::ostream &state) const
+{
+    const RoutingAggregate &aggregate = mAggregates[direction];
+    const RoutingParameters::StreamsParameters &applied = mAppliedParameters.streams[direction];
+    state << "  " << (direction == Direction::Output ? "Output" : "Input") << " routing:"
+          << std::hex << " devices 0x" << aggregate.devices.getMask()
+          << " (internal 0x" << aggregate.internalDevices.getMask()
+          << "), flags 0x" << aggregate.flags.getMask()
+          << ", use cases 0x" << aggregate.useCases.getMask()
+          << ", effects 0x" << aggregate.effects.getMask();
+    if (applied.isSet) {
+        state << "; applied devices 0x" << applied.devices << ", flags 0x" << applied.flagMask
+              << ", use cases 0x" << applied.useCaseMask;
+    }
+    state << std::dec;
+    if (direction == Direction::Output) {
+        state << ", mode " << mAppliedParameters.mode;
+    } else {
+        state << ", band " << mAppliedParameters.band
+              << ", pre processing 0x" << std::hex << mAppliedParameters.preProcRequested
+              << std::dec;
+    }
+    state << "\n";
+}
+
 size_t Device::getInputBufferSize(const struct audio_config &config) const
 {
     switch (config.sample_rate) {
@@ -253,7 +505,12 @@ size_t Device::getInputBufferSize(const struct audio_config &config) const
         Log::Warning() << __FUNCTION__ << ": bad sampling rate: " << config.sample_rate;
         return 0;
     }
-    if (config.format != AUDIO_FORMAT_PCM_16_BIT) {
+    switch (config.format) {
+    case AUDIO_FORMAT_PCM_16_BIT:
+    case AUDIO_FORMAT_PCM_8_24_BIT:
+    case AUDIO_FORMAT_PCM_FLOAT:
+        break;
+    default:
         Log::Warning() << __FUNCTION__ << ": bad format: " << static_cast<int32_t>(config.format);
         return 0;
     }
@@ -265,6 +522,19 @@ size_t Device::getInputBufferSize(const struct audio_config &config) const
         return 0;
     }
     SampleSpec spec(channelCount, config.format, config.sample_rate);
+    spec.setChannelMask(config.channel_mask);
+    // Sized on the period of the route a primary input would be attached to, as the buffer size
+    // of the stream once opened. Input devices are matched against the routes without their
+    // direction bit, as set on input streams.
+    uint32_t periodUs = mStreamInterface->getPeriodInUsForConfig(
+        false, AUDIO_INPUT_FLAG_PRIMARY, BitField::indexToMask(AUDIO_SOURCE_MIC),
+        AUDIO_DEVICE_IN_BUILTIN_MIC & ~AUDIO_DEVICE_BIT_IN, spec);
+    size_t bytes = spec.convertFramesToBytes(AudioUtils::alignOn16(
+                                                 spec.convertUsecToframes(periodUs)));
+    if (bytes != 0) {
+        return bytes;
+    }
+    Log::Warning() << __FUNCTION__ << ": no route for this configuration, using default size";
     return spec.convertFramesToBytes(spec.convertUsecToframes(mRecordingBufferTimeUsec));
 }
 
@@ -284,11 +554,13 @@ string Device::getParameters(const string &keys) const
 
 android::status_t Device::setMode(audio_mode_t mode)
 {
+    mPatchCollectionLock.lock();
     mMode = mode;
+    mPatchCollectionLock.unlock();
     return android::OK;
 }
 
-void Device::resetEchoReference(struct echo_reference_itfe *reference)
+void Device::resetEchoReference(EchoReference *reference)
 {
     Log::Debug() << __FUNCTION__ << ": (reference=" << reference << ")";
     // Check that the reset is possible:
@@ -310,12 +582,22 @@ void Device::resetEchoReference(struct echo_reference_itfe *reference)
         return;
     }
     StreamOut *out = static_cast<StreamOut *>(stream);
-    out->removeEchoReference(mEchoReference);
-    release_echo_reference(mEchoReference);
+    out->removeEchoReference(reference);
     mEchoReference = NULL;
+    delete reference;
+
+    nsecs_t delay = mCalibratedEchoPathDelay.exchange(mUncalibratedEchoPathDelay);
+    if (delay != mUncalibratedEchoPathDelay) {
+        Mutex::Locker locker(mEchoPathLock);
+        Log::Debug() << __FUNCTION__ << ": echo path delay " << ns2ms(delay)
+                     << " ms from input devices 0x" << std::hex << mEchoPath.first
+                     << " to output devices 0x" << mEchoPath.second;
+        mEchoPathDelays[mEchoPath] = delay;
+    }
 }
 
-struct echo_reference_itfe *Device::getEchoReference(const SampleSpec &inputSampleSpec)
+EchoReference *Device::getEchoReference(const SampleSpec &inputSampleSpec,
+                                        audio_devices_t inputDevices)
 {
     Log::Debug() << __FUNCTION__;
     resetEchoReference(mEchoReference);
@@ -330,19 +612,33 @@ struct echo_reference_itfe *Device::getEchoReference(const SampleSpec &inputSamp
     StreamOut *out = static_cast<StreamOut *>(stream);
     SampleSpec outputSampleSpec = out->streamSampleSpec();
 
-    if (create_echo_reference(inputSampleSpec.getFormat(),
-                              inputSampleSpec.getChannelCount(),
-                              inputSampleSpec.getSampleRate(),
-                              outputSampleSpec.getFormat(),
-                              outputSampleSpec.getChannelCount(),
-                              outputSampleSpec.getSampleRate(),
-                              &mEchoReference) < 0) {
+    EchoReference *echoReference = new EchoReference(inputSampleSpec, outputSampleSpec);
+    if (echoReference->init() != android::OK) {
         Log::Error() << __FUNCTION__ << ": Could not create echo reference";
+        delete echoReference;
         return NULL;
     }
-    out->addEchoReference(mEchoReference);
-    Log::Debug() << __FUNCTION__ << ": return that mEchoReference=" << mEchoReference << ")";
-    return mEchoReference;
+    {
+        Mutex::Locker locker(mEchoPathLock);
+        mEchoPath = EchoPath(inputDevices, out->getDevices());
+        EchoPathDelayCollection::const_iterator it = mEchoPathDelays.find(mEchoPath);
+        if (it != mEchoPathDelays.end()) {
+            Log::Debug() << __FUNCTION__ << ": echo path delay " << ns2ms(it->second) << " ms";
+            echoReference->setPathDelay(it->second);
+        }
+    }
+    mEchoReference = echoReference;
+    out->addEchoReference(echoReference);
+    Log::Debug() << __FUNCTION__ << ": return that mEchoReference=" << echoReference << ")";
+    return echoReference;
+}
+
+void Device::setEchoPathDelay(const EchoReference &reference, nsecs_t delay)
+{
+    if (&reference != mEchoReference) {
+        return;
+    }
+    mCalibratedEchoPathDelay = delay;
 }
 
 void Device::printPlatformFwErrorInfo()
@@ -417,7 +713,7 @@ void Device::onPortAttached(const audio_patch_handle_t &patchHandle,
     if (streamPreviousPatchHandle != AUDIO_PATCH_HANDLE_NONE &&
         streamPreviousPatchHandle != patchHandle) {
         Log::Warning() << __FUNCTION__ << ": setting new patch for already attached mix";
-        mPatches.erase(streamPreviousPatchHandle);
+        erasePatchUnsafe(streamPreviousPatchHandle);
     }
     stream->setPatchHandle(patchHandle);
 
@@ -461,18 +757,45 @@ status_t Device::createAudioPatch(size_t sourcesCount,
     if (handle == AUDIO_PATCH_HANDLE_NONE) {
         handle = Patch::nextUniqueHandle();
     }
+    // Applies the update deferred upon the release of the previous patch along with this one.
+    bool updateSourceDevice = false;
+    bool updateSinkDevice = false;
+    if (takeDeferredPatchUpdate(updateSourceDevice, updateSinkDevice)) {
+        mStreamInterface->disarmRoutingTimer(*this);
+    }
+
     mPatchCollectionLock.lock();
 
     std::pair<PatchCollection::iterator, bool> ret;
     ret = mPatches.insert(std::pair<audio_patch_handle_t, Patch>(handle, Patch(handle, this)));
 
     Patch &patch = ret.first->second;
+    // The same patch may be requested to be created just to update its port configuration(s).
+    std::vector<Stream *> involvedStreams;
+    if (!ret.second) {
+        updateInternalDevicesUnsafe(patch, false);
+        getPatchStreamsUnsafe(patch, involvedStreams);
+    }
     patch.addPorts(sourcesCount, sources, sinksCount, sinks);
+    updateInternalDevicesUnsafe(patch, true);
+    getPatchStreamsUnsafe(patch, involvedStreams);
+    for (std::vector<Stream *>::const_iterator it = involvedStreams.begin();
+         it != involvedStreams.end(); ++it) {
+        Stream *stream = *it;
+        audio_port_role_t devicePortRole = getOppositeRole(stream->getRole());
+        if (stream->getPatchHandle() == handle && patch.hasDevice(devicePortRole)) {
+            // Update device(s) info from patch to stream involved in this patch
+            stream->setDevices(patch.getDevices(devicePortRole));
+        }
+        updateContributionUnsafe(*stream);
+    }
     mPatchCollectionLock.unlock();
 
-    updateParametersSync(patch.hasDevice(AUDIO_PORT_ROLE_SOURCE),
-                         patch.hasDevice(AUDIO_PORT_ROLE_SINK),
-                         handle);
+    // Output devices are forced from the patch only if it involves some.
+    bool hasSinkDevice = patch.hasDevice(AUDIO_PORT_ROLE_SINK);
+    updateParametersSync(updateSourceDevice || patch.hasDevice(AUDIO_PORT_ROLE_SOURCE),
+                         updateSinkDevice || hasSinkDevice,
+                         hasSinkDevice ? handle : AUDIO_PATCH_HANDLE_NONE);
     // Patch has been created, even if updateParameters failed on one or more parameters, need to
     // return OK to AudioFlinger, unless this patch will not be considered as created and will
     // never be deleted (orphans patch within Audio HAL)
@@ -481,6 +804,9 @@ status_t Device::createAudioPatch(size_t sourcesCount,
 
 status_t Device::releaseAudioPatch(audio_patch_handle_t handle)
 {
+    uint32_t defaultCoalescingMs = mDefaultPatchCoalescingMs;
+    uint32_t coalescingMs = Property<uint32_t>(mPatchCoalescingProp,
+                                               defaultCoalescingMs).getValue();
     mPatchCollectionLock.lock();
     if (!hasPatchUnsafe(handle)) {
         Log::Error() << __FUNCTION__ << " Patch handle " << handle
@@ -492,7 +818,23 @@ status_t Device::releaseAudioPatch(audio_patch_handle_t handle)
     Patch &patch = getPatchUnsafe(handle);
     bool involvedSourceDevices = patch.hasDevice(AUDIO_PORT_ROLE_SOURCE);
     bool involvedSinkDevices = patch.hasDevice(AUDIO_PORT_ROLE_SINK);
-    mPatches.erase(handle);
+    std::vector<Stream *> involvedStreams;
+    getPatchStreamsUnsafe(patch, involvedStreams);
+    erasePatchUnsafe(handle);
+    for (std::vector<Stream *>::const_iterator it = involvedStreams.begin();
+         it != involvedStreams.end(); ++it) {
+        updateContributionUnsafe(**it);
+    }
+
+    if (coalescingMs != 0) {
+        // A patch is likely to be created right after, e.g. upon device switch: routing both
+        // at once spares a transitional unrouting.
+        mIsSourceUpdateDeferred = mIsSourceUpdateDeferred || involvedSourceDevices;
+        mIsSinkUpdateDeferred = mIsSinkUpdateDeferred || involvedSinkDevices;
+        mPatchCollectionLock.unlock();
+        mStreamInterface->armRoutingTimer(coalescingMs, *this);
+        return android::OK;
+    }
     mPatchCollectionLock.unlock();
 
     updateParametersSync(involvedSourceDevices, involvedSinkDevices);
@@ -501,24 +843,55 @@ status_t Device::releaseAudioPatch(audio_patch_handle_t handle)
     return android::OK;
 }
 
+bool Device::takeDeferredPatchUpdate(bool &updateSourceDevice, bool &updateSinkDevice)
+{
+    mPatchCollectionLock.lock();
+    updateSourceDevice = mIsSourceUpdateDeferred;
+    updateSinkDevice = mIsSinkUpdateDeferred;
+    mIsSourceUpdateDeferred = false;
+    mIsSinkUpdateDeferred = false;
+    mPatchCollectionLock.unlock();
+    return updateSourceDevice || updateSinkDevice;
+}
+
+void Device::onRoutingTimer()
+{
+    bool updateSourceDevice = false;
+    bool updateSinkDevice = false;
+    if (!takeDeferredPatchUpdate(updateSourceDevice, updateSinkDevice)) {
+        // Applied along with a patch created since.
+        return;
+    }
+    Log::Debug() << __FUNCTION__ << ": applying routing update deferred upon patch release";
+    // Called from routing thread context, routing cannot be waited for.
+    updateParameters(updateSourceDevice, updateSinkDevice, AUDIO_PATCH_HANDLE_NONE, false);
+}
+
 status_t Device::updateParameters(bool updateSourceDevice, bool updateSinkDevice,
                                   audio_patch_handle_t lastPatch, bool synchronous)
 {
-    KeyValuePairs pairs;
+    RoutingParameters parameters;
     // Update now the routing, i.e. the devices in input and/or output
     if (updateSourceDevice) {
         // Source Port update requested: it may impact input streams parameters
-        prepareStreamsParameters(AUDIO_PORT_ROLE_SINK, pairs);
+        prepareStreamsParameters(AUDIO_PORT_ROLE_SINK, parameters);
     }
     if (updateSinkDevice) {
         // Sink Port update requested: it may impact output streams parameters
-        prepareStreamsParameters(AUDIO_PORT_ROLE_SOURCE, pairs, lastPatch);
+        prepareStreamsParameters(AUDIO_PORT_ROLE_SOURCE, parameters, lastPatch);
     }
-    if (pairs.toString().empty()) {
+    if (parameters.isEmpty()) {
         return android::OK;
     }
-    Log::Verbose() << __FUNCTION__ << ": Parameters:" << pairs.toString();
-    return mStreamInterface->setParameters(pairs.toString(), synchronous);
+    status_t status = mStreamInterface->setRoutingParameters(parameters, synchronous);
+    if (status != android::OK) {
+        // Not recorded as applied, so that the next update applies them again.
+        return status;
+    }
+    mPatchCollectionLock.lock();
+    setAppliedUnsafe(parameters);
+    mPatchCollectionLock.unlock();
+    return android::OK;
 }
 
 status_t Device::getAudioPort(struct audio_port & /*port*/) const
@@ -546,73 +919,173 @@ uint32_t Device::selectOutputDevices(uint32_t streamDeviceMask)
     return selectedDeviceMask;
 }
 
-void Device::prepareStreamsParameters(audio_port_role_t streamPortRole, KeyValuePairs &pairs,
-                                      audio_patch_handle_t lastPatch)
+status_t Device::updateStreamsParameters(const Stream &stream, bool isSynchronous)
 {
-    audio_devices_t deviceMask = AUDIO_DEVICE_NONE;
-    audio_devices_t internalDeviceMask = AUDIO_DEVICE_NONE;
-    uint32_t streamsFlagMask = 0;
-    uint32_t streamsUseCaseMask = 0;
-    uint32_t requestedEffectMask = 0;
-
-    bool forceDeviceFromLastPatch = (lastPatch != AUDIO_PATCH_HANDLE_NONE);
-    // As Klockwork complains about potential dead leack, avoid using Locker helper here.
     mPatchCollectionLock.lock();
+    updateContributionUnsafe(stream);
+    mPatchCollectionLock.unlock();
 
-    // Loop on all patches that involve source mix ports (i.e. output streams)
-    for (PatchCollection::const_iterator it = mPatches.begin(); it != mPatches.end(); ++it) {
-        const Patch &patch = it->second;
-        audio_port_role_t devicePortRole = getOppositeRole(streamPortRole);
-        const Port *mixPort = patch.getMixPort(streamPortRole);
+    // If a stream is a sink mix port: we need to update source devices.
+    // If a stream is a source mix port: we need to update parameters related to sink devices.
+    return updateParameters(stream.getRole() == AUDIO_PORT_ROLE_SINK,
+                            stream.getRole() == AUDIO_PORT_ROLE_SOURCE,
+                            AUDIO_PATCH_HANDLE_NONE,
+                            isSynchronous);
+}
 
-        if (!patch.hasDevice(devicePortRole)) {
-            // This patch does not connect any devices for the requested role.
-            continue;
-        }
-        if (patch.hasDevice(streamPortRole)) {
-            // This patch is connecting 2 device ports to one another.
-            internalDeviceMask |= patch.getDevices(devicePortRole);
-        }
-        if (mixPort == NULL) {
-            // This patch does not involve a valid mix port in the requested role.";
-            continue;
-        }
-        audio_io_handle_t streamHandle = mixPort->getMixIoHandle();
-        Stream *stream = NULL;
-        if (!getStream(streamHandle, stream)) {
-            Log::Error() << __FUNCTION__ << ": Mix Port IO handle does not match any stream).";
-            continue;
-        }
-        // Update device(s) info from patch to stream involved in this patch
-        stream->setDevices(patch.getDevices(devicePortRole));
+void Device::prepareStreamsParameters(audio_port_role_t streamPortRole,
+                                      RoutingParameters &parameters,
+                                      audio_patch_handle_t lastPatch)
+{
+    Direction::Values direction = getDirectionFromMix(streamPortRole);
+    const RoutingAggregate &aggregate = mAggregates[direction];
+    // As Klockwork complains about potential dead leack, avoid using Locker helper here.
+    mPatchCollectionLock.lock();
 
-        if (forceDeviceFromLastPatch && (lastPatch == patch.getHandle())) {
-            deviceMask |= stream->getDevices();
-        }
-        if (stream->isStarted() && stream->isRoutedByPolicy()) {
-            if (!stream->isMuted() && !forceDeviceFromLastPatch) {
-                deviceMask |= stream->getDevices();
-            }
-            streamsFlagMask |= stream->getFlagMask();
-            streamsUseCaseMask |= stream->getUseCaseMask();
-            requestedEffectMask |= stream->getEffectRequested();
+    audio_devices_t deviceMask = aggregate.devices.getMask();
+    if (lastPatch != AUDIO_PATCH_HANDLE_NONE) {
+        // Only the devices of the last patch are considered, whatever the state of its stream.
+        deviceMask = AUDIO_DEVICE_NONE;
+        PatchCollection::const_iterator it = mPatches.find(lastPatch);
+        if (it != mPatches.end() && it->second.getMixPort(streamPortRole) != NULL) {
+            deviceMask = it->second.getDevices(getOppositeRole(streamPortRole));
         }
     }
-
     if (streamPortRole == AUDIO_PORT_ROLE_SOURCE) {
         deviceMask = selectOutputDevices(deviceMask);
-        pairs.add(Parameters::gKeyAndroidMode, mode());
+        parameters.mode = mode();
     } else {
-        pairs.add<int>(Parameters::gKeyVoipBandType, getBandFromActiveInput());
-        pairs.add(Parameters::gKeyPreProcRequested, requestedEffectMask);
+        parameters.band = getBandFromActiveInput();
+        parameters.preProcRequested = aggregate.effects.getMask();
+    }
+    RoutingParameters::StreamsParameters &streams = parameters.streams[direction];
+    streams.isSet = true;
+    streams.useCaseMask = aggregate.useCases.getMask();
+    streams.devices = deviceMask | aggregate.internalDevices.getMask();
+    streams.flagMask = aggregate.flags.getMask();
+    if (isAppliedUnsafe(direction, parameters)) {
+        // No change of the aggregated parameters, spare a routing reconsideration.
+        streams.isSet = false;
     }
-    pairs.add(Parameters::gKeyUseCases[getDirectionFromMix(streamPortRole)], streamsUseCaseMask);
-    pairs.add(Parameters::gKeyDevices[getDirectionFromMix(streamPortRole)],
-              deviceMask | internalDeviceMask);
-    pairs.add(Parameters::gKeyFlags[getDirectionFromMix(streamPortRole)], streamsFlagMask);
     mPatchCollectionLock.unlock();
 }
 
+Device::StreamContribution Device::getContributionUnsafe(const Stream &stream) const
+{
+    StreamContribution contribution;
+    if (!stream.isStarted()) {
+        return contribution;
+    }
+    if (&stream == mHotwordPreroll) {
+        // No patch for the pre-roll, its route is requested as long as started.
+        contribution.devices = stream.getDevices();
+        contribution.flagMask = stream.getFlagMask();
+        contribution.useCaseMask = stream.getUseCaseMask();
+        return contribution;
+    }
+    if (!stream.isRoutedByPolicy()) {
+        return contribution;
+    }
+    PatchCollection::const_iterator it = mPatches.find(stream.getPatchHandle());
+    if (it == mPatches.end()) {
+        return contribution;
+    }
+    const Patch &patch = it->second;
+    const Port *mixPort = patch.getMixPort(stream.getRole());
+    if (!patch.hasDevice(getOppositeRole(stream.getRole())) || mixPort == NULL ||
+        mixPort->getMixIoHandle() != stream.getIoHandle()) {
+        // The stream is not connected to any device.
+        return contribution;
+    }
+    if (!stream.isMuted()) {
+        contribution.devices = stream.getDevices();
+    }
+    contribution.flagMask = stream.getFlagMask();
+    contribution.useCaseMask = stream.getUseCaseMask();
+    contribution.effectMask = stream.getEffectRequested();
+    return contribution;
+}
+
+void Device::updateContributionUnsafe(const Stream &stream)
+{
+    removeContributionUnsafe(stream);
+    StreamContribution contribution = getContributionUnsafe(stream);
+    RoutingAggregate &aggregate = mAggregates[getDirectionFromMix(stream.getRole())];
+    aggregate.devices.add(contribution.devices);
+    aggregate.flags.add(contribution.flagMask);
+    aggregate.useCases.add(contribution.useCaseMask);
+    aggregate.effects.add(contribution.effectMask);
+    mContributions[&stream] = contribution;
+}
+
+void Device::removeContributionUnsafe(const Stream &stream)
+{
+    StreamContributionCollection::iterator it = mContributions.find(&stream);
+    if (it == mContributions.end()) {
+        return;
+    }
+    const StreamContribution &contribution = it->second;
+    RoutingAggregate &aggregate = mAggregates[getDirectionFromMix(stream.getRole())];
+    aggregate.devices.remove(contribution.devices);
+    aggregate.flags.remove(contribution.flagMask);
+    aggregate.useCases.remove(contribution.useCaseMask);
+    aggregate.effects.remove(contribution.effectMask);
+    mContributions.erase(it);
+}
+
+void Device::updateInternalDevicesUnsafe(const Patch &patch, bool isAdded)
+{
+    if (!patch.hasDevice(AUDIO_PORT_ROLE_SOURCE) || !patch.hasDevice(AUDIO_PORT_ROLE_SINK)) {
+        // This patch is not connecting 2 device ports to one another.
+        return;
+    }
+    // Sink devices are output devices, source devices are input devices.
+    audio_devices_t outputDevices = patch.getDevices(AUDIO_PORT_ROLE_SINK);
+    audio_devices_t inputDevices = patch.getDevices(AUDIO_PORT_ROLE_SOURCE);
+    if (isAdded) {
+        mAggregates[Direction::Output].internalDevices.add(outputDevices);
+        mAggregates[Direction::Input].internalDevices.add(inputDevices);
+    } else {
+        mAggregates[Direction::Output].internalDevices.remove(outputDevices);
+        mAggregates[Direction::Input].internalDevices.remove(inputDevices);
+    }
+}
+
+void Device::getPatchStreamsUnsafe(const Patch &patch, std::vector<Stream *> &streams)
+{
+    static const audio_port_role_t roles[] = {
+        AUDIO_PORT_ROLE_SOURCE, AUDIO_PORT_ROLE_SINK
+    };
+    for (size_t i = 0; i < sizeof(roles) / sizeof(roles[0]); i++) {
+        const Port *mixPort = patch.getMixPort(roles[i]);
+        Stream *stream = NULL;
+        if (mixPort != NULL && getStream(mixPort->getMixIoHandle(), stream)) {
+            streams.push_back(stream);
+        }
+    }
+}
+
+void Device::erasePatchUnsafe(audio_patch_handle_t patchHandle)
+{
+    PatchCollection::iterator it = mPatches.find(patchHandle);
+    if (it == mPatches.end()) {
+        return;
+    }
+    updateInternalDevicesUnsafe(it->second, false);
+    mPatches.erase(it);
+}
+
+bool Device::isAppliedUnsafe(Direction::Values direction,
+                             const RoutingParameters &parameters) const
+{
+    return parameters.isApplied(direction, mAppliedParameters);
+}
+
+void Device::setAppliedUnsafe(const RoutingParameters &parameters)
+{
+    mAppliedParameters.setApplied(parameters);
+}
+
 CAudioBand::Type Device::getBandFromActiveInput() const
 {
     const Stream *activeInput = NULL;
@@ -15,13 +15,13 @@
  */
 #pragma once
 
+#include "MaskAggregator.hpp"
 #include "Patch.hpp"
 #include "Port.hpp"
 #include <IStreamInterface.hpp>
 #include <KeyValuePairs.hpp>
 #include <Direction.hpp>
 #include <audio_effects/effect_aec.h>
-#include <audio_utils/echo_reference.h>
 #include <hardware/audio_effect.h>
 #include <hardware/hardware.h>
 #include <DeviceInterface.hpp>
@@ -31,14 +31,17 @@
 #include <NonCopyable.hpp>
 #include <Mutex.hpp>
 #include <AudioCommsAssert.hpp>
+#include <atomic>
+#include <limits>
+#include <ostream>
 #include <string>
-
-struct echo_reference_itfe;
+#include <vector>
 
 namespace intel_audio
 {
 
 class CAudioConversion;
+class EchoReference;
 class CompressedStreamOut;
 class StreamOut;
 class StreamIn;
@@ -47,12 +50,40 @@ class AudioPlatformState;
 
 class Device : public DeviceInterface,
                public PatchInterface,
+               private IRoutingTimerListener,
                private audio_comms::utilities::NonCopyable
 {
 private:
     typedef std::map<audio_io_handle_t, Stream *> StreamCollection;
     typedef std::map<audio_patch_handle_t, Patch> PatchCollection;
     typedef std::map<audio_port_handle_t, Port> PortCollection;
+    /** Echo path delays, indexed by input and output devices. */
+    typedef std::pair<audio_devices_t, audio_devices_t> EchoPath;
+    typedef std::map<EchoPath, nsecs_t> EchoPathDelayCollection;
+
+    /** Masks contributed by a started stream to the routing parameters of its direction. */
+    struct StreamContribution
+    {
+        StreamContribution()
+            : devices(AUDIO_DEVICE_NONE), flagMask(0), useCaseMask(0), effectMask(0)
+        {}
+
+        audio_devices_t devices;
+        uint32_t flagMask;
+        uint32_t useCaseMask;
+        uint32_t effectMask;
+    };
+    typedef std::map<const Stream *, StreamContribution> StreamContributionCollection;
+
+    /** Union of the contributions to the routing parameters of a direction. */
+    struct RoutingAggregate
+    {
+        MaskAggregator devices; /**< Of the streams. */
+        MaskAggregator internalDevices; /**< Of the patches connecting devices to one another. */
+        MaskAggregator flags;
+        MaskAggregator useCases;
+        MaskAggregator effects;
+    };
 
 public:
     Device();
@@ -102,8 +133,10 @@ public:
     virtual android::status_t setParameters(const std::string &keyValuePairs);
     virtual std::string getParameters(const std::string &keys) const;
     virtual size_t getInputBufferSize(const audio_config_t &config) const;
-    /** @note API not implemented in our Audio HAL */
-    virtual android::status_t dump(const int /* fd */) const { return android::OK; }
+    /**
+     * Dumps the state of the device and of all its streams, for dumpsys media.audio_flinger.
+     */
+    virtual android::status_t dump(const int fd) const;
     /** @note Routing Control API used for routing with AUDIO_DEVICE_API_VERSION >= 3.0. */
     virtual android::status_t createAudioPatch(size_t sourcesCount,
                                                const struct audio_port_config sources[],
@@ -122,26 +155,26 @@ protected:
      * Update the streams parameters upon start / stop / change of devices events on streams.
      * in a synchronous manner.
      *
-     * @param[in] streamMixPortRole role of the stream (acting as a mix port).
+     * @param[in] stream whose state has changed.
      *
      * @return OK if successfully updated streams parameters, error code otherwise.
      */
-    android::status_t updateStreamsParametersSync(audio_port_role_t streamPortRole)
+    android::status_t updateStreamsParametersSync(const Stream &stream)
     {
-        return updateStreamsParameters(streamPortRole, true);
+        return updateStreamsParameters(stream, true);
     }
 
     /**
      * Update the streams parameters upon start / stop / change of devices events on streams.
      * in an asynchronous manner.
      *
-     * @param[in] streamMixPortRole role of the stream (acting as a mix port).
+     * @param[in] stream whose state has changed.
      *
      * @return OK if successfully updated streams parameters, error code otherwise.
      */
-    android::status_t updateStreamsParametersAsync(audio_port_role_t streamPortRole)
+    android::status_t updateStreamsParametersAsync(const Stream &stream)
     {
-        return updateStreamsParameters(streamPortRole, false);
+        return updateStreamsParameters(stream, false);
     }
 
     /**
@@ -171,27 +204,20 @@ protected:
 private:
     /**
      * Update the streams parameters upon start / stop / change of devices events on streams.
-     * This function parses all streams and concatenate their mask into a bit field.
+     * This function updates the contribution of the stream to the masks aggregated over the
+     * streams, and applies them if changed.
      * For input streams:
      * It not only updates the requested preproc criterion but also the band type.
      * Only one input stream may be active at one time by design of android audio policy.
      * Find this active stream with valid device and set the parameters
      * according to what was requested from this input.
      *
-     * @param[in] isOut direction of stream from which the events is issued.
+     * @param[in] stream from which the events is issued.
      * @param[in] isSynchronous: need to update the settings in a synchronous way or not.
      *
      * @return OK if successfully updated streams parameters, error code otherwise.
      */
-    android::status_t updateStreamsParameters(audio_port_role_t streamPortRole, bool isSynchronous)
-    {
-        // If a stream is a sink mix port: we need to update source devices.
-        // If a stream is a source mix port: we need to update parameters related to sink devices.
-        return updateParameters(streamPortRole == AUDIO_PORT_ROLE_SINK,
-                                streamPortRole == AUDIO_PORT_ROLE_SOURCE,
-                                AUDIO_PATCH_HANDLE_NONE,
-                                isSynchronous);
-    }
+    android::status_t updateStreamsParameters(const Stream &stream, bool isSynchronous);
 
     inline audio_port_role_t getOppositeRole(audio_port_role_t role) const
     {
@@ -226,14 +252,107 @@ private:
                                        bool isSynchronous = false);
 
     /**
-     * Prepare the streams parameters to be sent to the parameter framework for routing.
+     * Prepare the streams parameters to be sent to the parameter framework for routing, from the
+     * masks aggregated over the streams. Left unset if already applied.
      *
      * @param[in] streamPortRole direction of stream from which the events is issued.
-     * @param[out] pairs: parameters as collection of {key,value} pairs.
+     * @param[out] parameters: routing parameters, set for the direction of the streams.
+     * @param[in] handle of the patch just created, whose devices are forced for output streams.
      */
-    void prepareStreamsParameters(audio_port_role_t streamPortRole, KeyValuePairs &pairs,
+    void prepareStreamsParameters(audio_port_role_t streamPortRole,
+                                  RoutingParameters &parameters,
                                   audio_patch_handle_t handle = AUDIO_PATCH_HANDLE_NONE);
 
+    /**
+     * Computes the masks a stream contributes to the routing parameters of its direction, i.e.
+     * none unless started, routed by the policy and connected to devices by a patch.
+     *
+     * @param[in] stream to consider.
+     *
+     * @return contribution of the stream.
+     */
+    StreamContribution getContributionUnsafe(const Stream &stream) const;
+
+    /**
+     * Replaces the contribution of a stream to the aggregated routing parameters by its current
+     * one. To be called with patch collection lock held each time the state of the stream,
+     * or the patch it is attached to, has changed.
+     *
+     * @param[in] stream to consider.
+     */
+    void updateContributionUnsafe(const Stream &stream);
+
+    /**
+     * Removes the contribution of a stream to the aggregated routing parameters, before closing
+     * it. To be called with patch collection lock held.
+     *
+     * @param[in] stream to consider.
+     */
+    void removeContributionUnsafe(const Stream &stream);
+
+    /**
+     * Adds or removes the devices connected to one another by a patch to the internal devices of
+     * the aggregated routing parameters. To be called with patch collection lock held.
+     *
+     * @param[in] patch to consider.
+     * @param[in] isAdded true if the patch is added, false if removed.
+     */
+    void updateInternalDevicesUnsafe(const Patch &patch, bool isAdded);
+
+    /**
+     * Gets the streams attached to a patch as mix ports.
+     *
+     * @param[in] patch to consider.
+     * @param[out] streams attached, appended.
+     */
+    void getPatchStreamsUnsafe(const Patch &patch, std::vector<Stream *> &streams);
+
+    /**
+     * Removes a patch from the collection along with its internal devices, the contribution of
+     * the streams attached to it being to be updated by the caller.
+     * To be called with patch collection lock held.
+     *
+     * @param[in] patchHandle of the patch to remove.
+     */
+    void erasePatchUnsafe(audio_patch_handle_t patchHandle);
+
+    /**
+     * Checks whether routing parameters of a direction were already applied.
+     * To be called with patch collection lock held.
+     *
+     * @param[in] direction of the routing parameters.
+     * @param[in] parameters to check, only the ones of the direction are considered.
+     *
+     * @return true if already applied, false otherwise.
+     */
+    bool isAppliedUnsafe(Direction::Values direction, const RoutingParameters &parameters) const;
+
+    /**
+     * Records routing parameters as applied, for the directions set, once successfully applied
+     * by the route manager. To be called with patch collection lock held.
+     *
+     * @param[in] parameters applied.
+     */
+    void setAppliedUnsafe(const RoutingParameters &parameters);
+
+    /**
+     * Appends a patch, i.e. its devices and the configuration of its mix port, to a debug
+     * snapshot. To be called with patch collection lock held.
+     *
+     * @param[in] patch to dump.
+     * @param[in,out] state snapshot to append to.
+     */
+    void dumpPatchUnsafe(const Patch &patch, std::ostream &state) const;
+
+    /**
+     * Appends the aggregated and the last applied routing parameters of a direction to a debug
+     * snapshot. To be called with patch collection lock held.
+     *
+     * @param[in] direction of the routing parameters.
+     * @param[in,out] state snapshot to append to.
+     */
+    void dumpRoutingParametersUnsafe(Direction::Values direction, std::ostream &state) const;
+
     /**
      * Selects the output devices from streams devices and internal devices. It also take into
      * account the specific role of the primary output and the compress (as not handled by
@@ -353,7 +472,7 @@ private:
      *
      * @param[in] reference: echo reference to reset.
      */
-    void resetEchoReference(struct echo_reference_itfe *reference);
+    void resetEchoReference(EchoReference *reference);
 
     /**
      * Get the echo reference for AEC effect.
@@ -361,12 +480,85 @@ private:
      * Audio HAL needs to provide the echo reference (output stream) to the input stream.
      *
      * @param[in] inputSampleSpec: input stream sample specification.
+     * @param[in] inputDevices: input stream devices, to delay the reference by the echo path
+     *                          delay calibrated for these devices and the voice output devices.
      *
      * @return valid echo reference is found, NULL otherwise.
      */
-    struct echo_reference_itfe *getEchoReference(const SampleSpec &inputSampleSpec);
+    EchoReference *getEchoReference(const SampleSpec &inputSampleSpec,
+                                    audio_devices_t inputDevices);
+
+    /**
+     * Publishes the echo path delay calibrated during a call, stored upon reset of the echo
+     * reference and applied to the echo references of the next calls on the same devices.
+     * Called by an input stream on which SW echo cancellation is performed, from its capture
+     * thread: lock-free.
+     *
+     * @param[in] reference: echo reference of the call.
+     * @param[in] delay: echo path delay of the reference, in nanoseconds.
+     */
+    void setEchoPathDelay(const EchoReference &reference, nsecs_t delay);
+
+    /**
+     * Creates the loopback of the frames played by the primary output, read by an input stream
+     * opened on the loopback device. A single loopback is supported at a time.
+     *
+     * @param[in] in input stream reading the loopback.
+     *
+     * @return OK if successful, error code otherwise.
+     */
+    android::status_t openLoopback(StreamIn &in);
+
+    /**
+     * Detaches the loopback from the primary output and deletes it.
+     */
+    void closeLoopback();
+
+    /**
+     * Starts the hotword pre-roll if enabled by property: an internal hotword input stream keeps
+     * its route and the latest captured frames, served to the next hotword stream opened.
+     * Called once the Route Manager service is started.
+     */
+    void startHotwordPreroll();
 
-    struct echo_reference_itfe *mEchoReference; /**< Echo reference to use for AEC effect. */
+    /**
+     * Stops the hotword pre-roll if started.
+     */
+    void stopHotwordPreroll();
+
+    /**
+     * Takes the routing update deferred upon patch release, if any.
+     *
+     * @param[out] updateSourceDevice set if source devices were involved in the released patches.
+     * @param[out] updateSinkDevice set if sink devices were involved in the released patches.
+     *
+     * @return true if an update was deferred, false otherwise.
+     */
+    bool takeDeferredPatchUpdate(bool &updateSourceDevice, bool &updateSinkDevice);
+
+    /**
+     * Applies the routing update deferred upon patch release, unless a patch was created since.
+     * From IRoutingTimerListener, called from the routing thread.
+     */
+    virtual void onRoutingTimer();
+
+    /**
+     * Echo reference to use for AEC effect.
+     * Set from the effect configuration, read from the capture thread upon calibration.
+     */
+    std::atomic<EchoReference *> mEchoReference;
+    EchoPath mEchoPath; /**< Devices of the echo reference. */
+    EchoPathDelayCollection mEchoPathDelays; /**< Calibrated during the previous calls. */
+    audio_comms::utilities::Mutex mEchoPathLock; /**< Protects the echo path delays. */
+
+    /**
+     * Calibrated for the current echo reference, mUncalibratedEchoPathDelay if none yet.
+     * A calibrated delay may be negative, if the reference is late.
+     */
+    std::atomic<nsecs_t> mCalibratedEchoPathDelay;
+
+    /** Out of the range of calibrated delays. */
+    static const nsecs_t mUncalibratedEchoPathDelay = std::numeric_limits<nsecs_t>::min();
 
     IStreamInterface *mStreamInterface; /**< Route Manager Stream Interface pointer. */
 
@@ -375,13 +567,42 @@ private:
     StreamCollection mStreams; /**< Collection of opened streams. */
     PatchCollection mPatches; /**< Collection of connected patches. */
     PortCollection mPorts; /**< Collection of audio ports. */
+
+    /** Contributions of the streams to the routing parameters, updated incrementally. */
+    StreamContributionCollection mContributions;
+    RoutingAggregate mAggregates[Direction::gNbDirections]; /**< Indexed by Direction::Values. */
+    RoutingParameters mAppliedParameters; /**< Last routing parameters applied per direction. */
+
+    /**
+     * Source / sink devices involved in the patches released within the coalescing delay, whose
+     * routing update is deferred so that a patch created meanwhile, as upon device switch, is
+     * applied along in a single routing update.
+     */
+    bool mIsSourceUpdateDeferred;
+    bool mIsSinkUpdateDeferred;
     Stream *mPrimaryOutput; /**< Primary output stream, which has a leading routing role. */
 
+    EchoReference *mLoopback; /**< Loopback of the primary output, if opened. */
+    StreamIn *mLoopbackInput; /**< Input stream reading the loopback. */
+
+    StreamIn *mHotwordPreroll; /**< Internal stream pre-rolling the hotword capture, if enabled. */
+    StreamIn *mHotwordPrerollClient; /**< Hotword stream served by the pre-roll, if opened. */
+
     static const char *const mDefaultGainPropName; /**< Gain property name. */
     static const float mDefaultGainValue; /**< Default gain value if empty property. */
 
+    /** Input buffer duration if no route matches the requested configuration. */
     static const uint32_t mRecordingBufferTimeUsec = 20000;
 
+    /** Duration of the hotword pre-roll in milliseconds, 0 (default) to disable it. */
+    static const std::string mHotwordPrerollProp;
+    /** Sample rate of the hotword pre-roll, 16 bits mono. */
+    static const uint32_t mHotwordPrerollSampleRate = 16000;
+
+    /** Delay to coalesce a patch release with the next patch creation, 0 to disable it. */
+    static const std::string mPatchCoalescingProp;
+    static const uint32_t mDefaultPatchCoalescingMs = 20; /**< If no property set. */
+
     /**
      * Stream Rate associated with narrow band in case of VoIP.
      */
@@ -390,8 +611,18 @@ private:
     /**
      * Protect concurrent access to routing control API to protect concurrent access to
      * patches collection.
+     * Also guards the stream collection and the mode, written by the stream open / close and mode
+     * requests, so that they can be read consistently from routing control and dump.
+     * Taken after the routing timer lock of the route manager, so never held while arming or
+     * disarming a routing timer.
      */
     mutable audio_comms::utilities::Mutex mPatchCollectionLock;
+
+    /**
+     * Held while dumping the streams and deleting a closed stream, so that the streams are dumped
+     * without the patch collection lock. Taken before the patch collection lock.
+     */
+    mutable audio_comms::utilities::Mutex mStreamDumpLock;
 };
 
 } // namespace intel_audio
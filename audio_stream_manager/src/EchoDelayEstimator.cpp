@@ -0,0 +1,191 @@
+/*
+ * Copyright (C) 2015 Intel Corporation
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#define LOG_TAG "AudioEchoDelayEstimator"
+
+#include "EchoDelayEstimator.hpp"
+#include <utilities/Log.hpp>
+#include <algorithm>
+#include <math.h>
+#include <stdlib.h>
+
+using audio_comms::utilities::Log;
+
+namespace intel_audio
+{
+
+const float EchoDelayEstimator::mMinCorrelation = 0.6f;
+const float EchoDelayEstimator::mMinReferenceLevel = 100.0f;
+
+EchoDelayEstimator::EchoDelayEstimator()
+    : mFramesPerBlock(0),
+      mChannelCount(0),
+      mNextEstimateBlock(0),
+      mCandidateLag(0),
+      mStableCount(0),
+      mConvergedLag(0),
+      mIsConverged(false),
+      mIsReported(false)
+{
+}
+
+void EchoDelayEstimator::reset(const SampleSpec &sampleSpec)
+{
+    mFramesPerBlock = std::max<size_t>(sampleSpec.convertUsecToframes(mBlockDurationMs * 1000), 1);
+    mChannelCount = sampleSpec.getChannelCount();
+    reset(mReference);
+    reset(mCapture);
+    mNextEstimateBlock = mReference.mBlocks.size();
+    mCandidateLag = 0;
+    mStableCount = 0;
+    mConvergedLag = 0;
+    mIsConverged = false;
+    mIsReported = false;
+}
+
+void EchoDelayEstimator::reset(Envelope &envelope)
+{
+    // Lead twice: once for the lag range, once for the envelopes to be pushed out of step.
+    envelope.mBlocks.assign((2 * mMaxLeadMs + mWindowMs + mMaxLagMs) / mBlockDurationMs, 0.0f);
+    envelope.mBlockCount = 0;
+    envelope.mBlockSum = 0.0f;
+    envelope.mBlockFrames = 0;
+}
+
+void EchoDelayEstimator::push(Envelope &envelope, const int16_t *buffer, size_t frames)
+{
+    if (mFramesPerBlock == 0) {
+        // Not reset yet
+        return;
+    }
+    // First channel only, the echo is expected on all of them.
+    for (size_t frame = 0; frame < frames; frame++) {
+        envelope.mBlockSum += abs(buffer[frame * mChannelCount]);
+        if (++envelope.mBlockFrames == mFramesPerBlock) {
+            envelope.mBlocks[envelope.mBlockCount % envelope.mBlocks.size()] =
+                envelope.mBlockSum / mFramesPerBlock;
+            envelope.mBlockCount++;
+            envelope.mBlockSum = 0.0f;
+            envelope.mBlockFrames = 0;
+        }
+    }
+}
+
+void EchoDelayEstimator::pushReference(const int16_t *buffer, size_t frames)
+{
+    push(mReference, buffer, frames);
+}
+
+void EchoDelayEstimator::pushCapture(const int16_t *buffer, size_t frames)
+{
+    push(mCapture, buffer, frames);
+    if (mCapture.mBlockCount >= mNextEstimateBlock &&
+        mReference.mBlockCount >= mNextEstimateBlock) {
+        estimate();
+        mNextEstimateBlock = std::min(mCapture.mBlockCount, mReference.mBlockCount) +
+                             mWindowMs / mBlockDurationMs;
+    }
+}
+
+void EchoDelayEstimator::estimate()
+{
+    const int32_t windowBlocks = mWindowMs / mBlockDurationMs;
+    const int32_t leadBlocks = mMaxLeadMs / mBlockDurationMs;
+    const int32_t lagBlocks = mMaxLagMs / mBlockDurationMs;
+    // Both envelopes are indexed on the same time base, the end of the shortest one.
+    uint64_t end = std::min(mCapture.mBlockCount, mReference.mBlockCount);
+    if (std::max(mCapture.mBlockCount, mReference.mBlockCount) - end >
+        static_cast<uint64_t>(leadBlocks)) {
+        // Out of step, the oldest blocks needed are overwritten already.
+        return;
+    }
+    uint64_t first = end - leadBlocks - windowBlocks;
+
+    float captureMean = 0.0f;
+    float referenceLevel = 0.0f;
+    for (uint64_t block = first; block < first + windowBlocks; block++) {
+        captureMean += mCapture.at(block);
+        referenceLevel += mReference.at(block);
+    }
+    captureMean /= windowBlocks;
+    referenceLevel /= windowBlocks;
+    if (referenceLevel < mMinReferenceLevel) {
+        // Far end silent, no echo to correlate with.
+        return;
+    }
+    float captureVariance = 0.0f;
+    for (uint64_t block = first; block < first + windowBlocks; block++) {
+        float capture = mCapture.at(block) - captureMean;
+        captureVariance += capture * capture;
+    }
+    if (captureVariance <= 0.0f) {
+        return;
+    }
+
+    float bestCorrelation = 0.0f;
+    int32_t bestLag = 0;
+    for (int32_t lag = -leadBlocks; lag <= lagBlocks; lag++) {
+        float referenceMean = 0.0f;
+        for (uint64_t block = first; block < first + windowBlocks; block++) {
+            referenceMean += mReference.at(block - lag);
+        }
+        referenceMean /= windowBlocks;
+        float covariance = 0.0f;
+        float referenceVariance = 0.0f;
+        for (uint64_t block = first; block < first + windowBlocks; block++) {
+            float reference = mReference.at(block - lag) - referenceMean;
+            covariance += (mCapture.at(block) - captureMean) * reference;
+            referenceVariance += reference * reference;
+        }
+        if (referenceVariance <= 0.0f) {
+            continue;
+        }
+        float correlation = covariance / sqrtf(captureVariance * referenceVariance);
+        if (correlation > bestCorrelation) {
+            bestCorrelation = correlation;
+            bestLag = lag;
+        }
+    }
+    if (bestCorrelation < mMinCorrelation) {
+        // Double talk or no echo, the window is not trusted.
+        return;
+    }
+    if (abs(bestLag - mCandidateLag) <= 1 && mStableCount != 0) {
+        mStableCount++;
+    } else {
+        mCandidateLag = bestLag;
+        mStableCount = 1;
+    }
+    if (mStableCount >= mConvergenceCount && (!mIsConverged || mConvergedLag != mCandidateLag)) {
+        Log::Debug() << __FUNCTION__ << ": converged on " << mCandidateLag * mBlockDurationMs
+                     << " ms (correlation " << bestCorrelation << ")";
+        mConvergedLag = mCandidateLag;
+        mIsConverged = true;
+        mIsReported = false;
+    }
+}
+
+bool EchoDelayEstimator::getConvergedDelay(nsecs_t &delay)
+{
+    if (!mIsConverged || mIsReported) {
+        return false;
+    }
+    delay = ms2ns(static_cast<nsecs_t>(mConvergedLag) * mBlockDurationMs);
+    mIsReported = true;
+    return true;
+}
+
+} // namespace intel_audio
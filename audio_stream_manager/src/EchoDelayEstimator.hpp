@@ -0,0 +1,113 @@
+/*
+ * Copyright (C) 2015 Intel Corporation
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#pragma once
+
+#include <SampleSpec.hpp>
+#include <NonCopyable.hpp>
+#include <utils/Timers.h>
+#include <vector>
+#include <stdint.h>
+
+namespace intel_audio
+{
+
+/**
+ * Estimates the delay of the echo in the captured frames relative to the echo reference provided
+ * to the AEC, i.e. the codec, DSP and acoustic delays not accounted by the timestamps of the
+ * reference.
+ * Both signals are reduced to their envelope, one value per millisecond, and cross-correlated on
+ * a sliding window. The delay converges once the correlation peak is found at the same lag on
+ * consecutive windows while the far end is active.
+ * Called from the capture thread only.
+ */
+class EchoDelayEstimator : private audio_comms::utilities::NonCopyable
+{
+public:
+    EchoDelayEstimator();
+
+    /**
+     * Restarts the estimation, dropping the frames pushed so far.
+     *
+     * @param[in] sampleSpec of the frames pushed, 16 bits.
+     */
+    void reset(const SampleSpec &sampleSpec);
+
+    /**
+     * @param[in] buffer reference frames provided to the AEC.
+     * @param[in] frames number of frames.
+     */
+    void pushReference(const int16_t *buffer, size_t frames);
+
+    /**
+     * @param[in] buffer captured frames processed by the AEC.
+     * @param[in] frames number of frames.
+     */
+    void pushCapture(const int16_t *buffer, size_t frames);
+
+    /**
+     * Reports a delay once converged, and again each time it converges to a new value.
+     *
+     * @param[out] delay of the echo in the captured frames relative to the reference, negative if
+     *                   the reference is late, in nanoseconds.
+     *
+     * @return true if a new delay converged since the last call, false otherwise.
+     */
+    bool getConvergedDelay(nsecs_t &delay);
+
+private:
+    /** Envelope of a signal, one value per block, stored in a ring of the history size. */
+    struct Envelope
+    {
+        std::vector<float> mBlocks;
+        uint64_t mBlockCount; /**< Blocks completed since reset. */
+        float mBlockSum; /**< Of the block being completed. */
+        size_t mBlockFrames; /**< Of the block being completed. */
+
+        float at(uint64_t block) const { return mBlocks[block % mBlocks.size()]; }
+    };
+
+    void reset(Envelope &envelope);
+
+    void push(Envelope &envelope, const int16_t *buffer, size_t frames);
+
+    /**
+     * Cross-correlates the last window of the capture with the reference at each lag, and updates
+     * the convergence with the lag of the correlation peak if the far end is active.
+     */
+    void estimate();
+
+    Envelope mReference;
+    Envelope mCapture;
+    size_t mFramesPerBlock;
+    uint32_t mChannelCount;
+    uint64_t mNextEstimateBlock; /**< Capture block at which the next window is complete. */
+
+    int32_t mCandidateLag; /**< Lag of the last correlation peak, in blocks. */
+    uint32_t mStableCount; /**< Consecutive windows peaking at the candidate lag. */
+    int32_t mConvergedLag; /**< In blocks, valid if mIsConverged. */
+    bool mIsConverged;
+    bool mIsReported; /**< Converged lag reported by getConvergedDelay. */
+
+    static const int32_t mBlockDurationMs = 1;
+    static const int32_t mMaxLagMs = 200; /**< Echo later than the reference. */
+    static const int32_t mMaxLeadMs = 20; /**< Echo earlier than the reference. */
+    static const uint32_t mWindowMs = 500; /**< Correlated on each estimate. */
+    static const float mMinCorrelation; /**< Normalized, below the peak is not trusted. */
+    static const float mMinReferenceLevel; /**< Mean envelope, below the far end is silent. */
+    static const uint32_t mConvergenceCount = 3; /**< Consecutive windows at the same lag. */
+};
+
+} // namespace intel_audio
@@ -0,0 +1,227 @@
+/*
+ * Copyright (C) 2015 Intel Corporation
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#define LOG_TAG "AudioEchoReference"
+
+#include "EchoReference.hpp"
+#include <utilities/Log.hpp>
+#include <algorithm>
+#include <string.h>
+
+using android::status_t;
+using audio_comms::utilities::Log;
+using std::memory_order_relaxed;
+using std::memory_order_acquire;
+using std::memory_order_release;
+
+namespace intel_audio
+{
+
+static const nsecs_t gNsecPerSec = 1000000000LL;
+
+static nsecs_t framesToNs(int64_t frames, uint32_t sampleRate)
+{
+    return frames * gNsecPerSec / sampleRate;
+}
+
+static uint64_t nsToFrames(nsecs_t duration, uint32_t sampleRate)
+{
+    return duration * sampleRate / gNsecPerSec;
+}
+
+EchoReference::EchoReference(const SampleSpec &inputSampleSpec,
+                             const SampleSpec &outputSampleSpec)
+    : mInputSampleSpec(inputSampleSpec),
+      mOutputSampleSpec(outputSampleSpec),
+      mRingSizeInFrames(0),
+      mSilenceSizeInFrames(0),
+      mWriteFrames(0),
+      mReadFrames(0),
+      mAnchorSequence(0),
+      mAnchorFrames(0),
+      mAnchorTime(0),
+      mSilenceFramesPending(0),
+      mPathDelay(0)
+{
+}
+
+status_t EchoReference::init()
+{
+    mRingSizeInFrames = mOutputSampleSpec.convertUsecToframes(mRingDurationMs * 1000);
+    mRing.resize(mOutputSampleSpec.convertFramesToBytes(mRingSizeInFrames));
+    mSilenceSizeInFrames = mOutputSampleSpec.convertUsecToframes(mSilenceDurationMs * 1000);
+    mSilence.assign(mOutputSampleSpec.convertFramesToBytes(mSilenceSizeInFrames), 0);
+    if (mRingSizeInFrames == 0 || mSilenceSizeInFrames == 0) {
+        Log::Error() << __FUNCTION__ << ": invalid output sample specification";
+        return android::BAD_VALUE;
+    }
+    if (mInputSampleSpec == mOutputSampleSpec) {
+        return android::OK;
+    }
+    status_t status = mAudioConversion.configure(mOutputSampleSpec, mInputSampleSpec);
+    if (status != android::OK) {
+        Log::Error() << __FUNCTION__ << ": could not configure conversion (err=" << status << ")";
+        return status;
+    }
+    // Not to allocate from the capture thread, a read shall not exceed the ring.
+    return mAudioConversion.reserve(mInputSampleSpec.convertUsecToframes(mRingDurationMs * 1000));
+}
+
+void EchoReference::write(const void *buffer, size_t frames, nsecs_t renderTime)
+{
+    uint64_t writeFrames = mWriteFrames.load(memory_order_relaxed);
+    size_t filledFrames = writeFrames - mReadFrames.load(memory_order_acquire);
+    size_t writtenFrames = std::min(frames, mRingSizeInFrames - filledFrames);
+
+    const char *src = static_cast<const char *>(buffer);
+    size_t offset = writeFrames % mRingSizeInFrames;
+    size_t firstChunk = std::min(writtenFrames, mRingSizeInFrames - offset);
+    memcpy(&mRing[mOutputSampleSpec.convertFramesToBytes(offset)], src,
+           mOutputSampleSpec.convertFramesToBytes(firstChunk));
+    memcpy(&mRing[0], src + mOutputSampleSpec.convertFramesToBytes(firstChunk),
+           mOutputSampleSpec.convertFramesToBytes(writtenFrames - firstChunk));
+    writeFrames += writtenFrames;
+    mWriteFrames.store(writeFrames, memory_order_release);
+
+    // Publish the render time of the write position
+    uint32_t sequence = mAnchorSequence.load(memory_order_relaxed);
+    mAnchorSequence.store(sequence + 1, memory_order_relaxed);
+    std::atomic_thread_fence(memory_order_release);
+    mAnchorFrames.store(writeFrames, memory_order_relaxed);
+    mAnchorTime.store(renderTime + framesToNs(writtenFrames, mOutputSampleSpec.getSampleRate()),
+                      memory_order_relaxed);
+    mAnchorSequence.store(sequence + 2, memory_order_release);
+}
+
+void EchoReference::getWriteAnchor(uint64_t &frames, nsecs_t &time) const
+{
+    uint32_t sequence;
+    do {
+        sequence = mAnchorSequence.load(memory_order_acquire);
+        frames = mAnchorFrames.load(memory_order_relaxed);
+        time = mAnchorTime.load(memory_order_relaxed);
+        std::atomic_thread_fence(memory_order_acquire);
+    } while ((sequence & 1) || sequence != mAnchorSequence.load(memory_order_relaxed));
+}
+
+void EchoReference::alignReadPosition(nsecs_t captureTime)
+{
+    mSilenceFramesPending = 0;
+
+    uint64_t anchorFrames;
+    nsecs_t anchorTime;
+    getWriteAnchor(anchorFrames, anchorTime);
+    if (anchorTime == 0) {
+        // Nothing pushed yet
+        return;
+    }
+    uint32_t sampleRate = mOutputSampleSpec.getSampleRate();
+    uint64_t readFrames = mReadFrames.load(memory_order_relaxed);
+    nsecs_t renderTime = anchorTime -
+                         framesToNs(static_cast<int64_t>(anchorFrames - readFrames), sampleRate);
+    nsecs_t delay = captureTime - renderTime;
+
+    if (delay > ms2ns(mMaxDelayMs)) {
+        // Consumer late, drop the frames rendered before the capture
+        uint64_t availableFrames = mWriteFrames.load(memory_order_acquire) - readFrames;
+        mReadFrames.store(readFrames + std::min(nsToFrames(delay, sampleRate), availableFrames),
+                          memory_order_release);
+    } else if (delay < 0) {
+        // Reference not rendered yet when captured
+        mSilenceFramesPending = std::min(nsToFrames(-delay, sampleRate),
+                                         static_cast<uint64_t>(mRingSizeInFrames));
+    }
+}
+
+status_t EchoReference::read(void *buffer, size_t frames, nsecs_t captureTime, nsecs_t &delay)
+{
+    // Frames rendered a path delay before the capture are the ones echoed in it.
+    captureTime -= mPathDelay;
+    alignReadPosition(captureTime);
+
+    // Render time of the first frame provided, once the silence inserted and the frames held by
+    // the conversion chain are accounted.
+    uint64_t anchorFrames;
+    nsecs_t anchorTime;
+    getWriteAnchor(anchorFrames, anchorTime);
+    uint32_t sampleRate = mOutputSampleSpec.getSampleRate();
+    int64_t framesBeforeAnchor = anchorFrames - mReadFrames.load(memory_order_relaxed) +
+                                 mSilenceFramesPending;
+    nsecs_t renderTime = anchorTime - framesToNs(framesBeforeAnchor, sampleRate);
+
+    if (mInputSampleSpec == mOutputSampleSpec) {
+        pullFrames(buffer, frames);
+    } else {
+        renderTime -= framesToNs(mAudioConversion.getDelayInFrames(),
+                                 mInputSampleSpec.getSampleRate());
+        status_t status = mAudioConversion.getConvertedBuffer(buffer, frames, this);
+        if (status != android::OK) {
+            return status;
+        }
+    }
+    delay = anchorTime == 0 ? 0 : captureTime - renderTime;
+    return android::OK;
+}
+
+void EchoReference::pullFrames(void *buffer, size_t frames)
+{
+    char *dst = static_cast<char *>(buffer);
+    while (frames != 0) {
+        android::AudioBufferProvider::Buffer ringBuffer;
+        ringBuffer.frameCount = frames;
+        getNextBuffer(&ringBuffer, 0);
+        size_t bytes = mOutputSampleSpec.convertFramesToBytes(ringBuffer.frameCount);
+        memcpy(dst, ringBuffer.raw, bytes);
+        dst += bytes;
+        frames -= ringBuffer.frameCount;
+        releaseBuffer(&ringBuffer);
+    }
+}
+
+status_t EchoReference::getNextBuffer(android::AudioBufferProvider::Buffer *buffer,
+                                      int64_t /*pts*/)
+{
+    if (mSilenceFramesPending != 0) {
+        buffer->frameCount = std::min(buffer->frameCount,
+                                      std::min(mSilenceFramesPending, mSilenceSizeInFrames));
+        buffer->raw = &mSilence[0];
+        return android::OK;
+    }
+    uint64_t readFrames = mReadFrames.load(memory_order_relaxed);
+    size_t availableFrames = mWriteFrames.load(memory_order_acquire) - readFrames;
+    if (availableFrames == 0) {
+        // Underflow, the next read realigns on the capture time.
+        buffer->frameCount = std::min(buffer->frameCount, mSilenceSizeInFrames);
+        buffer->raw = &mSilence[0];
+        return android::OK;
+    }
+    size_t offset = readFrames % mRingSizeInFrames;
+    buffer->frameCount = std::min(buffer->frameCount,
+                                  std::min(availableFrames, mRingSizeInFrames - offset));
+    buffer->raw = &mRing[mOutputSampleSpec.convertFramesToBytes(offset)];
+    return android::OK;
+}
+
+void EchoReference::releaseBuffer(android::AudioBufferProvider::Buffer *buffer)
+{
+    if (buffer->raw != &mSilence[0]) {
+        mReadFrames.fetch_add(buffer->frameCount, memory_order_release);
+    } else if (mSilenceFramesPending != 0) {
+        mSilenceFramesPending -= buffer->frameCount;
+    }
+}
+
+} // namespace intel_audio
@@ -0,0 +1,162 @@
+/*
+ * Copyright (C) 2015 Intel Corporation
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#pragma once
+
+#include <AudioConversion.hpp>
+#include <SampleSpec.hpp>
+#include <NonCopyable.hpp>
+#include <media/AudioBufferProvider.h>
+#include <utils/Errors.h>
+#include <utils/Timers.h>
+#include <atomic>
+#include <vector>
+#include <stdint.h>
+
+namespace intel_audio
+{
+
+/**
+ * Echo reference transferred from the playback thread (single producer) to the capture thread
+ * (single consumer) through a preallocated lock-free ring of timestamped frames. The two threads
+ * never contend with each other: each side only holds the effect lock of its own stream in read
+ * mode, taken in write mode to attach or detach the reference.
+ * Frames are stored in the sample specification of the output stream. The consumer converts them
+ * to the sample specification of the input stream, aligns them on the capture time, dropping stale
+ * frames and padding with silence on underflow.
+ * Also serves as loopback of the frames played to an input stream opened on the loopback device.
+ */
+class EchoReference
+    : private android::AudioBufferProvider,
+      private audio_comms::utilities::NonCopyable
+{
+public:
+    /**
+     * @param[in] inputSampleSpec sample specification of the frames read by the consumer.
+     * @param[in] outputSampleSpec sample specification of the frames written by the producer.
+     */
+    EchoReference(const SampleSpec &inputSampleSpec, const SampleSpec &outputSampleSpec);
+
+    /**
+     * Allocates the ring and the conversion chain. Must be called once before any read or write.
+     *
+     * @return OK if successful, error code otherwise.
+     */
+    android::status_t init();
+
+    /**
+     * Pushes frames played by the output stream. Overflowing frames are dropped, the consumer
+     * being too late anyway.
+     * Called from the playback thread only.
+     *
+     * @param[in] buffer frames in the output sample specification.
+     * @param[in] frames number of frames to push.
+     * @param[in] renderTime monotonic time at which the first frame will be rendered.
+     */
+    void write(const void *buffer, size_t frames, nsecs_t renderTime);
+
+    /**
+     * Pulls the reference of frames captured by the input stream.
+     * Called from the capture thread only.
+     *
+     * @param[out] buffer frames in the input sample specification.
+     * @param[in] frames number of frames requested, always filled.
+     * @param[in] captureTime monotonic time at which the first frame requested was captured.
+     * @param[out] delay between the render of the first reference frame and its capture, in
+     *                   nanoseconds.
+     *
+     * @return OK if successful, error code otherwise.
+     */
+    android::status_t read(void *buffer, size_t frames, nsecs_t captureTime, nsecs_t &delay);
+
+    /**
+     * Delays the reference by the echo path delay not accounted by the render time of the frames,
+     * i.e. codec, DSP and acoustic delays. Must be called before any read.
+     *
+     * @param[in] delay in nanoseconds, negative if the echo is captured before its render time.
+     */
+    void setPathDelay(nsecs_t delay) { mPathDelay = delay; }
+
+    nsecs_t getPathDelay() const { return mPathDelay; }
+
+private:
+    /**
+     * Provides the frames of the ring to the conversion chain, or silence on underflow.
+     * From AudioBufferProvider interface.
+     */
+    virtual android::status_t getNextBuffer(android::AudioBufferProvider::Buffer *buffer,
+                                            int64_t pts);
+
+    /**
+     * Consumes the frames of the ring provided on previous getNextBuffer call.
+     * From AudioBufferProvider interface.
+     */
+    virtual void releaseBuffer(android::AudioBufferProvider::Buffer *buffer);
+
+    /**
+     * Reads the last write position and the render time of its frame published by the producer.
+     *
+     * @param[out] frames write position.
+     * @param[out] time render time of the frame at write position.
+     */
+    void getWriteAnchor(uint64_t &frames, nsecs_t &time) const;
+
+    /**
+     * Aligns the read position on the capture time, dropping the frames rendered too long before
+     * the capture and requesting silence for the frames not rendered yet.
+     *
+     * @param[in] captureTime time at which the first frame requested was captured.
+     */
+    void alignReadPosition(nsecs_t captureTime);
+
+    /**
+     * Pulls frames from the ring without conversion, input and output sample specifications
+     * matching.
+     *
+     * @param[out] buffer frames in the input sample specification.
+     * @param[in] frames number of frames requested, always filled.
+     */
+    void pullFrames(void *buffer, size_t frames);
+
+    SampleSpec mInputSampleSpec;
+    SampleSpec mOutputSampleSpec;
+    AudioConversion mAudioConversion; /**< Output to input sample specification. */
+
+    std::vector<char> mRing; /**< Frames in the output sample specification. */
+    size_t mRingSizeInFrames;
+    std::vector<char> mSilence; /**< Provided on underflow. */
+    size_t mSilenceSizeInFrames;
+
+    std::atomic<uint64_t> mWriteFrames; /**< Frames pushed since creation, producer owned. */
+    std::atomic<uint64_t> mReadFrames; /**< Frames pulled since creation, consumer owned. */
+
+    /**
+     * Render time of the frame at the write position, published with a sequence counter (odd
+     * while updated) so that the consumer reads a consistent couple without lock.
+     */
+    std::atomic<uint32_t> mAnchorSequence;
+    std::atomic<uint64_t> mAnchorFrames;
+    std::atomic<nsecs_t> mAnchorTime;
+
+    size_t mSilenceFramesPending; /**< Silence to insert before the ring frames, consumer owned. */
+
+    nsecs_t mPathDelay; /**< Echo path delay, see setPathDelay. */
+
+    static const uint32_t mRingDurationMs = 500; /**< Capacity of the ring. */
+    static const uint32_t mMaxDelayMs = 200; /**< Above, reference frames are dropped. */
+    static const uint32_t mSilenceDurationMs = 20; /**< Granularity of silence on underflow. */
+};
+
+} // namespace intel_audio
@@ -0,0 +1,57 @@
+/*
+ * Copyright (C) 2015 Intel Corporation
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "MaskAggregator.hpp"
+#include <AudioCommsAssert.hpp>
+#include <string.h>
+
+namespace intel_audio
+{
+
+MaskAggregator::MaskAggregator()
+    : mMask(0)
+{
+    memset(mRefCounts, 0, sizeof(mRefCounts));
+}
+
+bool MaskAggregator::add(uint32_t mask)
+{
+    uint32_t previousMask = mMask;
+    while (mask != 0) {
+        uint32_t bit = __builtin_ctz(mask);
+        mask &= mask - 1;
+        if (mRefCounts[bit]++ == 0) {
+            mMask |= 1u << bit;
+        }
+    }
+    return mMask != previousMask;
+}
+
+bool MaskAggregator::remove(uint32_t mask)
+{
+    uint32_t previousMask = mMask;
+    while (mask != 0) {
+        uint32_t bit = __builtin_ctz(mask);
+        mask &= mask - 1;
+        AUDIOCOMMS_ASSERT(mRefCounts[bit] != 0, "Removing a mask not added");
+        if (--mRefCounts[bit] == 0) {
+            mMask &= ~(1u << bit);
+        }
+    }
+    return mMask != previousMask;
+}
+
+} // namespace intel_audio
@@ -0,0 +1,56 @@
+/*
+ * Copyright (C) 2015 Intel Corporation
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#pragma once
+
+#include <stdint.h>
+
+namespace intel_audio
+{
+
+/**
+ * Union of the masks contributed by several elements, maintained incrementally with a reference
+ * count per bit, so that adding or removing a contribution does not require to parse the other
+ * ones. Not thread safe.
+ */
+class MaskAggregator
+{
+public:
+    MaskAggregator();
+
+    /**
+     * @param[in] mask contributed.
+     *
+     * @return true if the aggregated mask has changed, false otherwise.
+     */
+    bool add(uint32_t mask);
+
+    /**
+     * @param[in] mask previously contributed with add.
+     *
+     * @return true if the aggregated mask has changed, false otherwise.
+     */
+    bool remove(uint32_t mask);
+
+    uint32_t getMask() const { return mMask; }
+
+private:
+    static const uint32_t mBitCount = 32;
+
+    uint32_t mRefCounts[mBitCount]; /**< Contributions to each bit of the mask. */
+    uint32_t mMask; /**< Bits with at least one contribution. */
+};
+
+} // namespace intel_audio
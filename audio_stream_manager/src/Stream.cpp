@@ -28,6 +28,8 @@
 #include <property/Property.hpp>
 #include <AudioConversion.hpp>
 #include <HalAudioDump.hpp>
+#include <utils/Timers.h>
+#include <stdio.h>
 #include <string>
 
 using android::status_t;
@@ -49,15 +51,24 @@ const std::string Stream::dumpAfterConvProps[Direction::gNbDirections] = {
     "media.dump_input.aftconv", "media.dump_output.aftconv"
 };
 
+const std::string Stream::standbyDelayProps[Direction::gNbDirections] = {
+    "media.audio.input.standby_delay_ms", "media.audio.output.standby_delay_ms"
+};
+
 Stream::Stream(Device *parent, audio_io_handle_t handle, uint32_t flagMask)
     : mParent(parent),
       mStandby(true),
       mAudioConversion(new AudioConversion),
       mLatencyMs(0),
+      mPipelineDelayFrames(0),
       mFlagMask(flagMask),
       mUseCaseMask(0),
+      mConversionProviderTime(0),
       mDumpBeforeConv(NULL),
       mDumpAfterConv(NULL),
+      mLastIoStartTime(0),
+      mIoFrameCount(0),
+      mIsStandbyDeferred(false),
       mHandle(handle),
       mPatchHandle(AUDIO_PATCH_HANDLE_NONE)
 {
@@ -65,6 +76,8 @@ Stream::Stream(Device *parent, audio_io_handle_t handle, uint32_t flagMask)
 
 Stream::~Stream()
 {
+    // Already disarmed upon closure, before the derived stream is torn down: only a safety net.
+    mParent->getStreamInterface().disarmRoutingTimer(*this);
     setStandby(true);
 
     delete mAudioConversion;
@@ -114,9 +127,101 @@ std::string Stream::getParameters(const std::string &keys) const
     if (pairs.hasKey(key)) {
         returnedPairs.add(key, capabilities.getSupportedRates());
     }
+    if (pairs.hasKey(Parameters::gKeyStreamStats)) {
+        returnedPairs.add(Parameters::gKeyStreamStats, mStats.toString());
+    }
+    if (pairs.hasKey(Parameters::gKeyClockDrift)) {
+        returnedPairs.add(Parameters::gKeyClockDrift, getClockDriftEstimator().getDriftPpm());
+    }
     return returnedPairs.toString();
 }
 
+status_t Stream::dump(int fd) const
+{
+    const char *xrunName = isOut() ? "underruns" : "overruns";
+    nsecs_t lastEvent = mStats.getLastEventTime();
+
+    dprintf(fd, "  %s stream %p (io handle %d):\n", isOut() ? "Output" : "Input", this, mHandle);
+    dprintf(fd, "    %s: %u, overflows: %u, frames lost: %llu\n", xrunName,
+            mStats.getXrunCount(), mStats.getOverflowCount(),
+            static_cast<unsigned long long>(mStats.getFramesLost()));
+    dprintf(fd, "    retries: %u, recoveries: %u (last %lld us, max %lld us)\n",
+            mStats.getRetryCount(), mStats.getRecoveryCount(),
+            static_cast<long long>(ns2us(mStats.getLastRecoveryDuration())),
+            static_cast<long long>(ns2us(mStats.getMaxRecoveryDuration())));
+    dprintf(fd, "    recovery attempts: in place %u, reopen %u, reroute %u\n",
+            mStats.getRecoveryAttemptCount(StreamStats::RecoveryInPlace),
+            mStats.getRecoveryAttemptCount(StreamStats::RecoveryReopen),
+            mStats.getRecoveryAttemptCount(StreamStats::RecoveryReroute));
+    if (lastEvent != 0) {
+        dprintf(fd, "    last event: %lld ms ago\n",
+                static_cast<long long>(ns2ms(systemTime() - lastEvent)));
+    }
+    dprintf(fd, "    state: %s, flags: 0x%x, latency: %u ms, frames %s: %llu\n",
+            isStarted() ? "started" : "standby", getFlagMask(), getLatencyMs(),
+            isOut() ? "written" : "read",
+            static_cast<unsigned long long>(mIoFrameCount.load(std::memory_order_relaxed)));
+    dumpRouting(fd);
+    dprintf(fd, "    %s time: %s\n", isOut() ? "write" : "read",
+            mIoTimeHistogram.toString().c_str());
+    dprintf(fd, "    conversion time: %s\n", mConversionTimeHistogram.toString().c_str());
+    dprintf(fd, "    jitter: %s\n", mIoJitterHistogram.toString().c_str());
+    return android::OK;
+}
+
+void Stream::dumpRouting(int fd) const
+{
+    AutoR lock(mStreamLock);
+    SampleSpec ssStream = streamSampleSpec();
+    dprintf(fd, "    stream spec: %u Hz, %u ch, format 0x%x\n", ssStream.getSampleRate(),
+            ssStream.getChannelCount(), static_cast<uint32_t>(ssStream.getFormat()));
+    if (!isRoutedL()) {
+        dprintf(fd, "    route: none\n");
+        return;
+    }
+    SampleSpec ssRoute = routeSampleSpec();
+    dprintf(fd, "    route: %s\n", getCurrentStreamRoute()->getName().c_str());
+    dprintf(fd, "    route spec: %u Hz, %u ch, format 0x%x\n", ssRoute.getSampleRate(),
+            ssRoute.getChannelCount(), static_cast<uint32_t>(ssRoute.getFormat()));
+    dprintf(fd, "    conversion: %s\n", mAudioConversion->getConversionPlan().c_str());
+
+    size_t avail;
+    struct timespec tStamp;
+    if (getFramesAvailable(avail, tStamp) == android::OK) {
+        // Output: frames queued in the ring buffer, input: frames captured not read yet.
+        size_t kernelFrames = isOut() ? getBufferSizeInFrames() - avail : avail;
+        dprintf(fd, "    kernel delay: %zu frames (%zu us)\n", kernelFrames,
+                ssRoute.convertFramesToUsec(kernelFrames));
+    } else {
+        dprintf(fd, "    kernel delay: unavailable\n");
+    }
+    dprintf(fd, "    pipeline delay: %u frames (%zu us)\n", getPipelineDelayInFrames(),
+            ssStream.convertFramesToUsec(getPipelineDelayInFrames()));
+    if (getClockDriftEstimator().isLocked()) {
+        dprintf(fd, "    clock drift: %.1f ppm\n", getClockDriftEstimator().getDriftPpm());
+    } else {
+        dprintf(fd, "    clock drift: not locked\n");
+    }
+}
+
+nsecs_t Stream::startIoTiming(size_t frames)
+{
+    nsecs_t now = systemTime();
+    nsecs_t lastIoStartTime = mLastIoStartTime.exchange(now, std::memory_order_relaxed);
+    if (lastIoStartTime != 0) {
+        nsecs_t expected = us2ns(streamSampleSpec().convertFramesToUsec(frames));
+        nsecs_t elapsed = now - lastIoStartTime;
+        mIoJitterHistogram.record(elapsed > expected ? elapsed - expected : expected - elapsed);
+    }
+    return now;
+}
+
+void Stream::stopIoTiming(nsecs_t startTime, size_t frames)
+{
+    mIoTimeHistogram.record(systemTime() - startTime);
+    mIoFrameCount.fetch_add(frames, std::memory_order_relaxed);
+}
+
 uint32_t Stream::getSampleRate() const
 {
     return IoStream::getSampleRate();
@@ -146,7 +251,42 @@ status_t Stream::setFormat(audio_format_t format)
 
 status_t Stream::standby()
 {
-    return setStandby(true);
+    uint32_t standbyDelayMs = getStandbyDelayMs();
+    if (standbyDelayMs == 0 || !isStarted() || !isRouted()) {
+        return setStandby(true);
+    }
+    {
+        AutoR lock(mStreamLock);
+        if (!isRoutedL()) {
+            return setStandby(true);
+        }
+        // Stop the pcm but keep the audio device open: a write / read within the standby delay
+        // restarts it without the cost of a reroute.
+        pcmStop();
+    }
+    Log::Debug() << __FUNCTION__ << ": deferring standby of " << (isOut() ? "output" : "input")
+                 << " stream by " << standbyDelayMs << " ms";
+    mIsStandbyDeferred = true;
+    mParent->getStreamInterface().armRoutingTimer(standbyDelayMs, *this);
+    return android::OK;
+}
+
+uint32_t Stream::getStandbyDelayMs() const
+{
+    uint32_t defaultStandbyDelayMs = mDefaultStandbyDelayMs;
+    return Property<uint32_t>(standbyDelayProps[isOut()], defaultStandbyDelayMs).getValue();
+}
+
+void Stream::onRoutingTimer()
+{
+    if (!mIsStandbyDeferred.exchange(false)) {
+        // I/O resumed within the standby delay.
+        return;
+    }
+    Log::Debug() << __FUNCTION__ << ": applying deferred standby of "
+                 << (isOut() ? "output" : "input") << " stream";
+    // Called from routing thread context, routing cannot be waited for.
+    setStandby(true, false);
 }
 
 audio_devices_t Stream::getDevice() const
@@ -161,14 +301,12 @@ bool Stream::isRoutedByPolicy() const
 
 uint32_t Stream::getFlagMask() const
 {
-    AutoR lock(mStreamLock);
     return mFlagMask;
 }
 
 uint32_t Stream::getUseCaseMask() const
 {
-    AutoR lock(mStreamLock);
-    return mUseCaseMask;
+    return mUseCaseMask.load(std::memory_order_relaxed);
 }
 
 status_t Stream::setParameters(const string &keyValuePairs)
@@ -225,15 +363,47 @@ void Stream::setUseCaseMask(uint32_t useCaseMask)
     updateLatency();
 }
 
+void Stream::handleLatencyAdaptationRequest()
+{
+    if (!consumeLatencyAdaptationRequest()) {
+        return;
+    }
+    Log::Info() << __FUNCTION__ << ": adapting latency of " << (isOut() ? "output" : "input")
+                << " stream " << this;
+    mParent->getStreamInterface().reconsiderRouting(false);
+}
+
 void Stream::updateLatency()
 {
     AutoR lock(mStreamLock);
-    mLatencyMs =
-            AudioUtils::convertUsecToMsec(mParent->getStreamInterface().getLatencyInUs(*this));
+    updateLatencyL(mParent->getStreamInterface().getLatencyInUs(*this));
 }
 
-status_t Stream::setStandby(bool isSet)
+void Stream::updateLatencyL(uint32_t routeLatencyUs)
 {
+    mLatencyMs = AudioUtils::convertUsecToMsec(
+        routeLatencyUs + streamSampleSpec().convertFramesToUsec(getPipelineDelayInFrames()));
+}
+
+void Stream::updatePipelineDelayL()
+{
+    // Conversion delay is given in destination frames, i.e. route frames for output streams.
+    uint32_t routeDelayFrames = getCurrentStreamRoute()->getDelayInFrames();
+    size_t conversionDelayFrames = mAudioConversion->getDelayInFrames();
+    uint32_t pipelineDelayFrames = isOut() ?
+        AudioUtils::convertSrcToDstInFrames(routeDelayFrames + conversionDelayFrames,
+                                            routeSampleSpec(), streamSampleSpec()) :
+        AudioUtils::convertSrcToDstInFrames(routeDelayFrames, routeSampleSpec(),
+                                            streamSampleSpec()) + conversionDelayFrames;
+    mPipelineDelayFrames.store(pipelineDelayFrames, std::memory_order_relaxed);
+}
+
+status_t Stream::setStandby(bool isSet, bool isSynchronous)
+{
+    if (mIsStandbyDeferred.load(std::memory_order_relaxed)) {
+        // Either resuming within the standby delay or entering standby for good.
+        mIsStandbyDeferred = false;
+    }
     if (isStarted() == !isSet) {
 
         return android::OK;
@@ -244,7 +414,9 @@ status_t Stream::setStandby(bool isSet)
                  << (isOut() ? "output" : "input") << " stream";
     // Start / Stop streams operation are expected to be synchronous, since we want to avoid loosing
     // audio data before the stream is routed to its route, i.e. audio device.
-    return mParent->updateStreamsParametersSync(getRole());
+    // Only deferred standby, applied from the routing thread, is asynchronous.
+    return isSynchronous ? mParent->updateStreamsParametersSync(*this) :
+           mParent->updateStreamsParametersAsync(*this);
 }
 
 status_t Stream::attachRouteL()
@@ -264,6 +436,18 @@ status_t Stream::attachRouteL()
                      << ": could not initialize audio conversion chain (err=" << err << ")";
         return err;
     }
+    // Conversion chain allocated once for all, not from the audio thread.
+    err = mAudioConversion->reserve(isOut() ? getBufferSizeInFrames() : getMaxIoFramesL());
+    if (err != android::OK) {
+        Log::Error() << __FUNCTION__
+                     << ": could not allocate audio conversion chain (err=" << err << ")";
+        return err;
+    }
+
+    updatePipelineDelayL();
+
+    // Latency may have been adapted by the route upon new routing, stream lock already held.
+    updateLatencyL(getCurrentStreamRoute()->getLatencyInUs());
 
     return android::OK;
 }
@@ -272,10 +456,17 @@ status_t Stream::detachRouteL()
 {
     Log::Verbose() << __FUNCTION__ << ": " << (isOut() ? "output" : "input") << " stream";
     TinyAlsaIoStream::detachRouteL();
+    mPipelineDelayFrames = 0;
 
     return android::OK;
 }
 
+size_t Stream::getMaxIoFramesL() const
+{
+    return AudioUtils::convertSrcToDstInFrames(getBufferSizeInFrames(), routeSampleSpec(),
+                                               streamSampleSpec());
+}
+
 status_t Stream::configureAudioConversion(const SampleSpec &ssSrc, const SampleSpec &ssDst)
 {
     return mAudioConversion->configure(ssSrc, ssDst);
@@ -284,25 +475,37 @@ status_t Stream::configureAudioConversion(const SampleSpec &ssSrc, const SampleS
 status_t Stream::getConvertedBuffer(void *dst, const size_t outFrames,
                                     android::AudioBufferProvider *bufferProvider)
 {
-    return mAudioConversion->getConvertedBuffer(dst, outFrames, bufferProvider);
+    nsecs_t startTime = systemTime();
+    mConversionProviderTime = 0;
+    status_t status = mAudioConversion->getConvertedBuffer(dst, outFrames, bufferProvider);
+    mConversionTimeHistogram.record(systemTime() - startTime - mConversionProviderTime);
+    // Frames converted beyond the request are held by the chain until the next request.
+    updatePipelineDelayL();
+    return status;
 }
 
 status_t Stream::applyAudioConversion(const void *src, void **dst, size_t inFrames,
                                       size_t *outFrames)
 {
-    return mAudioConversion->convert(src, dst, inFrames, outFrames);
+    nsecs_t startTime = systemTime();
+    status_t status = mAudioConversion->convert(src, dst, inFrames, outFrames);
+    mConversionTimeHistogram.record(systemTime() - startTime);
+    updatePipelineDelayL();
+    return status;
 }
 
 bool Stream::isStarted() const
 {
-    AutoR lock(mStreamLock);
-    return !mStandby;
+    // Lock-free: called by the audio thread at each I/O through setStandby.
+    return !mStandby.load(std::memory_order_acquire);
 }
 
 void Stream::setStarted(bool isStarted)
 {
     AutoW lock(mStreamLock);
-    mStandby = !isStarted;
+    mStandby.store(!isStarted, std::memory_order_release);
+    // Jitter is not relevant across a standby
+    mLastIoStartTime.store(0, std::memory_order_relaxed);
 
     if (isStarted) {
 
@@ -338,20 +541,6 @@ void Stream::initAudioDump()
     }
 }
 
-bool Stream::safeSleep(uint32_t sleepTimeUs)
-{
-    struct timespec tim;
-
-    if (sleepTimeUs > mMaxSleepTime) {
-        sleepTimeUs = mMaxSleepTime;
-    }
-
-    tim.tv_sec = 0;
-    tim.tv_nsec = sleepTimeUs * mNsecPerUsec;
-
-    return nanosleep(&tim, NULL) > 0;
-}
-
 void Stream::setPatchHandle(audio_patch_handle_t patchHandle)
 {
     mPatchHandle = patchHandle;
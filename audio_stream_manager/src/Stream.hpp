@@ -17,12 +17,15 @@
 
 #include "SampleSpec.hpp"
 #include <StreamInterface.hpp>
+#include <IStreamInterface.hpp>
 #include <NonCopyable.hpp>
 #include <Direction.hpp>
 #include <TinyAlsaIoStream.hpp>
+#include <TimingHistogram.hpp>
 #include <media/AudioBufferProvider.h>
 #include <hardware/audio.h>
 #include <string>
+#include <atomic>
 #include <utils/RWLock.h>
 
 class HalAudioDump;
@@ -37,6 +40,7 @@ class AudioConversion;
 class Stream
     : public virtual StreamInterface,
       public TinyAlsaIoStream,
+      private IRoutingTimerListener,
       private audio_comms::utilities::NonCopyable
 {
 public:
@@ -61,8 +65,7 @@ public:
     virtual audio_format_t getFormat() const;
     virtual android::status_t setFormat(audio_format_t format);
     virtual android::status_t standby();
-    /** @note API not implemented in our Audio HAL */
-    virtual android::status_t dump(int) const { return android::OK; }
+    virtual android::status_t dump(int fd) const;
     virtual audio_devices_t getDevice() const;
     virtual android::status_t setDevice(audio_devices_t device) = 0;
     /** @note API not implemented in stream base class, input specific implementation only. */
@@ -103,12 +106,14 @@ protected:
 
     /**
      * Set the stream state.
+     * Any deferred standby is cancelled.
      *
      * @param[in] isSet: true if the client requests the stream to enter standby, false to start
+     * @param[in] isSynchronous: wait for the routing to be applied or not.
      *
      * @return OK if stream started/standbyed successfully, error code otherwise.
      */
-    android::status_t setStandby(bool isSet);
+    android::status_t setStandby(bool isSet, bool isSynchronous = true);
 
     /**
      * Set the use case mask, which is an input source mask for an input stream, and still
@@ -119,6 +124,12 @@ protected:
      */
     void setUseCaseMask(uint32_t useCaseMask);
 
+    /**
+     * Requests the routing to be reconsidered if the route of the stream asked to adapt its
+     * latency upon xruns. Must be called without the stream lock held.
+     */
+    void handleLatencyAdaptationRequest();
+
     /**
      * Callback of route attachement called by the stream lib. (and so route manager)
      * Inherited from Stream class
@@ -182,22 +193,72 @@ protected:
      */
     android::status_t generateSilence(size_t &bytes, void *buffer = NULL);
 
+    /**
+     * Starts timing an I/O request of the client and accounts the jitter of its arrival, i.e. the
+     * deviation of the time elapsed since the previous request from the duration of the buffer.
+     * Called from the audio thread, lock-free.
+     *
+     * @param[in] frames of the request, in the stream sample specification.
+     *
+     * @return start time of the request, to be given back to stopIoTiming.
+     */
+    nsecs_t startIoTiming(size_t frames);
+
+    /**
+     * Accounts the duration of an I/O request of the client and the frames transferred.
+     * Called from the audio thread, lock-free.
+     *
+     * @param[in] startTime returned by startIoTiming.
+     * @param[in] frames transferred, in the stream sample specification. 0 if the request failed,
+     *                   its duration is still accounted.
+     */
+    void stopIoTiming(nsecs_t startTime, size_t frames);
+
     /**
      * Get the latency of the stream.
-     * Latency returns the worst case, ie the latency introduced by the alsa ring buffer.
+     * Latency returns the worst case, ie the latency introduced by the alsa ring buffer, plus the
+     * pipeline delay once routed.
      *
      * @return latency in milliseconds.
      */
     uint32_t getLatencyMs() const;
 
+    /**
+     * Get the delay of the audio pipeline beyond the alsa ring buffer, i.e. the delay of the
+     * conversion chain, including the frames it holds since the last conversion, and the intrinsic
+     * delay of the route (DSP, codec...).
+     * Lock-free, 0 if the stream is not routed.
+     *
+     * @return delay in frames in the stream sample specification.
+     */
+    uint32_t getPipelineDelayInFrames() const
+    {
+        return mPipelineDelayFrames.load(std::memory_order_relaxed);
+    }
+
     /**
      * Update the latency according to the flag.
      * Request will be done to the route manager to informs the latency introduced by the route
-     * supporting this stream flags.
+     * supporting this stream flags, the pipeline delay being added on top of it.
      *
      */
     void updateLatency();
 
+    /**
+     * Update the latency from the latency of the route and the pipeline delay.
+     * Must be called with stream lock held.
+     *
+     * @param[in] routeLatencyUs latency of the route supporting the stream, in microseconds.
+     */
+    void updateLatencyL(uint32_t routeLatencyUs);
+
+    /**
+     * Update the pipeline delay from the delay of the route and of the conversion chain.
+     * Called upon routing and after each conversion, as the frames held by the conversion chain
+     * vary from one request to another. Must be called with stream lock held, stream routed.
+     */
+    void updatePipelineDelayL();
+
     /**
      * Sets the state of the status.
      *
@@ -225,25 +286,6 @@ protected:
         return mDumpAfterConv;
     }
 
-    /**
-     * Used to sleep on the current thread.
-     *
-     * This function is used to get a POSIX-compliant way
-     * to accurately sleep the current thread.
-     *
-     * If function is successful, zero is returned
-     * and request has been honored, if function fails,
-     * EINTR has been raised by the system and -1 is returned.
-     *
-     * The other two errors considered by standard
-     * are not applicable in our context (EINVAL, ENOSYS)
-     *
-     * @param[in] sleepTimeUs: desired to sleep, in microseconds.
-     *
-     * @return on success true is returned, false otherwise.
-     */
-    bool safeSleep(uint32_t sleepTimeUs);
-
     Device *mParent; /**< Audio HAL singleton handler. */
 
     /**
@@ -256,21 +298,60 @@ protected:
     android::RWLock mPreProcEffectLock;
 
     /**
-     * maximum number of read/write retries.
+     * Time spent by the buffer provider within getConvertedBuffer, i.e. reading from the audio
+     * device, excluded from the conversion time. Accessed from the audio thread only.
+     */
+    nsecs_t mConversionProviderTime;
+
+    /**
+     * Get the worst case of frames transferred by a single I/O operation, i.e. the ring buffer
+     * of the route. Used to size once upon routing the buffers of the I/O path.
+     * Must be called with stream lock held, stream routed.
      *
-     * This constant is used to set maximum number of retries to do
-     * on write/read operations before stating that error is not
-     * recoverable and reset media server.
+     * @return frames in the stream sample specification.
      */
-    static const uint32_t mMaxReadWriteRetried = 50;
+    size_t getMaxIoFramesL() const;
 
     static const uint32_t mDefaultSampleRate = 48000; /**< Default HAL sample rate. */
     static const uint32_t mDefaultChannelCount = 2; /**< Default HAL nb of channels. */
     static const audio_format_t mDefaultFormat = AUDIO_FORMAT_PCM_16_BIT; /**< Default HAL format.*/
 
 private:
+    /** Disarms the routing timer and enters standby upon stream closure. */
+    friend class Device;
+
     void getDefaultConfig(audio_config_t &config) const;
 
+    /**
+     * Dumps the route, sample specifications, conversion chain and kernel delay of the stream.
+     * Takes the stream lock in read mode.
+     *
+     * @param[in] fd file descriptor to dump into.
+     */
+    void dumpRouting(int fd) const;
+
+    /**
+     * Applies the deferred standby, unless an I/O resumed since the standby request.
+     * From IRoutingTimerListener, called from the routing thread.
+     */
+    virtual void onRoutingTimer();
+
+    /**
+     * Delay before closing the audio device upon standby request, 0 to close it immediately.
+     *
+     * @return standby delay of the stream direction, in milliseconds.
+     */
+    uint32_t getStandbyDelayMs() const;
+
+    /** Standby requested, closure of the audio device deferred until the routing timer expiry. */
+    std::atomic<bool> mIsStandbyDeferred;
+
+    TimingHistogram mIoTimeHistogram; /**< wall time of write/read requests. */
+    TimingHistogram mConversionTimeHistogram; /**< time spent in the conversion chain. */
+    TimingHistogram mIoJitterHistogram; /**< jitter of write/read requests arrival. */
+    std::atomic<nsecs_t> mLastIoStartTime; /**< start of the last request, 0 after standby. */
+    std::atomic<uint64_t> mIoFrameCount; /**< frames written/read since stream creation. */
+
     /**
      * Configures the conversion chain.
      * It configures the conversion chain that may be used to convert samples from the source
@@ -291,12 +372,22 @@ private:
     void initAudioDump();
 
 
-    bool mStandby; /**< state of the stream, true if standby, false if started. */
+    /**
+     * State of the stream, true if standby, false if started.
+     * Updated with the stream lock held, read lock-free from the audio thread at each I/O.
+     */
+    std::atomic<bool> mStandby;
 
     AudioConversion *mAudioConversion; /**< Audio Conversion utility class. */
 
     uint32_t mLatencyMs; /**< Latency associated with the current flag of the stream. */
 
+    /**
+     * Pipeline delay, computed upon routing and refreshed after each conversion, in frames in the
+     * stream sample specification.
+     */
+    std::atomic<uint32_t> mPipelineDelayFrames;
+
     /**
      * Flags mask is either:
      *  -for output streams: stream flags, from audio_output_flags_t in audio.h file.
@@ -305,16 +396,18 @@ private:
      *  -for input streams: audio_input_flags_t.
      *          Note that 0 will be taken as none.
      * The values must match audio.h file definitions.
+     * Constant during the whole stream life, so it may be read without the stream lock.
      */
-    uint32_t mFlagMask;
+    const uint32_t mFlagMask;
 
     /**
      * Use case mask is either:
      *  -for output streams: Not used.
      *  -for input streams: input source translated into a bit.
      *          Note that 0 will be taken as none.
+     * Updated with the stream lock held, read lock-free.
      */
-    uint32_t mUseCaseMask;
+    std::atomic<uint32_t> mUseCaseMask;
 
     /**
      * Audio dump object used if one of the dump property before
@@ -338,11 +431,12 @@ private:
      */
     static const std::string dumpAfterConvProps[Direction::gNbDirections];
 
-    /** maximum sleep time to be allowed by HAL, in microseconds. */
-    static const uint32_t mMaxSleepTime = 1000000UL;
+    /**
+     * Array of property names of the standby delay
+     */
+    static const std::string standbyDelayProps[Direction::gNbDirections];
 
-    /** Ratio between nanoseconds and microseconds */
-    static const uint32_t mNsecPerUsec = 1000;
+    static const uint32_t mDefaultStandbyDelayMs = 500; /**< Standby delay if no property set. */
 
     audio_io_handle_t mHandle; /**< Unique IO handle identifier assigned by the audio policy. */
 
@@ -16,37 +16,44 @@
 #define LOG_TAG "AudioStreamIn"
 
 #include "StreamIn.hpp"
+#include "EchoReference.hpp"
 #include <AudioCommsAssert.hpp>
 #include <HalAudioDump.hpp>
 #include <KeyValuePairs.hpp>
 #include <BitField.hpp>
 #include <EffectHelper.hpp>
+#include <property/Property.hpp>
 #include <utilities/Log.hpp>
 #include <algorithm>
+#include <string.h>
 
 using namespace std;
 using audio_comms::utilities::BitField;
 using android::status_t;
 using audio_comms::utilities::Log;
+using audio_comms::utilities::Property;
 
 namespace intel_audio
 {
 
 const std::string StreamIn::mHwEffectImplementor = "IntelLPE";
+const std::string StreamIn::mPrefetchProp = "media.audio.input.prefetch";
 
 StreamIn::StreamIn(Device *parent, audio_io_handle_t handle, uint32_t flagMask,
                    audio_source_t source, audio_devices_t devices)
     : Stream(parent, handle, flagMask),
-      mFramesLost(0),
       mFramesIn(0),
-      mProcessingFramesIn(0),
-      mProcessingBuffer(NULL),
-      mProcessingBufferSizeInFrames(0),
-      mReferenceFramesIn(0),
-      mReferenceBuffer(NULL),
-      mReferenceBufferSizeInFrames(0),
+      mFramesRead(0),
+      mProcessingRingFrames(0),
       mPreprocessorsHandlerList(),
-      mHwBuffer(NULL)
+      mPreprocessorCount(0),
+      mHwBuffer(NULL),
+      mHwBufferSize(0),
+      mIsPrefetchEnabled(Property<bool>(mPrefetchProp, false).getValue()),
+      mPrefetcher(*this, mStats),
+      mIsPrerolling(false),
+      mPrerollSource(NULL),
+      mLoopback(NULL)
 {
     setDevice(devices);
     setInputSource(source);
@@ -54,9 +61,18 @@ StreamIn::StreamIn(Device *parent, audio_io_handle_t handle, uint32_t flagMask,
 
 StreamIn::~StreamIn()
 {
+    // Before the buffers are freed, as the prefetch thread may be reading in.
+    mPrefetcher.stop();
     freeAllocatedBuffers();
 }
 
+status_t StreamIn::standby()
+{
+    mPrefetcher.stop();
+    mLoopbackClock.stop();
+    return Stream::standby();
+}
+
 status_t StreamIn::set(audio_config_t &config)
 {
     if (config.channel_mask == AUDIO_CHANNEL_NONE) {
@@ -73,7 +89,10 @@ status_t StreamIn::getNextBuffer(AudioBufferProvider::Buffer *buffer,
 
     ssize_t hwFramesToRead = min(maxFrames, buffer->frameCount);
 
+    // Reading from the audio device is not part of the conversion time
+    nsecs_t readStartTime = systemTime();
     status_t status = readHwFrames(mHwBuffer, hwFramesToRead);
+    mConversionProviderTime += systemTime() - readStartTime;
     if (status < 0) {
 
         return status;
@@ -86,7 +105,6 @@ status_t StreamIn::getNextBuffer(AudioBufferProvider::Buffer *buffer,
 
 status_t StreamIn::readHwFrames(void *buffer, size_t frames)
 {
-    uint32_t retryCount = 0;
     status_t ret;
 
     if (frames == 0) {
@@ -94,9 +112,9 @@ status_t StreamIn::readHwFrames(void *buffer, size_t frames)
         return android::BAD_VALUE;
     }
 
+    // Only filled upon error, declared once not to construct it at each retry.
+    std::string error;
     do {
-        std::string error;
-
         ret = pcmReadFrames(buffer, frames, error);
 
         if (ret < 0) {
@@ -104,26 +122,11 @@ status_t StreamIn::readHwFrames(void *buffer, size_t frames)
                          << " (bytes=" << streamSampleSpec().convertFramesToBytes(frames)
                          << ") frames";
 
-            if (error.find(strerror(EBADFD)) != std::string::npos) {
+            if (pcmRecover() != android::OK) {
+                mStats.onRecoveryStarted(StreamStats::RecoveryReroute);
                 return android::DEAD_OBJECT;
             }
-
-            if (++retryCount >= mMaxReadWriteRetried) {
-                Log::Error() << __FUNCTION__ << ": Hardware not responding after " << retryCount
-                             << " retries";
-                return android::DEAD_OBJECT;
-            }
-
-            // Get the number of microseconds to sleep, inferred from the number of
-            // frames to write.
-            size_t sleepUSecs = routeSampleSpec().convertFramesToUsec(frames);
-
-            // Go sleeping before trying I/O operation again.
-            if (safeSleep(sleepUSecs)) {
-                // If some error arises when trying to sleep, try I/O operation anyway.
-                // Error counter will provoke the restart of mediaserver.
-                Log::Error() << __FUNCTION__ << ":  Error while calling nanosleep interface";
-            }
+            mStats.onRetry();
         }
 
     } while (ret < 0);
@@ -142,6 +145,109 @@ status_t StreamIn::readHwFrames(void *buffer, size_t frames)
     return ret;
 }
 
+status_t StreamIn::readPrefetchFrames(void *buffer, size_t frames, size_t &framesRead)
+{
+    if (!isRouted()) {
+        return android::NO_INIT;
+    }
+    status_t status;
+    {
+        AutoR lock(mStreamLock);
+        if (!isRoutedL()) {
+            return android::NO_INIT;
+        }
+        ssize_t processedFrames = 0;
+        status = readFrames(buffer, frames, &processedFrames);
+        framesRead = (status == android::OK) ? processedFrames : 0;
+    }
+    if (status == android::DEAD_OBJECT && mIsPrerolling) {
+        // Without the stream lock, as rerouting takes it.
+        Log::Error() << __FUNCTION__ << ": execute pre-roll device recovery";
+        setStandby(true);
+        setStandby(false);
+        return android::NO_INIT;
+    }
+    return status;
+}
+
+status_t StreamIn::startPrefetch()
+{
+    size_t periodFrames;
+    size_t depthFrames;
+    {
+        AutoR lock(mStreamLock);
+        if (!isRoutedL()) {
+            return android::NO_INIT;
+        }
+        periodFrames = AudioUtils::convertSrcToDstInFrames(getPeriodSizeInFrames(),
+                                                           routeSampleSpec(),
+                                                           streamSampleSpec());
+        depthFrames = getMaxIoFramesL() * mPrefetchDepthFactor;
+    }
+    // Without the stream lock, as the prefetch thread takes it for each read.
+    return mPrefetcher.start(streamSampleSpec().getFrameSize(), streamSampleSpec().getSampleRate(),
+                             periodFrames, depthFrames);
+}
+
+status_t StreamIn::startPreroll(uint32_t durationMs)
+{
+    size_t periodFrames = streamSampleSpec().convertBytesToFrames(getBufferSize());
+    if (periodFrames == 0) {
+        Log::Error() << __FUNCTION__ << ": no route matching the pre-roll stream";
+        return android::NO_INIT;
+    }
+    mIsPrerolling = true;
+    setStandby(false);
+    // Prefetching while no route is attached yet, the thread paces itself until then.
+    status_t status = mPrefetcher.start(streamSampleSpec().getFrameSize(),
+                                        streamSampleSpec().getSampleRate(), periodFrames,
+                                        streamSampleSpec().convertUsecToframes(durationMs * 1000),
+                                        true);
+    if (status != android::OK) {
+        stopPreroll();
+    }
+    return status;
+}
+
+void StreamIn::stopPreroll()
+{
+    mPrefetcher.stop();
+    mIsPrerolling = false;
+    setStandby(true);
+}
+
+status_t StreamIn::readLoopbackFrames(void *buffer, size_t frames)
+{
+    nsecs_t now = systemTime();
+    if (!mLoopbackClock.isRunning() || mLoopbackClock.getFramesAt(now) > mFramesRead) {
+        // First read or client late: restarts from now, as an audio device would.
+        mLoopbackClock.start(mFramesRead, now, streamSampleSpec().getSampleRate());
+    }
+    VirtualClock::sleepUntil(mLoopbackClock.getTimeOf(mFramesRead + frames));
+    nsecs_t delay;
+    return mLoopback->read(buffer, frames, mLoopbackClock.getTimeOf(mFramesRead), delay);
+}
+
+status_t StreamIn::readPrefetchedFrames(void *buffer, size_t frames, size_t &capturedFrames)
+{
+    nsecs_t timeout = us2ns(streamSampleSpec().convertFramesToUsec(
+                                frames + mPrefetcher.getPeriodSizeInFrames()));
+    capturedFrames = 0;
+    status_t status = mPrefetcher.read(buffer, frames, timeout, capturedFrames);
+    if (status != android::OK) {
+        return status;
+    }
+    if (capturedFrames < frames) {
+        // Capture late, e.g. rerouting: frames replaced by silence not to block the client.
+        Log::Warning() << __FUNCTION__ << ": " << frames - capturedFrames
+                       << " frames not prefetched in time, filled with silence";
+        memset(static_cast<char *>(buffer) +
+               streamSampleSpec().convertFramesToBytes(capturedFrames),
+               0, streamSampleSpec().convertFramesToBytes(frames - capturedFrames));
+    }
+    return android::OK;
+}
+
 status_t StreamIn::readFrames(void *buffer, size_t frames, ssize_t *processedFrames)
 {
     //
@@ -178,28 +284,36 @@ status_t StreamIn::readFrames(void *buffer, size_t frames, ssize_t *processedFra
     return status;
 }
 
-int StreamIn::doProcessFrames(const void *buffer, ssize_t frames,
-                              ssize_t *processedFrames,
-                              ssize_t *processingFramesIn)
+int StreamIn::doProcessFrames(const void *buffer, ssize_t frames, ssize_t *processedFrames)
 {
     int ret = 0;
 
     audio_buffer_t inBuf;
     audio_buffer_t outBuf;
 
-    while ((*processedFrames < frames) && (*processingFramesIn > 0) && (ret == 0)) {
+    while ((*processedFrames < frames) && (mProcessingRing.getReadableFrames() > 0) &&
+           (ret == 0)) {
+
+        // Effects are fed with the contiguous region of the ring, the region following the end
+        // of the ring is processed on next loop.
+        size_t processingFramesIn;
+        int16_t *processingBuffer =
+            static_cast<int16_t *>(mProcessingRing.getReadPointer(processingFramesIn));
+        size_t consumedFrames = 0;
+        ssize_t producedFrames = 0;
+        bool isEchoCancelled = false;
 
         vector<AudioEffectHandle>::const_iterator it;
         for (it = mPreprocessorsHandlerList.begin(); it != mPreprocessorsHandlerList.end(); ++it) {
 
             if (it->mEchoReference != NULL) {
-                pushEchoReference(*processingFramesIn, it->mPreprocessor, *it->mEchoReference);
+                pushEchoReference(processingFramesIn, it->mPreprocessor, *it->mEchoReference);
+                isEchoCancelled = true;
             }
             // in_buf.frameCount and out_buf.frameCount indicate respectively
             // the maximum number of frames to be consumed and produced by process()
-            inBuf.frameCount = *processingFramesIn;
-            inBuf.s16 = (int16_t *)((char *)mProcessingBuffer +
-                                    streamSampleSpec().convertFramesToBytes(*processedFrames));
+            inBuf.frameCount = processingFramesIn;
+            inBuf.s16 = processingBuffer;
             outBuf.frameCount = frames - *processedFrames;
             outBuf.s16 = (int16_t *)((char *)buffer +
                                      streamSampleSpec().convertFramesToBytes(*processedFrames));
@@ -211,115 +325,171 @@ int StreamIn::doProcessFrames(const void *buffer, ssize_t frames,
 
                 // process() has updated the number of frames consumed and produced in
                 // in_buf.frameCount and out_buf.frameCount respectively
-                *processingFramesIn -= inBuf.frameCount;
-                *processedFrames += outBuf.frameCount;
+                consumedFrames = inBuf.frameCount;
+                producedFrames = outBuf.frameCount;
             }
         }
+        if (consumedFrames == 0 && producedFrames == 0) {
+            // Effects buffering internally, nothing more to expect from this region.
+            break;
+        }
+        if (isEchoCancelled) {
+            mEchoDelayEstimator.pushCapture(processingBuffer, consumedFrames);
+        }
+        mProcessingRing.consume(consumedFrames);
+        *processedFrames += producedFrames;
     }
     return ret;
 }
 
 status_t StreamIn::processFrames(void *buffer, ssize_t frames, ssize_t *processedFrames)
 {
-    // first reload enough frames at the end of process input buffer
-    if (mProcessingFramesIn < frames) {
-
-        if (mProcessingBufferSizeInFrames < frames) {
+    // Never more than the ring can hold, the client is told the frames actually read.
+    frames = min(frames, static_cast<ssize_t>(mProcessingRing.getCapacity()));
 
-            status_t ret = allocateProcessingMemory(frames);
-            if (ret != android::OK) {
+    // first reload enough frames at the end of the processing ring, up to two regions if the
+    // free room wraps at the end of the ring
+    while (mProcessingRing.getReadableFrames() < static_cast<size_t>(frames)) {
 
-                return ret;
-            }
-        }
-
-        ssize_t read_frames = frames - mProcessingFramesIn;
+        size_t writableFrames;
+        void *processingBuffer = mProcessingRing.getWritePointer(writableFrames);
+        size_t framesToRead = min(writableFrames, frames - mProcessingRing.getReadableFrames());
 
-        status_t status = readFrames((char *)mProcessingBuffer +
-                                     streamSampleSpec().convertFramesToBytes(
-                                         mProcessingFramesIn),
-                                     read_frames, processedFrames);
+        status_t status = readFrames(processingBuffer, framesToRead, processedFrames);
         if (status < 0) {
 
             return status;
         }
         /* OK, we have to process all read frames */
-        mProcessingFramesIn += read_frames;
-        AUDIOCOMMS_ASSERT(mProcessingFramesIn >= frames, "Not enough frames");
-
+        mProcessingRing.commitWrite(framesToRead);
     }
 
     *processedFrames = 0;
-    ssize_t processingFramesIn = mProcessingFramesIn;
     int processingReturn = 0;
 
     // Then process the frames
-    processingReturn = doProcessFrames(buffer, frames, processedFrames, &processingFramesIn);
+    processingReturn = doProcessFrames(buffer, frames, processedFrames);
     if (processingReturn != 0) {
 
         // Effects processing failed
         // at least, it is necessary to return the read HW frames
         Log::Debug() << __FUNCTION__ << ": unable to apply any effect, ret=" << processingReturn;
-        memcpy(buffer,
-               mProcessingBuffer,
-               streamSampleSpec().convertFramesToBytes(mProcessingFramesIn));
-        *processedFrames = mProcessingFramesIn;
-    } else {
-
-        // move remaining frames to the beginning of mProccesingBuffer because currently,
-        // the configuration imposes working with 160 frames and effects library works
-        // with 80 frames per cycle (10 ms), i.e. the processing of 160 read HW frames
-        // requests two calls to effects library (which are done by while loop. In future or
-        // if configuration changed, effects library processing could be not more multiple of
-        // HW read frames, so it is necessary to realign the buffer
-        if (processingFramesIn != 0) {
-
-            AUDIOCOMMS_ASSERT(processingFramesIn > 0, "Not enough frames");
-            memmove(mProcessingBuffer,
-                    (char *)mProcessingBuffer +
-                    streamSampleSpec().convertFramesToBytes(mProcessingFramesIn -
-                                                            processingFramesIn),
-                    streamSampleSpec().convertFramesToBytes(processingFramesIn));
-        }
+        *processedFrames += mProcessingRing.read((char *)buffer +
+                                                 streamSampleSpec().convertFramesToBytes(
+                                                     *processedFrames),
+                                                 frames - *processedFrames);
     }
-    // at the end, we keep remainder frames not cosumed by effect processor.
-    mProcessingFramesIn = processingFramesIn;
+    // at the end, we keep remainder frames not consumed by effect processor in the ring, as the
+    // effects library may work with a different amount of frames per cycle than the HW reads.
 
     return android::OK;
 }
 
 status_t StreamIn::read(void *buffer, size_t &bytes)
 {
+    status_t status;
+    ssize_t frames = streamSampleSpec().convertBytesToFrames(bytes);
+
+    if (mPrerollSource != NULL) {
+        // Never started, the route is held by the pre-rolling stream.
+        size_t capturedFrames;
+        status = mPrerollSource->readPrefetchedFrames(buffer, frames, capturedFrames);
+        if (status != android::OK) {
+            Log::Error() << __FUNCTION__ << ": (buffer=" << buffer << ", bytes=" << bytes
+                         << ") pre-roll failed. Generating silence for stream " << this;
+            generateSilence(bytes, buffer);
+            return -EBADFD;
+        }
+        mFramesRead += capturedFrames;
+        return android::OK;
+    }
+    if (mLoopback != NULL) {
+        // Never started, no route is needed to capture the frames played.
+        status = readLoopbackFrames(buffer, frames);
+        if (status != android::OK) {
+            Log::Error() << __FUNCTION__ << ": (buffer=" << buffer << ", bytes=" << bytes
+                         << ") loopback failed. Generating silence for stream " << this;
+            generateSilence(bytes, buffer);
+            return -EBADFD;
+        }
+        mFramesRead += frames;
+        return android::OK;
+    }
     setStandby(false);
 
-    mStreamLock.readLock();
+    nsecs_t ioStartTime = startIoTiming(frames);
+
+    if (mIsPrefetchEnabled && mPreprocessorCount.load(std::memory_order_acquire) == 0 &&
+        (mPrefetcher.isRunning() || startPrefetch() == android::OK)) {
+        // Frames drained by the prefetch thread, consumed without the stream lock.
+        size_t capturedFrames;
+        status = readPrefetchedFrames(buffer, frames, capturedFrames);
+        if (status != android::OK) {
+            Log::Error() << __FUNCTION__ << ": (buffer=" << buffer << ", bytes=" << bytes
+                         << ") prefetch failed. Generating silence for stream " << this;
+            generateSilence(bytes, buffer);
+            mPrefetcher.stop();
+            if (status == android::DEAD_OBJECT) {
+                Log::Error() << __FUNCTION__ << ": execute device recovery";
+                setStandby(true);
+            }
+            stopIoTiming(ioStartTime, 0);
+            return -EBADFD;
+        }
+        // Silence inserted on timeout not accounted, the position shall follow the hardware.
+        mFramesRead += capturedFrames;
+        stopIoTiming(ioStartTime, frames);
+        handleLatencyAdaptationRequest();
+        return android::OK;
+    }
+    if (mPrefetcher.isRunning()) {
+        // SW effects attached since the prefetch started, capture synchronously from now on.
+        mPrefetcher.stop();
+    }
 
-    status_t status;
-    // Check if the audio route is available for this stream
-    if (!isRoutedL()) {
+    // Check if the audio route is available for this stream.
+    // Lock-free check first, the stream lock is only taken to access the audio device, and checked
+    // again once held as a route change may be pending.
+    bool isCapturing = isRouted();
+    if (isCapturing) {
+        mStreamLock.readLock();
+        if (!isRoutedL()) {
+            mStreamLock.unlock();
+            isCapturing = false;
+        }
+    }
+    if (!isCapturing) {
+        // Silence is generated without the stream lock, not to block the routing thread while
+        // sleeping for the buffer duration.
         Log::Warning() << __FUNCTION__ << ": (buffer=" << buffer
                        << ", bytes=" << bytes
                        << ") No route available. Generating silence for stream " << this;
         status = generateSilence(bytes, buffer);
-
-        mStreamLock.unlock();
+        mFramesRead += frames;
+        stopIoTiming(ioStartTime, frames);
         return status;
     }
 
     ssize_t received_frames = -1;
-    ssize_t frames = streamSampleSpec().convertBytesToFrames(bytes);
 
-    // Take the effect lock while processing
-    mPreProcEffectLock.readLock();
+    if (mPreprocessorCount.load(std::memory_order_acquire) == 0) {
+        // Fast path: no SW effect attached, effect lock not needed.
+        status = readFrames(buffer, frames, &received_frames);
+    } else {
+        // Take the effect lock while processing
+        mPreProcEffectLock.readLock();
 
-    if (!mPreprocessorsHandlerList.empty()) {
+        if (!mPreprocessorsHandlerList.empty()) {
 
-        status = processFrames(buffer, frames, &received_frames);
-    } else {
+            status = processFrames(buffer, frames, &received_frames);
+            mProcessingRingFrames.store(mProcessingRing.getReadableFrames(),
+                                        std::memory_order_relaxed);
+        } else {
 
-        status = readFrames(buffer, frames, &received_frames);
+            status = readFrames(buffer, frames, &received_frames);
+        }
+        mPreProcEffectLock.unlock();
     }
-    mPreProcEffectLock.unlock();
 
     if (status < 0) {
         Log::Error() << __FUNCTION__ << ": (buffer=" << buffer << ", bytes=" << bytes
@@ -333,45 +503,88 @@ status_t StreamIn::read(void *buffer, size_t &bytes)
             Log::Error() << __FUNCTION__ << ": execute device recovery";
             setStandby(true);
         }
+        stopIoTiming(ioStartTime, 0);
         return -EBADFD;
     }
     bytes = streamSampleSpec().convertFramesToBytes(received_frames);
+    mFramesRead += received_frames;
 
     mStreamLock.unlock();
+    stopIoTiming(ioStartTime, received_frames);
+    handleLatencyAdaptationRequest();
     return android::OK;
 }
 
-void StreamIn::resetFramesLost()
-{
-    // setVoiceVolume and mixing during voice call cannot happen together
-    // need a lock; but deadlock may appear during simultaneous R or W
-    // so remove lock and the reset of mFramesLost which is never updated btw
-}
-
 unsigned int StreamIn::getInputFramesLost() const
 {
-    unsigned int count = mFramesLost;   // set to 0 during construction
-
-    StreamIn *mutable_this = const_cast<StreamIn *>(this);
     // Requirement from AudioHardwareInterface.h:
     // Audio driver is expected to reset the value to 0 and restart counting upon
     // returning the current value by this function call.
-    mutable_this->resetFramesLost();
-    return count;
+    // Overruns are accounted lock-free by the stream lib, so no need to take the stream lock.
+    return mStats.consumeFramesLost();
 }
 
+status_t StreamIn::getCapturePosition(int64_t &frames, int64_t &time) const
+{
+    if (mLoopback != NULL && mLoopbackClock.isRunning()) {
+        // All frames captured by the virtual clock have been read.
+        uint64_t framesRead = mFramesRead;
+        frames = framesRead;
+        time = mLoopbackClock.getTimeOf(framesRead);
+        return android::OK;
+    }
+    if (!isRouted()) {
+        return android::INVALID_OPERATION;
+    }
+    // Stream lock held not to close the audio device while getting its timestamp.
+    AutoR lock(mStreamLock);
+    if (!isRoutedL()) {
+        return android::INVALID_OPERATION;
+    }
+    size_t kernelFrames;
+    struct timespec tStamp;
+    status_t status = getFramesAvailable(kernelFrames, tStamp);
+    if (status != android::OK) {
+        return status;
+    }
+    // All frames captured by the timestamp have been either read by the client or are still
+    // buffered in the kernel ring buffer, the prefetch ring, the processing ring or the pipeline
+    // (route delay and conversion chain).
+    uint64_t bufferedFrames =
+        AudioUtils::convertSrcToDstInFrames(kernelFrames, routeSampleSpec(), streamSampleSpec()) +
+        mPrefetcher.getReadableFrames() + mProcessingRingFrames.load(std::memory_order_relaxed) +
+        getPipelineDelayInFrames();
+    frames = mFramesRead + bufferedFrames;
+    time = seconds_to_nanoseconds(tStamp.tv_sec) + tStamp.tv_nsec;
+    return android::OK;
+}
 
-status_t StreamIn::allocateHwBuffer()
+
+status_t StreamIn::allocateCaptureBuffers()
 {
-    freeAllocatedBuffers();
+    ssize_t hwBufferSize = getBufferSizeInBytes();
+    if (mHwBufferSize < hwBufferSize) {
 
-    mHwBufferSize = getBufferSizeInBytes();
+        freeAllocatedBuffers();
+        mHwBuffer = new char[hwBufferSize];
+        if (!mHwBuffer) {
+            Log::Error() << __FUNCTION__ << ": cannot allocate resampler Hwbuffer";
+            return android::NO_MEMORY;
+        }
+        mHwBufferSize = hwBufferSize;
+    }
 
-    mHwBuffer = new char[mHwBufferSize];
-    if (!mHwBuffer) {
-        Log::Error() << __FUNCTION__ << ": cannot allocate resampler Hwbuffer";
+    // Effect rings sized for the worst case upon routing, not to allocate from the audio
+    // thread once effects are attached.
+    size_t maxFrames = getMaxIoFramesL();
+    size_t frameSize = streamSampleSpec().getFrameSize();
+    if (mProcessingRing.reserve(maxFrames, frameSize) != android::OK ||
+        mReferenceRing.reserve(maxFrames, frameSize) != android::OK) {
+        Log::Error() << __FUNCTION__ << ": (frames=" << maxFrames
+                     << "): cannot allocate processing rings";
         return android::NO_MEMORY;
     }
+    mProcessingRingFrames = 0;
     return android::OK;
 }
 
@@ -379,6 +592,7 @@ void StreamIn::freeAllocatedBuffers()
 {
     delete[] mHwBuffer;
     mHwBuffer = NULL;
+    mHwBufferSize = 0;
 }
 
 status_t StreamIn::attachRouteL()
@@ -388,12 +602,12 @@ status_t StreamIn::attachRouteL()
 
         return status;
     }
-    return allocateHwBuffer();
+    return allocateCaptureBuffers();
 }
 
 status_t StreamIn::detachRouteL()
 {
-    freeAllocatedBuffers();
+    // Capture buffers are kept, not to reallocate them on next routing.
     return Stream::detachRouteL();
 }
 
@@ -472,17 +686,23 @@ status_t StreamIn::addAudioEffect(effect_handle_t effect)
         if (isStarted()) {
             Log::Debug() << __FUNCTION__ << ": stream running, reconsider routing";
             // If the stream is routed, force a reconsider routing to take effect into account
-            mParent->updateStreamsParametersAsync(getRole());
+            mParent->updateStreamsParametersAsync(*this);
         }
     } else {
         Log::Debug() << __FUNCTION__ << ": SW Effect requested(effect=" << effect << ")";
         /**
          * SW Effects management
          */
+        if (streamSampleSpec().getFormat() != AUDIO_FORMAT_PCM_16_BIT) {
+            // SW effects only process 16-bit samples, hi-res capture is not reformatted for them.
+            Log::Error() << __FUNCTION__ << ": SW effects not supported in format "
+                         << static_cast<int32_t>(streamSampleSpec().getFormat());
+            return android::INVALID_OPERATION;
+        }
         if (isAecEffect(effect)) {
 
-            struct echo_reference_itfe *stReference = NULL;
-            stReference = mParent->getEchoReference(streamSampleSpec());
+            EchoReference *stReference = NULL;
+            stReference = mParent->getEchoReference(streamSampleSpec(), getDevices());
             return addSwAudioEffectL(effect, stReference);
         }
         addSwAudioEffectL(effect);
@@ -518,7 +738,7 @@ status_t StreamIn::removeAudioEffect(effect_handle_t effect)
             Log::Debug() << __FUNCTION__ << ": stream running, reconsider routing";
             // If the stream is routed,
             // force a reconsider routing to take effect removal into account
-            mParent->updateStreamsParametersAsync(getRole());
+            mParent->updateStreamsParametersAsync(*this);
         }
     } else {
         Log::Debug() << __FUNCTION__ << ": SW Effect requested";
@@ -531,7 +751,7 @@ status_t StreamIn::removeAudioEffect(effect_handle_t effect)
 }
 
 status_t StreamIn::addSwAudioEffectL(effect_handle_t effect,
-                                     echo_reference_itfe *reference)
+                                     EchoReference *reference)
 {
     if (effect == NULL || *effect == NULL) {
         return android::BAD_VALUE;
@@ -546,7 +766,12 @@ status_t StreamIn::addSwAudioEffectL(effect_handle_t effect,
                        << "): it is useless to add again the same effect";
         return android::OK;
     }
+    if (reference != NULL) {
+        // New call, calibrated again from scratch.
+        mEchoDelayEstimator.reset(streamSampleSpec());
+    }
     mPreprocessorsHandlerList.push_back(AudioEffectHandle(effect, reference));
+    mPreprocessorCount.store(mPreprocessorsHandlerList.size(), std::memory_order_release);
     Log::Debug() << __FUNCTION__ << ": (effect=" << effect
                  << "): effect added. number of stored effects is"
                  << effect, mPreprocessorsHandlerList.size();
@@ -564,12 +789,11 @@ status_t StreamIn::removeSwAudioEffectL(effect_handle_t effect)
                      << mPreprocessorsHandlerList.size();
         if (it->mEchoReference != NULL) {
 
-            /* stop reading from echo reference */
-            it->mEchoReference->read(it->mEchoReference, NULL);
             mParent->resetEchoReference(it->mEchoReference);
             it->mEchoReference = NULL;
         }
         mPreprocessorsHandlerList.erase(it);
+        mPreprocessorCount.store(mPreprocessorsHandlerList.size(), std::memory_order_release);
         Log::Debug() << __FUNCTION__ << " (effect=" << effect
                      << "): effect has been found. number of effects after erase "
                      << mPreprocessorsHandlerList.size();
@@ -626,115 +850,93 @@ bool StreamIn::isAecEffect(effect_handle_t effect)
     return false;
 }
 
-void StreamIn::getCaptureDelay(struct echo_reference_buffer *buffer)
+status_t StreamIn::getCaptureTime(nsecs_t &captureTime)
 {
-    /* read frames available in kernel driver buffer */
-    size_t kernel_frames;
-    struct timespec tstamp;
-    long buf_delay;
-    long kernel_delay;
-    long delay_ns;
-
-    if (getFramesAvailable(kernel_frames, tstamp) != android::OK) {
-
-        buffer->time_stamp.tv_sec = 0;
-        buffer->time_stamp.tv_nsec = 0;
-        buffer->delay_ns = 0;
-        Log::Warning() << __FUNCTION__ << ": read get_capture_delay(): pcm_htimestamp error";
-        return;
+    size_t kernelFrames;
+    struct timespec tStamp;
+    status_t status = getFramesAvailable(kernelFrames, tStamp);
+    if (status != android::OK) {
+        Log::Warning() << __FUNCTION__ << ": pcm_htimestamp error";
+        return status;
     }
-    // read frames available in audio HAL input buffer
-    // add number of frames being read as we want the capture time of first sample
-    // in current buffer.
-    buf_delay = streamSampleSpec().convertFramesToUsec(mFramesIn + mProcessingFramesIn);
-
-    // add delay introduced by kernel
-    kernel_delay = routeSampleSpec().convertFramesToUsec(kernel_frames);
-
-    delay_ns = kernel_delay + buf_delay;
-
-    buffer->time_stamp = tstamp;
-    buffer->delay_ns = delay_ns;
-    Log::Verbose() << "get_capture_delay time_stamp = [" << buffer->time_stamp.tv_sec
-                   << "].[" << buffer->time_stamp.tv_nsec << "], delay_ns: [" << buffer->delay_ns
-                   << "], kernel_delay:[" << kernel_delay << "], buf_delay:[" << buf_delay
-                   << "], kernel_frames:[" << kernel_frames << "]";
+    // Frames available in kernel driver buffer and in the HAL buffers were captured before the
+    // hardware pointer, except the ones already matched with echo reference.
+    ssize_t halFrames = mFramesIn + mProcessingRing.getReadableFrames() -
+                        mReferenceRing.getReadableFrames();
+    captureTime = seconds_to_nanoseconds(tStamp.tv_sec) + tStamp.tv_nsec -
+                  us2ns(routeSampleSpec().convertFramesToUsec(kernelFrames)) -
+                  static_cast<nsecs_t>(halFrames) * seconds_to_nanoseconds(1) /
+                  streamSampleSpec().getSampleRate();
+    return android::OK;
 }
 
-int32_t StreamIn::updateEchoReference(ssize_t frames, struct echo_reference_itfe &reference)
+nsecs_t StreamIn::updateEchoReference(ssize_t frames, EchoReference &reference)
 {
-    struct echo_reference_buffer b;
+    nsecs_t delay = 0;
 
-    b.delay_ns = 0;
+    // Up to two regions if the free room wraps at the end of the ring
+    while (mReferenceRing.getReadableFrames() < static_cast<size_t>(frames)) {
 
-    if (mReferenceFramesIn < frames) {
-
-        if (mReferenceBufferSizeInFrames < frames) {
-
-            mReferenceBufferSizeInFrames = frames;
-            int16_t *referenceBuffer = (int16_t *)realloc(mReferenceBuffer,
-                                                          streamSampleSpec().convertFramesToBytes(
-                                                              mReferenceBufferSizeInFrames));
-            if (referenceBuffer == NULL) {
-                Log::Error() << __FUNCTION__ << ": (frames=" << frames << "): realloc failed";
-                return android::NO_MEMORY;
-            }
-            mReferenceBuffer = referenceBuffer;
+        size_t writableFrames;
+        void *referenceBuffer = mReferenceRing.getWritePointer(writableFrames);
+        size_t referenceFrames = min(writableFrames,
+                                     frames - mReferenceRing.getReadableFrames());
+        if (referenceFrames == 0) {
+            // Ring full, the client reads more than the ring buffer of the route.
+            break;
         }
 
-        b.frame_count = frames - mReferenceFramesIn;
-        b.raw = (void *)((char *)mReferenceBuffer +
-                         streamSampleSpec().convertFramesToBytes(mReferenceFramesIn));
-
-        getCaptureDelay(&b);
-
-        if (reference.read(&reference, &b) == 0) {
-
-            mReferenceFramesIn += b.frame_count;
-        } else {
-            Log::Warning() << __FUNCTION__ << ": NOT enough frames to read ref buffer";
+        nsecs_t captureTime;
+        if (getCaptureTime(captureTime) != android::OK) {
+            captureTime = systemTime();
         }
+        if (reference.read(referenceBuffer, referenceFrames, captureTime, delay) != android::OK) {
+            Log::Warning() << __FUNCTION__ << ": could not read echo reference";
+            break;
+        }
+        mReferenceRing.commitWrite(referenceFrames);
     }
-    return b.delay_ns;
+    return delay;
 }
 
 status_t StreamIn::pushEchoReference(ssize_t frames, effect_handle_t preprocessor,
-                                     struct echo_reference_itfe &reference)
+                                     EchoReference &reference)
 {
-    /* read frames from echo reference buffer and update echo delay
-     * mReferenceFramesIn is updated with frames available in mReferenceBuffer */
-    int32_t delay_us = updateEchoReference(frames, reference) / 1000;
+    /* read frames from echo reference and update echo delay
+     * mReferenceRing is filled with the frames matching the frames to process */
+    int32_t delay_us = ns2us(updateEchoReference(frames, reference));
 
     if (preprocessor == NULL || *preprocessor == NULL) {
         return android::DEAD_OBJECT;
     }
 
-    if (mReferenceFramesIn < frames) {
-
-        frames = mReferenceFramesIn;
-    }
-
     if ((*preprocessor)->process_reverse == NULL) {
         Log::Warning() << __FUNCTION__ << ": (frames " << frames << ": process_reverse is NULL";
         return android::BAD_VALUE;
     }
 
-    audio_buffer_t buf;
+    status_t processingReturn = android::OK;
+    while (mReferenceRing.getReadableFrames() > 0 && processingReturn == android::OK) {
 
-    buf.frameCount = mReferenceFramesIn;
-    buf.s16 = mReferenceBuffer;
+        audio_buffer_t buf;
+        size_t referenceFrames;
+        buf.s16 = static_cast<int16_t *>(mReferenceRing.getReadPointer(referenceFrames));
+        buf.frameCount = referenceFrames;
 
-    status_t processingReturn = (*preprocessor)->process_reverse(preprocessor,
-                                                                 &buf,
-                                                                 NULL);
+        processingReturn = (*preprocessor)->process_reverse(preprocessor, &buf, NULL);
+        if (buf.frameCount == 0) {
+            break;
+        }
+        mEchoDelayEstimator.pushReference(buf.s16, buf.frameCount);
+        // Remaining frames are kept in the ring for the next process
+        mReferenceRing.consume(buf.frameCount);
+    }
     setPreprocessorEchoDelay(preprocessor, delay_us);
-    mReferenceFramesIn -= buf.frameCount;
 
-    if (mReferenceFramesIn > 0) {
-
-        memcpy(mReferenceBuffer,
-               (char *)mReferenceBuffer + streamSampleSpec().convertFramesToBytes(buf.frameCount),
-               streamSampleSpec().convertFramesToBytes(mReferenceFramesIn));
+    nsecs_t pathDelay;
+    if (mEchoDelayEstimator.getConvergedDelay(pathDelay)) {
+        // Residual delay of the echo, on top of the path delay already applied to the reference.
+        mParent->setEchoPathDelay(reference, reference.getPathDelay() + pathDelay);
     }
 
     return processingReturn;
@@ -790,26 +992,4 @@ status_t StreamIn::setPreprocessorEchoDelay(effect_handle_t effect, int32_t dela
     return setPreprocessorParam(effect, *param);
 }
 
-status_t StreamIn::allocateProcessingMemory(ssize_t frames)
-{
-    mProcessingBufferSizeInFrames = frames;
-
-    int16_t *processingBuffer = (int16_t *)realloc(mProcessingBuffer,
-                                                   streamSampleSpec().convertFramesToBytes(
-                                                       mProcessingBufferSizeInFrames));
-    if (processingBuffer == NULL) {
-        Log::Error() << __FUNCTION__ << ": (frames=" << frames
-                     << "): realloc failed errno = " << strerror(errno) << "!";
-        return android::NO_MEMORY;
-    }
-    mProcessingBuffer = processingBuffer;
-    Log::Debug() << __FUNCTION__ << ": (frames=" << frames
-                 << "): mProcessingBuffer=" << mProcessingBuffer
-                 << " size extended to " << mProcessingBufferSizeInFrames
-                 << " frames (i.e. "
-                 << streamSampleSpec().convertFramesToBytes(mProcessingBufferSizeInFrames)
-                 << " bytes)";
-    return android::OK;
-}
-
 } // namespace intel_audio
@@ -15,10 +15,15 @@
  */
 #pragma once
 
+#include "CapturePrefetcher.hpp"
+#include "EchoDelayEstimator.hpp"
 #include "Device.hpp"
 #include "Stream.hpp"
 #include <StreamInterface.hpp>
+#include <FrameRing.hpp>
+#include <VirtualClock.hpp>
 #include <media/AudioBufferProvider.h>
+#include <atomic>
 #include <vector>
 #include <list>
 
@@ -26,7 +31,8 @@ namespace intel_audio
 {
 
 class StreamIn : public StreamInInterface, public Stream,
-                 public android::AudioBufferProvider
+                 public android::AudioBufferProvider,
+                 private CapturePrefetcher::Source
 {
 private:
     typedef std::list<effect_handle_t>::iterator AudioEffectsListIterator;
@@ -45,8 +51,15 @@ public:
     virtual int setGain(float /* gain */) { return android::OK; }
     virtual android::status_t read(void *buffer, size_t &bytes);
     virtual uint32_t getInputFramesLost() const;
+    virtual android::status_t getCapturePosition(int64_t &frames, int64_t &time) const;
     virtual android::status_t setDevice(audio_devices_t device);
 
+    /**
+     * Stops the capture prefetch if running before entering standby.
+     * From StreamInterface, called from the client thread.
+     */
+    virtual android::status_t standby();
+
     // From AudioBufferProvider
     virtual android::status_t getNextBuffer(android::AudioBufferProvider::Buffer *buffer,
                                             int64_t presentationTimeStamp = kInvalidPTS);
@@ -77,6 +90,43 @@ public:
 
     virtual bool isMuted() const { return false; }
 
+    /**
+     * Keeps capturing the latest frames in the background, without any client, for a hotword
+     * stream to be served the audio captured before it was opened. The stream is started to hold
+     * its route as long as pre-rolling.
+     *
+     * @param[in] durationMs duration of the latest frames kept, in milliseconds.
+     *
+     * @return OK if started, error code otherwise.
+     */
+    android::status_t startPreroll(uint32_t durationMs);
+
+    /**
+     * Stops pre-rolling and releases the route.
+     * Shall not be called with the stream lock held.
+     */
+    void stopPreroll();
+
+    /**
+     * Serves the reads of this stream from a pre-rolling stream rather than from a route of its
+     * own: the latest frames kept by the pre-roll first, then the frames captured since, with no
+     * routing latency. Both streams shall have the same sample specification.
+     * This function is non-reetrant, intended to be called by the HW device before any read.
+     *
+     * @param[in] preroll stream started with startPreroll, NULL to capture from a route again.
+     */
+    void setPrerollSource(StreamIn *preroll) { mPrerollSource = preroll; }
+
+    /**
+     * Serves the reads of this stream from the frames played by an output stream rather than from
+     * a route: the stream is paced by a virtual clock at its own rate, and the frames rendered
+     * during each read are converted from the output sample specification.
+     * This function is non-reetrant, intended to be called by the HW device before any read.
+     *
+     * @param[in] loopback fed by the output stream, NULL to capture from a route again.
+     */
+    void setLoopback(EchoReference *loopback) { mLoopback = loopback; }
+
 protected:
     /**
      * Callback of route attachement called by the stream lib. (and so route manager).
@@ -97,6 +147,45 @@ protected:
 private:
     android::status_t readHwFrames(void *buffer, size_t frames);
 
+    /**
+     * Reads frames from the audio device on behalf of the prefetch thread, with the stream lock
+     * held for the duration of the read. When pre-rolling, the device recovery is executed from
+     * the prefetch thread as there is no client to do so.
+     * From CapturePrefetcher::Source.
+     */
+    virtual android::status_t readPrefetchFrames(void *buffer, size_t frames, size_t &framesRead);
+
+    /**
+     * Starts the prefetch thread, with a period of the route and a depth of
+     * mPrefetchDepthFactor ring buffers of the route.
+     *
+     * @return OK if started, error code otherwise, in which case the capture is synchronous.
+     */
+    android::status_t startPrefetch();
+
+    /**
+     * Reads frames prefetched, waiting for them at most the duration of the request and a period.
+     * Missing frames are replaced by silence.
+     *
+     * @param[out] buffer memory in which it will copy the frames.
+     * @param[in] frames requested frames to read.
+     * @param[out] capturedFrames frames actually prefetched, the others being silence.
+     *
+     * @return OK if successful, error code reported by the prefetch thread otherwise.
+     */
+    android::status_t readPrefetchedFrames(void *buffer, size_t frames, size_t &capturedFrames);
+
+    /**
+     * Reads the frames rendered by the output stream of the loopback while the virtual clock
+     * captures them, waiting until their capture is complete.
+     *
+     * @param[out] buffer memory in which it will copy the frames.
+     * @param[in] frames requested frames to read.
+     *
+     * @return OK if successful, error code otherwise.
+     */
+    android::status_t readLoopbackFrames(void *buffer, size_t frames);
+
     /**
      * Performs the removal of an effect.
      * It removes the effect from the stream list of requested effects
@@ -117,7 +206,7 @@ private:
      * @return status_t OK upon succes, error code otherwise.
      */
     android::status_t addSwAudioEffectL(effect_handle_t effect,
-                                        struct echo_reference_itfe *reference = NULL);
+                                        EchoReference *reference = NULL);
 
     /**
      * Retrieve audio effect name from effect handle.
@@ -165,10 +254,10 @@ private:
     {
     public:
         effect_handle_t mPreprocessor;
-        struct echo_reference_itfe *mEchoReference;
+        EchoReference *mEchoReference;
         AudioEffectHandle()
             : mPreprocessor(NULL), mEchoReference(NULL) {}
-        AudioEffectHandle(effect_handle_t effect, struct echo_reference_itfe *reference)
+        AudioEffectHandle(effect_handle_t effect, EchoReference *reference)
             : mPreprocessor(effect), mEchoReference(reference) {}
         ~AudioEffectHandle() {}
     };
@@ -187,12 +276,6 @@ private:
         }
     };
 
-    /**
-     * Reset the amount of input frames lost in the audio driver since the last call of
-     * getInputFramesLost.
-     */
-    void resetFramesLost();
-
     /**
      * Read audio frames into the buffer.
      *
@@ -210,20 +293,13 @@ private:
     void freeAllocatedBuffers();
 
     /**
-     * Allocate memory to process a certain amount of frames.
-     *
-     * @param[in] frames number of frame that we may process.
-     *
-     * @return OK if successful allocation, error code otherwise.
-     */
-    android::status_t allocateProcessingMemory(ssize_t frames);
-
-    /**
-     * Allocate the buffer in which it reads the samples from the audio device.
+     * Allocate the buffers of the capture path for the worst case, i.e. the buffer in which it
+     * reads the samples from the audio device and the rings feeding the effects. Memory only
+     * grows, so that a new routing does not reallocate.
      *
      * @return OK if successful allocation, error code otherwise.
      */
-    inline android::status_t allocateHwBuffer();
+    android::status_t allocateCaptureBuffers();
 
     /**
      * Process audio frames into the buffer.
@@ -237,18 +313,15 @@ private:
     android::status_t processFrames(void *buffer, ssize_t frames, ssize_t *processedFrames);
 
     /**
-     * Process audio frames into the buffer.
+     * Process the frames of the processing ring into the buffer, region by region of the ring.
      *
      * @param[out] buffer memory in which it will copy the processed frames.
      * @param[in] frames requested frames to read.
-     * @param[out] processed_frames number of frames processed.
-     * @param[out] processing_frames_in remaining frames to process.
+     * @param[in,out] processedFrames number of frames processed.
      *
      * @return 0 if success, negative error code otherwise.
      */
-    int doProcessFrames(const void *buffer, ssize_t frames,
-                        ssize_t *processed_frames,
-                        ssize_t *processing_frames_in);
+    int doProcessFrames(const void *buffer, ssize_t frames, ssize_t *processedFrames);
 
     /**
      * Read frames from echo reference buffer and update echo delay.
@@ -260,7 +333,7 @@ private:
      * @return OK if successful operation, error code otherwise.
      */
     android::status_t pushEchoReference(ssize_t frames, effect_handle_t preprocessor,
-                                        echo_reference_itfe &reference);
+                                        EchoReference &reference);
 
     /**
      * Update the echo reference with the frames read from the audio device.
@@ -268,9 +341,9 @@ private:
      * @param[in] frames number of frames ready to process by AEC.
      * @param[in] reference echo reference handle.
      *
-     * @return 0 if successful operation, error code otherwise.
+     * @return delay between the render of the reference and its capture, in nanoseconds.
      */
-    int32_t updateEchoReference(ssize_t frames, struct echo_reference_itfe &reference);
+    nsecs_t updateEchoReference(ssize_t frames, EchoReference &reference);
 
     /**
      * Set preprocessor echo delay.
@@ -293,61 +366,72 @@ private:
     android::status_t setPreprocessorParam(effect_handle_t effect, effect_param_t &param);
 
     /**
-     * Get the capture delay.
-     * It computes the time between the data were read and retrieved and sets the value in the
-     * echo reference structure.
+     * Get the capture time of the first frame of the processing buffer without echo reference
+     * yet, from the timestamp of the hardware pointer.
      *
-     * @param[in,out] buffer echo reference structure.
-     */
-    void getCaptureDelay(struct echo_reference_buffer *buffer);
-
-    /**
-     * amount of input frames lost in the audio driver (i.e. not provided on time to client).
+     * @param[out] captureTime monotonic time, in nanoseconds.
+     *
+     * @return OK if successful operation, error code otherwise.
      */
-    unsigned int mFramesLost;
+    android::status_t getCaptureTime(nsecs_t &captureTime);
 
     ssize_t mFramesIn; /**< frames available in stream input buffer. */
 
     /**
-     * This variable represents the number of frames of in mProcessingBuffer.
+     * Number of audio frames captured and read by AudioFlinger, silence inserted on a prefetch
+     * timeout excluded. Written by the capture thread, read by the position queries.
      */
-    ssize_t mProcessingFramesIn;
+    std::atomic<uint64_t> mFramesRead;
 
-    /**
-     * This variable is a dynamic buffer and contains raw data read from input device.
-     * It is used as input buffer before application of SW accoustics effects.
-     */
-    int16_t *mProcessingBuffer;
+    /** Frames held by mProcessingRing, published by the capture thread for the position queries. */
+    std::atomic<size_t> mProcessingRingFrames;
 
     /**
-     * This variable represents the size in frames of in mProcessingBuffer.
+     * Frames read from input device, converted and not consumed yet by the SW accoustics effects.
+     * Sized upon routing, never compacted.
      */
-    ssize_t mProcessingBufferSizeInFrames;
+    FrameRing mProcessingRing;
 
     /**
-     * This variable represents the number of frames of in mReferenceBuffer.
+     * Frames read from AudioEffectHandle::mEchoReference and not consumed yet by the AEC.
+     * Sized upon routing, never compacted.
      */
-    ssize_t mReferenceFramesIn;
+    FrameRing mReferenceRing;
 
-    /**
-     * This variable is a dynamic buffer and contains the data used as reference for AEC and
-     * which are read from AudioEffectHandle::mEchoReference.
-     */
-    int16_t *mReferenceBuffer;
+    /** Calibrates the echo path delay from the frames processed by the AEC. */
+    EchoDelayEstimator mEchoDelayEstimator;
 
     /**
-     * This variable represents the size in frames of in mReferenceBuffer.
+     * It is vector which contains the handlers to accoustics SW effects.
      */
-    ssize_t mReferenceBufferSizeInFrames;
+    std::vector<AudioEffectHandle> mPreprocessorsHandlerList;
 
     /**
-     * It is vector which contains the handlers to accoustics SW effects.
+     * Number of SW effects attached, updated with effect lock held. Read lock-free by the audio
+     * thread to skip the effect lock when no processing is required.
      */
-    std::vector<AudioEffectHandle> mPreprocessorsHandlerList;
+    std::atomic<size_t> mPreprocessorCount;
 
     char *mHwBuffer; /**< buffer in which samples are read from audio device. */
     ssize_t mHwBufferSize; /**< Size of the buffer in which samples are read from audio device. */
 
+    /**
+     * Opt-in: the audio device is drained by a dedicated thread, not by the client. Only used
+     * while no SW effect is attached, as the AEC requires the capture time of the frames it
+     * processes.
+     */
+    const bool mIsPrefetchEnabled;
+    CapturePrefetcher mPrefetcher;
+
+    bool mIsPrerolling; /**< Keeping the latest frames with no client, see startPreroll. */
+    StreamIn *mPrerollSource; /**< Pre-rolling stream serving the reads, if any. */
+
+    EchoReference *mLoopback; /**< Frames played serving the reads, if any. */
+    VirtualClock mLoopbackClock; /**< Paces the reads from the loopback. */
+
     static const std::string mHwEffectImplementor; /**< Implementor name for HW effects. */
+    static const std::string mPrefetchProp; /**< property to enable the capture prefetch. */
+    /** Depth of the prefetch, in ring buffers of the route. */
+    static const uint32_t mPrefetchDepthFactor = 2;
 };
 } // namespace intel_audio
@@ -17,13 +17,17 @@
 #define LOG_TAG "AudioStreamOut"
 
 #include "StreamOut.hpp"
+#include "EchoReference.hpp"
 #include <AudioCommsAssert.hpp>
 #include <HalAudioDump.hpp>
 #include <utilities/Log.hpp>
+#include <property/Property.hpp>
+#include <algorithm>
 
 using namespace std;
 using android::status_t;
 using audio_comms::utilities::Log;
+using audio_comms::utilities::Property;
 
 namespace intel_audio
 {
@@ -32,17 +36,44 @@ const uint32_t StreamOut::mMaxAgainRetry = 2;
 const uint32_t StreamOut::mWaitBeforeRetryUs = 10000; // 10ms
 const uint32_t StreamOut::mUsecPerMsec = 1000;
 
+const std::string StreamOut::mDeadlineWriteProp = "media.audio.output.deadline_write";
+const std::string StreamOut::mPeriodAlignedWriteProp =
+    "media.audio.output.period_aligned_write";
+const std::string StreamOut::mMaxMirrorsProp = "media.audio.output.max_mirrors";
+
 StreamOut::StreamOut(Device *parent, audio_io_handle_t handle, uint32_t flagMask, audio_devices_t devices)
     : Stream(parent, handle, flagMask),
       mFrameCount(0),
       mEchoReference(NULL),
-      mIsMuted(false)
+      mLoopback(NULL),
+      mIsMuted(false),
+      mLastPresentedFrames(0),
+      mIsDeadlineWriteEnabled(Property<bool>(mDeadlineWriteProp, false).getValue()),
+      mIsPeriodAlignedWriteEnabled(Property<bool>(mPeriodAlignedWriteProp, false).getValue()),
+      mStagedFrames(0)
 {
     setDevice(devices);
 }
 
 StreamOut::~StreamOut()
 {
+    if (mMirrors.empty()) {
+        return;
+    }
+    // Mirrors follow the state of this stream: stop it so that the routes release them before
+    // they are destroyed.
+    setStandby(true);
+    for (std::vector<StreamOutMirror *>::iterator it = mMirrors.begin(); it != mMirrors.end();
+         ++it) {
+        if ((*it)->isRouted() || (*it)->isNewRouteAvailable()) {
+            mParent->getStreamInterface().reconsiderRouting(true);
+            break;
+        }
+    }
+    for (std::vector<StreamOutMirror *>::iterator it = mMirrors.begin(); it != mMirrors.end();
+         ++it) {
+        delete *it;
+    }
 }
 
 status_t StreamOut::set(audio_config_t &config)
@@ -50,7 +81,46 @@ status_t StreamOut::set(audio_config_t &config)
     if (config.channel_mask == AUDIO_CHANNEL_NONE) {
         config.channel_mask = isDirect() ? AUDIO_CHANNEL_OUT_5POINT1 : AUDIO_CHANNEL_OUT_STEREO;
     }
-    return Stream::set(config);
+    status_t status = Stream::set(config);
+    if (status != android::OK || isDirect() || !mMirrors.empty()) {
+        return status;
+    }
+    // Created before the stream is added to the route manager, with its final configuration.
+    uint32_t defaultMaxMirrors = mDefaultMaxMirrors;
+    uint32_t maxMirrors = Property<uint32_t>(mMaxMirrorsProp, defaultMaxMirrors).getValue();
+    for (uint32_t i = 0; i < maxMirrors; i++) {
+        mMirrors.push_back(new StreamOutMirror(*this));
+    }
+    return android::OK;
+}
+
+IoStream *StreamOut::getAvailableMirror()
+{
+    for (std::vector<StreamOutMirror *>::iterator it = mMirrors.begin(); it != mMirrors.end();
+         ++it) {
+        if (!(*it)->isNewRouteAvailable()) {
+            return *it;
+        }
+    }
+    return NULL;
+}
+
+void StreamOut::writeMirrors(const void *buffer, size_t frames)
+{
+    for (std::vector<StreamOutMirror *>::iterator it = mMirrors.begin(); it != mMirrors.end();
+         ++it) {
+        (*it)->write(buffer, frames);
+    }
+}
+
+status_t StreamOut::dump(int fd) const
+{
+    status_t status = Stream::dump(fd);
+    for (std::vector<StreamOutMirror *>::const_iterator it = mMirrors.begin();
+         it != mMirrors.end(); ++it) {
+        (*it)->dump(fd);
+    }
+    return status;
 }
 
 android::status_t StreamOut::setVolume(float left, float right)
@@ -58,7 +128,7 @@ android::status_t StreamOut::setVolume(float left, float right)
     bool muteRequested = (left == 0 && right == 0);
     if (isMuted() != muteRequested) {
         muteRequested ? mute() : unMute();
-        return mParent->updateStreamsParametersSync(getRole());
+        return mParent->updateStreamsParametersSync(*this);
     }
     return android::OK;
 }
@@ -87,23 +157,40 @@ status_t StreamOut::write(const void *buffer, size_t &bytes)
     }
     setStandby(false);
 
-    mStreamLock.readLock();
     status_t status;
     const ssize_t srcFrames = streamSampleSpec().convertBytesToFrames(bytes);
-
-    // Check if the audio route is available for this stream or if the stream is muted
-    if (!isRoutedL() || isMuted()) {
+    nsecs_t ioStartTime = startIoTiming(srcFrames);
+
+    // Check if the audio route is available for this stream or if the stream is muted.
+    // Lock-free check first, the stream lock is only taken to access the audio device, and checked
+    // again once held as a route change may be pending.
+    bool isPlaying = isRouted() && !isMuted();
+    if (isPlaying) {
+        mStreamLock.readLock();
+        if (!isRoutedL()) {
+            mStreamLock.unlock();
+            isPlaying = false;
+        }
+    }
+    if (!isPlaying) {
+        // Frames are consumed by the virtual clock without the stream lock, not to block the
+        // routing thread while sleeping until the deadline of the buffer.
         Log::Warning() << __FUNCTION__ << ": Trashing " << bytes << " bytes for stream " << this
                        << (isMuted() ? ": Stream muted" : ": No route available");
-        status = generateSilence(bytes);
-        mFrameCount += srcFrames;
-        mStreamLock.unlock();
+        // Mirrors keep rendering, each on its own route, not to underrun meanwhile. Only non
+        // direct streams have mirrors, which are muted by the mixer rather than by the policy.
+        writeMirrors(buffer, srcFrames);
+        status = renderSilence(srcFrames);
+        stopIoTiming(ioStartTime, srcFrames);
         return status;
     }
+    if (mRenderClock.isRunning()) {
+        // Back on the audio device, which takes over the virtual clock.
+        mRenderClock.stop();
+    }
 
     size_t dstFrames = 0;
     char *dstBuf = NULL;
-    uint32_t retryCount = 0;
 
     pushEchoReference(buffer, srcFrames);
 
@@ -122,81 +209,140 @@ status_t StreamOut::write(const void *buffer, size_t &bytes)
 
     if (status != android::OK) {
         mStreamLock.unlock();
+        // Mirrors convert the client frames with their own conversion chain.
+        writeMirrors(buffer, srcFrames);
+        stopIoTiming(ioStartTime, 0);
         return status;
     }
-    Log::Verbose() << __FUNCTION__ << ": srcFrames=" << srcFrames << ", bytes=" << bytes
-                   << " dstFrames=" << dstFrames;
+    status = mStagingBuffer.empty() ? writeFramesL(dstBuf, dstFrames) :
+             writePeriodAlignedFramesL(dstBuf, dstFrames);
+    if (status != android::OK) {
+        mStreamLock.unlock();
+        // Failure of the route of this stream does not prevent the mirrors from rendering.
+        writeMirrors(buffer, srcFrames);
+        Log::Error() << __FUNCTION__ << ": execute device recovery";
+        mStats.onRecoveryStarted(StreamStats::RecoveryReroute);
+        setStandby(true);
+        stopIoTiming(ioStartTime, 0);
+        return android::DEAD_OBJECT;
+    }
 
-    do {
-        std::string error;
+    // Dump audio output after eventual conversions
+    // FOR DEBUG PURPOSE ONLY
+    if (getDumpObjectAfterConv() != NULL) {
+        getDumpObjectAfterConv()->dumpAudioSamples((const void *)dstBuf,
+                                                   routeSampleSpec().convertFramesToBytes(
+                                                       dstFrames),
+                                                   isOut(),
+                                                   routeSampleSpec().getSampleRate(),
+                                                   routeSampleSpec().getChannelCount(),
+                                                   "after_conversion");
+    }
+    if (mFrameCount > (std::numeric_limits<uint64_t>::max() - srcFrames)) {
+        Log::Error() << __FUNCTION__ << ": overflow detected, resetting framecount";
+        mFrameCount = 0;
+    }
+    mFrameCount += srcFrames;
+    mStreamLock.unlock();
+    writeMirrors(buffer, srcFrames);
+    stopIoTiming(ioStartTime, srcFrames);
+    handleLatencyAdaptationRequest();
+    return status;
+}
 
-        status = pcmWriteFrames(dstBuf, dstFrames, error);
+status_t StreamOut::writeFramesL(const void *buffer, size_t frames)
+{
+    if (mIsDeadlineWriteEnabled) {
+        waitForWriteDeadlineL(frames);
+    }
+    status_t status;
+    // Only filled upon error, declared once not to construct it at each retry.
+    std::string error;
+    do {
+        status = pcmWriteFrames(const_cast<void *>(buffer), frames, error);
 
         if (status < 0) {
             Log::Error() << __FUNCTION__ << ": write error: " << error
-                         << " - requested " << srcFrames
-                         << " (bytes=" << streamSampleSpec().convertFramesToBytes(srcFrames)
+                         << " - requested " << frames
+                         << " (bytes=" << routeSampleSpec().convertFramesToBytes(frames)
                          << ") frames";
 
             if (error.find(strerror(EIO)) != std::string::npos) {
                 // Dump hw registers debug file info in console
                 mParent->printPlatformFwErrorInfo();
-
-            } else if (error.find(strerror(EBADFD)) != std::string::npos) {
-                mStreamLock.unlock();
-                Log::Error() << __FUNCTION__ << ": execute device recovery";
-                setStandby(true);
-                return android::DEAD_OBJECT;
             }
             AUDIOCOMMS_ASSERT(error.find(strerror(EBADF)) == std::string::npos,
                               "Audio Device handle closed not by Audio HAL."
                               " A corruption might have happenned, investigation required");
 
-            if (++retryCount > mMaxReadWriteRetried) {
-                mStreamLock.unlock();
-                Log::Error() << __FUNCTION__ << ": Hardware not responding";
+            if (pcmRecover() != android::OK) {
                 return android::DEAD_OBJECT;
             }
-
-            // Get the number of microseconds to sleep, inferred from the number of
-            // frames to write.
-            size_t sleepUsecs = routeSampleSpec().convertFramesToUsec(dstFrames);
-
-            // Go sleeping before trying I/O operation again.
-            if (safeSleep(sleepUsecs)) {
-                // If some error arises when trying to sleep, try I/O operation anyway.
-                // Error counter will provoke the restart of mediaserver.
-                Log::Error() << __FUNCTION__ << ":  Error while calling nanosleep interface";
-            }
+            mStats.onRetry();
         }
     } while (status < 0);
+    return android::OK;
+}
 
-    Log::Verbose() << __FUNCTION__ << ": returns " << streamSampleSpec().convertFramesToBytes(
-        AudioUtils::convertSrcToDstInFrames(status, routeSampleSpec(), streamSampleSpec()));
+status_t StreamOut::writePeriodAlignedFramesL(const char *buffer, size_t frames)
+{
+    size_t periodFrames = routeSampleSpec().convertBytesToFrames(mStagingBuffer.size());
+    size_t stagedFrames = mStagedFrames;
+    status_t status;
 
-    // Dump audio output after eventual conversions
-    // FOR DEBUG PURPOSE ONLY
-    if (getDumpObjectAfterConv() != NULL) {
-        getDumpObjectAfterConv()->dumpAudioSamples((const void *)dstBuf,
-                                                   routeSampleSpec().convertFramesToBytes(
-                                                       dstFrames),
-                                                   isOut(),
-                                                   routeSampleSpec().getSampleRate(),
-                                                   routeSampleSpec().getChannelCount(),
-                                                   "after_conversion");
+    if (stagedFrames != 0) {
+        // Complete the staged period first.
+        size_t framesToStage = std::min(frames, periodFrames - stagedFrames);
+        memcpy(&mStagingBuffer[routeSampleSpec().convertFramesToBytes(stagedFrames)], buffer,
+               routeSampleSpec().convertFramesToBytes(framesToStage));
+        stagedFrames += framesToStage;
+        buffer += routeSampleSpec().convertFramesToBytes(framesToStage);
+        frames -= framesToStage;
+        if (stagedFrames < periodFrames) {
+            mStagedFrames = stagedFrames;
+            return android::OK;
+        }
+        status = writeFramesL(&mStagingBuffer[0], periodFrames);
+        if (status != android::OK) {
+            return status;
+        }
+        mStagedFrames = 0;
     }
-    if (mFrameCount > (std::numeric_limits<uint64_t>::max() - srcFrames)) {
-        Log::Error() << __FUNCTION__ << ": overflow detected, resetting framecount";
-        mFrameCount = 0;
+    size_t alignedFrames = frames - frames % periodFrames;
+    if (alignedFrames != 0) {
+        status = writeFramesL(buffer, alignedFrames);
+        if (status != android::OK) {
+            return status;
+        }
+        buffer += routeSampleSpec().convertFramesToBytes(alignedFrames);
+        frames -= alignedFrames;
     }
-    mFrameCount += srcFrames;
-    mStreamLock.unlock();
-    return status;
+    memcpy(&mStagingBuffer[0], buffer, routeSampleSpec().convertFramesToBytes(frames));
+    mStagedFrames = frames;
+    return android::OK;
 }
 
 uint32_t StreamOut::getLatency()
 {
-    return getLatencyMs();
+    AutoR lock(mStreamLock);
+    if (mStagingBuffer.empty()) {
+        return getLatencyMs();
+    }
+    // Worst case, a period is staged before reaching the ring buffer.
+    return getLatencyMs() + AudioUtils::convertUsecToMsec(
+        routeSampleSpec().convertFramesToUsec(
+            routeSampleSpec().convertBytesToFrames(mStagingBuffer.size())));
+}
+
+status_t StreamOut::standby()
+{
+    // Standby may be deferred and the route kept: drop the staged frames, as the ring buffer is.
+    mStagedFrames = 0;
+    for (std::vector<StreamOutMirror *>::iterator it = mMirrors.begin(); it != mMirrors.end();
+         ++it) {
+        (*it)->stop();
+    }
+    return Stream::standby();
 }
 
 status_t StreamOut::attachRouteL()
@@ -206,22 +352,19 @@ status_t StreamOut::attachRouteL()
 
         return status;
     }
+    mStagedFrames = 0;
+    if (mIsPeriodAlignedWriteEnabled) {
+        mStagingBuffer.resize(routeSampleSpec().convertFramesToBytes(getPeriodSizeInFrames()));
+    }
     // Need to generate silence?
     uint32_t silenceMs = getOutputSilencePrologMs();
     if (silenceMs) {
 
-        // Allocate a 1Ms buffer in stack
-        uint32_t bufferSizeInFrames = routeSampleSpec().convertUsecToframes(1 * mUsecPerMsec);
-        void *silenceBuffer = alloca(routeSampleSpec().convertFramesToBytes(bufferSizeInFrames));
-        memset(silenceBuffer, 0, routeSampleSpec().convertFramesToBytes(bufferSizeInFrames));
-
-        uint32_t msCount;
-        for (msCount = 0; msCount < silenceMs; msCount++) {
-            std::string writeError;
-            status = pcmWriteFrames(silenceBuffer, bufferSizeInFrames, writeError);
-            if (status < 0) {
-                Log::Error() << "Write error when writing silence : " << writeError;
-            }
+        std::string writeError;
+        status = pcmWriteSilence(routeSampleSpec().convertUsecToframes(silenceMs * mUsecPerMsec),
+                                 writeError);
+        if (status < 0) {
+            Log::Error() << "Write error when writing silence : " << writeError;
         }
     }
 
@@ -230,46 +373,175 @@ status_t StreamOut::attachRouteL()
 
 status_t StreamOut::detachRouteL()
 {
-    removeEchoReference(mEchoReference);
+    removeEchoReference(mEchoReference.load(std::memory_order_relaxed));
+    mStagingBuffer.clear();
+    mStagedFrames = 0;
+    if (isStarted() && !mRenderClock.isRunning()) {
+        // Route lost while playing, the virtual clock takes over from the audio device position.
+        startRenderClockL();
+    }
     return Stream::detachRouteL();
 }
 
+status_t StreamOut::renderSilence(ssize_t frames)
+{
+    if (!mRenderClock.isRunning()) {
+        AutoR lock(mStreamLock);
+        startRenderClockL();
+    }
+    nsecs_t now = systemTime();
+    if (mRenderClock.getFramesAt(now) > mFrameCount) {
+        // Client late, the virtual clock underran: restart it from now, as an audio device would.
+        mRenderClock.start(mFrameCount, now, streamSampleSpec().getSampleRate());
+    }
+    mFrameCount += frames;
+    // Absolute deadline, sleeping for the buffer duration would accumulate the client overhead.
+    VirtualClock::sleepUntil(mRenderClock.getTimeOf(mFrameCount));
+    return android::OK;
+}
+
+void StreamOut::startRenderClockL()
+{
+    uint64_t frames;
+    struct timespec timestamp;
+    nsecs_t time;
+    if (isRoutedL() && getHwPresentationPositionL(frames, timestamp) == android::OK) {
+        time = seconds_to_nanoseconds(timestamp.tv_sec) + timestamp.tv_nsec;
+    } else {
+        frames = mFrameCount;
+        time = systemTime();
+    }
+    Log::Debug() << __FUNCTION__ << ": starting virtual render clock at frame " << frames;
+    mRenderClock.start(frames, time, streamSampleSpec().getSampleRate());
+}
+
 status_t StreamOut::getRenderPosition(uint32_t &dspFrames) const
 {
-    dspFrames = mFrameCount;
+    // Frames staged, held by the conversion chain and the route have not reached the DSP yet.
+    uint64_t pipelineDelayFrames = getPipelineDelayInFrames() +
+        AudioUtils::convertSrcToDstInFrames(mStagedFrames, routeSampleSpec(), streamSampleSpec());
+    dspFrames = mFrameCount > pipelineDelayFrames ? mFrameCount - pipelineDelayFrames : 0;
     return android::OK;
 }
 
 status_t StreamOut::getPresentationPosition(uint64_t &frames, struct timespec &timestamp) const
 {
-    /** Take the stream lock in read mode to avoid the route manager unrouting this stream,
-     * and closing the audio device while dealing with it.
-     */
-    AutoR lock(mStreamLock);
-    // Check if the audio route is available for this stream (i.e. an audio device is assign to it).
-    if (!isRoutedL()) {
-        return android::INVALID_OPERATION;
+    status_t status = android::INVALID_OPERATION;
+    if (mRenderClock.isRunning()) {
+        // Muted or unrouted, frames are presented by the virtual clock.
+        nsecs_t now = systemTime();
+        frames = std::min(mRenderClock.getFramesAt(now), mFrameCount);
+        timestamp.tv_sec = nanoseconds_to_seconds(now);
+        timestamp.tv_nsec = now - seconds_to_nanoseconds(timestamp.tv_sec);
+        status = android::OK;
+    } else if (isRouted()) {
+        /** Take the stream lock in read mode to avoid the route manager unrouting this stream,
+         * and closing the audio device while dealing with it.
+         */
+        AutoR lock(mStreamLock);
+        // Check if the audio route is available for this stream (i.e. an audio device is assign
+        // to it).
+        if (isRoutedL()) {
+            status = getHwPresentationPositionL(frames, timestamp);
+        }
     }
+    if (status != android::OK) {
+        return status;
+    }
+    // Never go backward when switching between the audio device and the virtual clock.
+    uint64_t lastPresentedFrames = mLastPresentedFrames.load(std::memory_order_relaxed);
+    if (frames < lastPresentedFrames) {
+        frames = lastPresentedFrames;
+    } else {
+        mLastPresentedFrames.store(frames, std::memory_order_relaxed);
+    }
+    return android::OK;
+}
+
+status_t StreamOut::getHwPresentationPositionL(uint64_t &frames, struct timespec &timestamp) const
+{
     size_t avail;
     status_t error = getFramesAvailable(avail, timestamp);
     if (error != android::OK) {
         return error;
     }
     size_t kernelBufferSize = getBufferSizeInFrames();
-    // FIXME This calculation is incorrect if there is buffering after app processor
-    int64_t signedFrames = mFrameCount - kernelBufferSize + avail;
-    if (signedFrames < 0) {
-        Log::Error() << __FUNCTION__ << ": signedFrames=" << signedFrames
-                     << " unusual negative value, please check avail implementation within driver."
-                     << ": mFrameCount=" << mFrameCount
-                     << ": kernelBufferSize=" << kernelBufferSize
-                     << ": avail=" << avail;
+    if (avail > kernelBufferSize) {
+        Log::Error() << __FUNCTION__ << ": avail=" << avail
+                     << " unusual value, please check avail implementation within driver."
+                     << ": kernelBufferSize=" << kernelBufferSize;
         return android::BAD_VALUE;
     }
-    frames = signedFrames;
+    // Frames queued in the ring buffer and staged are in the route sample spec, whereas the frames
+    // written are in the stream sample spec.
+    uint64_t queuedFrames =
+        AudioUtils::convertSrcToDstInFrames(kernelBufferSize - avail + mStagedFrames,
+                                            routeSampleSpec(), streamSampleSpec()) +
+        getPipelineDelayInFrames();
+    // Until the pipeline is filled, no frame has been presented yet.
+    frames = mFrameCount > queuedFrames ? mFrameCount - queuedFrames : 0;
     return android::OK;
 }
 
+status_t StreamOut::getNextWriteTimestamp(int64_t &timestamp) const
+{
+    if (!isRouted()) {
+        return android::INVALID_OPERATION;
+    }
+    AutoR lock(mStreamLock);
+    if (!isRoutedL()) {
+        return android::INVALID_OPERATION;
+    }
+    nsecs_t time;
+    status_t status = getNextWriteTimeL(time);
+    if (status != android::OK) {
+        return status;
+    }
+    timestamp = ns2us(time);
+    return android::OK;
+}
+
+status_t StreamOut::getNextWriteTimeL(nsecs_t &time) const
+{
+    if (!isPcmRunningL()) {
+        // The next write starts the pcm, no hardware clock to align on yet.
+        return android::INVALID_OPERATION;
+    }
+    size_t avail;
+    struct timespec tStamp;
+    status_t status = getFramesAvailable(avail, tStamp);
+    if (status != android::OK) {
+        return status;
+    }
+    size_t kernelBufferSize = getBufferSizeInFrames();
+    size_t queuedFrames = (avail < kernelBufferSize ? kernelBufferSize - avail : 0) + mStagedFrames;
+    // Next frames written are presented once the staged frames, the ring buffer and the pipeline
+    // are drained.
+    time = seconds_to_nanoseconds(tStamp.tv_sec) + tStamp.tv_nsec +
+           us2ns(routeSampleSpec().convertFramesToUsec(queuedFrames) +
+                 streamSampleSpec().convertFramesToUsec(getPipelineDelayInFrames()));
+    return android::OK;
+}
+
+void StreamOut::waitForWriteDeadlineL(size_t frames) const
+{
+    size_t avail;
+    struct timespec tStamp;
+    if (!isPcmRunningL() || getFramesAvailable(avail, tStamp) != android::OK) {
+        // Not started yet, pcm_write will start it without blocking.
+        return;
+    }
+    // Larger writes are split by pcm_write anyway, wait for the whole ring buffer at most.
+    frames = std::min(frames, getBufferSizeInFrames());
+    if (avail >= frames) {
+        return;
+    }
+    // Room is freed at the route rate from the timestamp of the hardware pointer.
+    nsecs_t deadline = seconds_to_nanoseconds(tStamp.tv_sec) + tStamp.tv_nsec +
+                       us2ns(routeSampleSpec().convertFramesToUsec(frames - avail));
+    VirtualClock::sleepUntil(deadline);
+}
+
 status_t StreamOut::flush()
 {
     AutoR lock(mStreamLock);
@@ -277,77 +549,75 @@ status_t StreamOut::flush()
 
         return android::OK;
     }
-
+    mStagedFrames = 0;
     return pcmStop();
 }
 
-void StreamOut::addEchoReference(struct echo_reference_itfe *reference)
+void StreamOut::addEchoReference(EchoReference *reference)
 {
     AutoW lock(mPreProcEffectLock);
     Log::Debug() << __FUNCTION__ << ": (reference = " << reference
-                 << "): note mEchoReference = " << mEchoReference;
+                 << "): note mEchoReference = " << mEchoReference.load(std::memory_order_relaxed);
     // Called from a WLocked context
-    mEchoReference = reference;
+    mEchoReference.store(reference, std::memory_order_release);
 }
 
-void StreamOut::removeEchoReference(struct echo_reference_itfe *reference)
+void StreamOut::removeEchoReference(EchoReference *reference)
 {
     AutoW lock(mPreProcEffectLock);
-    if (reference == NULL || mEchoReference == NULL) {
+    EchoReference *echoReference = mEchoReference.load(std::memory_order_relaxed);
+    if (reference == NULL || echoReference == NULL) {
 
         return;
     }
     Log::Debug() << __FUNCTION__ << ": (reference = " << reference
-                 << "): note mEchoReference = " << mEchoReference;
-    if (mEchoReference == reference) {
+                 << "): note mEchoReference = " << echoReference;
+    if (echoReference == reference) {
 
-        mEchoReference->write(mEchoReference, NULL);
-        mEchoReference = NULL;
+        mEchoReference.store(NULL, std::memory_order_release);
     } else {
         Log::Error() << __FUNCTION__ << ": reference requested was not attached to this stream...";
     }
 }
 
-int StreamOut::getPlaybackDelay(ssize_t frames, struct echo_reference_buffer *buffer)
+void StreamOut::addLoopback(EchoReference *loopback)
 {
-    size_t kernelFrames;
-    int status;
-    status = getFramesAvailable(kernelFrames, buffer->time_stamp);
-    if (status != android::OK) {
+    AutoW lock(mPreProcEffectLock);
+    Log::Debug() << __FUNCTION__ << ": (loopback = " << loopback << ")";
+    mLoopback.store(loopback, std::memory_order_release);
+}
 
-        buffer->time_stamp.tv_sec = 0;
-        buffer->time_stamp.tv_nsec = 0;
-        buffer->delay_ns = 0;
-        Log::Error() << "get_playback_delay(): pcm_get_htimestamp error,"
-                     << "setting playbackTimestamp to 0";
-        return status;
+void StreamOut::removeLoopback(EchoReference *loopback)
+{
+    AutoW lock(mPreProcEffectLock);
+    if (mLoopback.load(std::memory_order_relaxed) == loopback) {
+        mLoopback.store(NULL, std::memory_order_release);
     }
-    kernelFrames = getBufferSizeInFrames() - kernelFrames;
-
-    /* adjust render time stamp with delay added by current driver buffer.
-     * Add the duration of current frame as we want the render time of the last
-     * sample being written.
-     */
-    buffer->delay_ns = streamSampleSpec().convertFramesToUsec(kernelFrames + frames);
-
-    Log::Verbose() << __FUNCTION__
-                   << ": kernel_frames=" << kernelFrames
-                   << " buffer->time_stamp.tv_sec=" << buffer->time_stamp.tv_sec << ","
-                   << "buffer->time_stamp.tv_nsec =" << buffer->time_stamp.tv_nsec
-                   << " buffer->delay_ns=" << buffer->delay_ns;
-
-    return 0;
 }
 
 void StreamOut::pushEchoReference(const void *buffer, ssize_t frames)
 {
+    if (mEchoReference.load(std::memory_order_acquire) == NULL &&
+        mLoopback.load(std::memory_order_acquire) == NULL) {
+        // Fast path: no echo reference nor loopback attached, effect lock not needed.
+        return;
+    }
     AutoR lock(mPreProcEffectLock);
-    if (mEchoReference != NULL) {
-        struct echo_reference_buffer b;
-        b.raw = (void *)buffer;
-        b.frame_count = frames;
-        getPlaybackDelay(b.frame_count, &b);
-        mEchoReference->write(mEchoReference, &b);
+    EchoReference *echoReference = mEchoReference.load(std::memory_order_relaxed);
+    EchoReference *loopback = mLoopback.load(std::memory_order_relaxed);
+    if (echoReference == NULL && loopback == NULL) {
+        return;
+    }
+    nsecs_t renderTime;
+    if (getNextWriteTimeL(renderTime) != android::OK) {
+        // Pcm started by this write, the capture side realigns on the next frames anyway.
+        renderTime = systemTime();
+    }
+    if (echoReference != NULL) {
+        echoReference->write(buffer, frames, renderTime);
+    }
+    if (loopback != NULL) {
+        loopback->write(buffer, frames, renderTime);
     }
 }
 
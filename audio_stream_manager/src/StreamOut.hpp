@@ -17,9 +17,11 @@
 
 #include "Stream.hpp"
 #include "Device.hpp"
+#include "StreamOutMirror.hpp"
 #include <StreamInterface.hpp>
+#include <VirtualClock.hpp>
+#include <vector>
 
-struct echo_reference_itfe;
 
 namespace intel_audio
 {
@@ -39,9 +41,9 @@ public:
     virtual android::status_t setVolume(float left, float right);
     virtual android::status_t write(const void *buffer, size_t &bytes);
     virtual android::status_t getRenderPosition(uint32_t &dspFrames) const;
-    /** @note API not implemented in our Audio HAL */
-    virtual android::status_t getNextWriteTimestamp(int64_t & /*ts*/) const { return android::OK; }
+    virtual android::status_t getNextWriteTimestamp(int64_t &timestamp) const;
     virtual android::status_t flush();
+    virtual android::status_t standby();
     /** @note API not implemented in our Audio HAL */
     virtual android::status_t setCallback(stream_callback_t, void *) { return android::OK; }
     /** @note API implemented in our Audio HAL only for direct streams */
@@ -52,13 +54,14 @@ public:
     virtual android::status_t drain(audio_drain_type_t) { return android::OK; }
     virtual android::status_t getPresentationPosition(uint64_t &, struct timespec &) const;
     virtual android::status_t setDevice(audio_devices_t device);
+    virtual android::status_t dump(int fd) const;
 
     /**
      * Request to provide Echo Reference.
      *
      * @param[in] echo reference structure pointer.
      */
-    void addEchoReference(struct echo_reference_itfe *reference);
+    void addEchoReference(EchoReference *reference);
 
     /**
      * Cancel the request to provide Echo Reference.
@@ -66,7 +69,22 @@ public:
      * @param[in] echo reference structure pointer.
      *
      */
-    void removeEchoReference(struct echo_reference_itfe *reference);
+    void removeEchoReference(EchoReference *reference);
+
+    /**
+     * Tees the frames played by this stream into a loopback, whatever the effects attached.
+     *
+     * @param[in] loopback read by a loopback input stream.
+     */
+    void addLoopback(EchoReference *loopback);
+
+    /**
+     * Stops teeing the frames played by this stream. Once returned, the loopback is not accessed
+     * anymore by the playback thread.
+     *
+     * @param[in] loopback previously added.
+     */
+    void removeLoopback(EchoReference *loopback);
 
     // From IoStream
     /**
@@ -86,17 +104,17 @@ public:
      */
     virtual bool isMuted() const { return mIsMuted; }
 
-    void mute()
-    {
-        AutoW lock(mStreamLock);
-        mIsMuted = true;
-    }
+    void mute() { mIsMuted = true; }
 
-    void unMute()
-    {
-        AutoW lock(mStreamLock);
-        mIsMuted = false;
-    }
+    void unMute() { mIsMuted = false; }
+
+    /**
+     * Mirrors are created upon set for non direct streams, up to the number of additional routes
+     * allowed by property.
+     *
+     * @return mirror not assigned to any route yet, NULL if none.
+     */
+    virtual IoStream *getAvailableMirror();
 
 protected:
     /**
@@ -117,7 +135,7 @@ protected:
 
 private:
     /**
-     * Push samples to echo reference.
+     * Push samples to echo reference and loopback.
      *
      * @param[in] buffer: output stream audio buffer to be appended to echo reference.
      * @param[in] frames: number of frames to be appended in echo reference.
@@ -125,26 +143,125 @@ private:
     void pushEchoReference(const void *buffer, ssize_t frames);
 
     /**
-     * Get the playback delay.
-     * Used when SW AEC effect is activated to informs at best the AEC engine of the rendering
-     * delay.
+     * Get the time at which the next frame written will be presented, once the staged frames,
+     * the ring buffer and the pipeline are drained.
+     * Must be called with stream lock held, stream routed.
+     *
+     * @param[out] time monotonic time, in nanoseconds.
+     *
+     * @return OK if successful, INVALID_OPERATION if the pcm is not running, error code otherwise.
+     */
+    android::status_t getNextWriteTimeL(nsecs_t &time) const;
+
+    /**
+     * Consumes frames that do not reach any audio device, i.e. muted or unrouted stream, at the
+     * pace of the virtual render clock. Blocks until the clock consumed all the frames written.
+     *
+     * @param[in] frames: number of frames written by the client.
+     *
+     * @return OK.
+     */
+    android::status_t renderSilence(ssize_t frames);
+
+    /**
+     * Starts the virtual render clock from the position of the audio device if available, so that
+     * the presentation position remains continuous, from the frames written otherwise.
+     * Must be called with stream lock held.
+     */
+    void startRenderClockL();
+
+    /**
+     * Get the presentation position from the audio device.
+     * Must be called with stream lock held and stream routed.
+     *
+     * @param[out] frames: frames presented to the external observer.
+     * @param[out] timestamp: time at which the frames were presented.
+     *
+     * @return OK if the audio device is running, error code otherwise.
+     */
+    android::status_t getHwPresentationPositionL(uint64_t &frames,
+                                                 struct timespec &timestamp) const;
+
+    /**
+     * Sleeps until the ring buffer has room for the frames to write, computed from the hardware
+     * timestamp, so that the write does not rely on pcm_write back-pressure to block.
+     * Must be called with stream lock held.
+     *
+     * @param[in] frames: number of frames to write, in the route sample specification.
+     */
+    void waitForWriteDeadlineL(size_t frames) const;
+
+    /**
+     * Writes frames to the audio device, retrying upon failure after recovering the device.
+     * Must be called with stream lock held.
      *
-     * @param[in] frames: frames pushed in the echo reference.
-     * @param[out] buffer: echo reference buffer given to set the timestamp when echo reference
-     *                     is provided.
+     * @param[in] buffer: frames to write, in the route sample specification.
+     * @param[in] frames: number of frames to write.
      *
-     * @return 0 if success, error code otherwise.
+     * @return OK if written, DEAD_OBJECT if the device could not be recovered.
      */
-    int getPlaybackDelay(ssize_t frames, struct echo_reference_buffer *buffer);
+    android::status_t writeFramesL(const void *buffer, size_t frames);
+
+    /**
+     * Writes whole periods to the audio device, staging the remaining frames until the next write
+     * completes their period.
+     * Must be called with stream lock held.
+     *
+     * @param[in] buffer: frames to write, in the route sample specification.
+     * @param[in] frames: number of frames to write.
+     *
+     * @return OK if written or staged, DEAD_OBJECT if the device could not be recovered.
+     */
+    android::status_t writePeriodAlignedFramesL(const char *buffer, size_t frames);
+
+    /**
+     * Writes frames to the routes of the mirrors, without the stream lock held. Mirrors never
+     * block, so that the device clock of this stream keeps pacing the writes.
+     *
+     * @param[in] buffer: frames written by the client, in the stream sample specification.
+     * @param[in] frames: number of frames to write.
+     */
+    void writeMirrors(const void *buffer, size_t frames);
 
     uint64_t mFrameCount; /**< number of audio frames written by AudioFlinger. */
 
-    struct echo_reference_itfe *mEchoReference; /**< echo reference pointer, for SW AEC effect. */
+    /**
+     * Echo reference pointer, for SW AEC effect.
+     * Updated with effect lock held, read lock-free by the audio thread to skip the effect lock
+     * when no echo reference is attached.
+     */
+    std::atomic<EchoReference *> mEchoReference;
+
+    /** Loopback of the frames played, updated and read as the echo reference. */
+    std::atomic<EchoReference *> mLoopback;
 
     static const uint32_t mMaxAgainRetry; /**< Max retry for write operations before recovering. */
     static const uint32_t mWaitBeforeRetryUs; /**< Time to wait before retrial. */
     static const uint32_t mUsecPerMsec; /**< time conversion constant. */
+    static const std::string mDeadlineWriteProp; /**< property to enable deadline writes. */
+    static const std::string mPeriodAlignedWriteProp; /**< property to enable period alignment. */
+    static const std::string mMaxMirrorsProp; /**< property to limit the fan-out of the stream. */
+    static const uint32_t mDefaultMaxMirrors = 1; /**< routes in addition to the stream's own. */
+
+    const bool mIsDeadlineWriteEnabled; /**< write waits for the deadline of the next period. */
+
+    const bool mIsPeriodAlignedWriteEnabled; /**< audio device only receives whole periods. */
+
+    /** Period staged until complete, allocated upon routing, in the route sample spec. */
+    std::vector<char> mStagingBuffer;
+
+    /** Frames staged in the staging buffer, not written yet to the audio device. */
+    std::atomic<size_t> mStagedFrames;
+
+    std::atomic<bool> mIsMuted; /**< muted by the policy, read lock-free by the audio thread. */
+
+    /** Paces and timestamps the frames written while the stream is muted or not routed. */
+    VirtualClock mRenderClock;
+
+    /** Last presentation position reported, which shall never go backward. */
+    mutable std::atomic<uint64_t> mLastPresentedFrames;
 
-    bool mIsMuted;
+    /** Render the frames on additional routes, only resized upon set and destruction. */
+    std::vector<StreamOutMirror *> mMirrors;
 };
 } // namespace intel_audio
@@ -0,0 +1,129 @@
+/*
+ * Copyright (C) 2015 Intel Corporation
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#define LOG_TAG "AudioStreamOutMirror"
+
+#include "StreamOutMirror.hpp"
+#include <AudioConversion.hpp>
+#include <IStreamRoute.hpp>
+#include <utilities/Log.hpp>
+#include <utils/Timers.h>
+#include <stdio.h>
+#include <string>
+
+using android::status_t;
+using audio_comms::utilities::Log;
+
+namespace intel_audio
+{
+
+StreamOutMirror::StreamOutMirror(const IoStream &source)
+    : mSource(source),
+      mAudioConversion(new AudioConversion),
+      mRetryTime(0),
+      mDroppedFrameCount(0)
+{
+    mSampleSpec = source.streamSampleSpec();
+}
+
+StreamOutMirror::~StreamOutMirror()
+{
+    delete mAudioConversion;
+}
+
+status_t StreamOutMirror::attachRouteL()
+{
+    TinyAlsaIoStream::attachRouteL();
+    mRetryTime = 0;
+
+    status_t err = mAudioConversion->configure(streamSampleSpec(), routeSampleSpec());
+    if (err != android::OK) {
+        Log::Error() << __FUNCTION__
+                     << ": could not initialize audio conversion chain (err=" << err << ")";
+        return err;
+    }
+    // Conversion chain allocated once for all, not from the audio thread.
+    err = mAudioConversion->reserve(getBufferSizeInFrames());
+    if (err != android::OK) {
+        Log::Error() << __FUNCTION__
+                     << ": could not allocate audio conversion chain (err=" << err << ")";
+    }
+    return err;
+}
+
+void StreamOutMirror::write(const void *buffer, size_t frames)
+{
+    if (!isRouted()) {
+        return;
+    }
+    AutoR lock(mStreamLock);
+    if (!isRoutedL()) {
+        return;
+    }
+    void *dstBuf = NULL;
+    size_t dstFrames = 0;
+    if (mAudioConversion->convert(buffer, &dstBuf, frames, &dstFrames) != android::OK) {
+        mDroppedFrameCount += frames;
+        return;
+    }
+    nsecs_t now = systemTime();
+    if (now < mRetryTime) {
+        mDroppedFrameCount += dstFrames;
+        return;
+    }
+    // Never blocks on the mirror device, so that its clock does not pace the mirrored stream.
+    size_t writableFrames = getWritableFramesL();
+    if (writableFrames < dstFrames) {
+        mDroppedFrameCount += dstFrames - writableFrames;
+        dstFrames = writableFrames;
+    }
+    if (dstFrames == 0) {
+        return;
+    }
+    std::string error;
+    if (pcmWriteFrames(dstBuf, dstFrames, error) == android::OK) {
+        return;
+    }
+    Log::Error() << __FUNCTION__ << ": write error on route "
+                 << getCurrentStreamRoute()->getName() << ": " << error;
+    // Not recovered from the audio thread: skipped for a buffer duration, the next write
+    // prepares the device again.
+    mDroppedFrameCount += dstFrames;
+    mRetryTime = now + us2ns(routeSampleSpec().convertFramesToUsec(getBufferSizeInFrames()));
+}
+
+void StreamOutMirror::stop()
+{
+    AutoR lock(mStreamLock);
+    mRetryTime = 0;
+    if (isRoutedL()) {
+        pcmStop();
+    }
+}
+
+void StreamOutMirror::dump(int fd) const
+{
+    AutoR lock(mStreamLock);
+    if (!isRoutedL()) {
+        return;
+    }
+    dprintf(fd, "    mirror route: %s, conversion: %s, dropped frames: %llu\n",
+            getCurrentStreamRoute()->getName().c_str(),
+            mAudioConversion->getConversionPlan().c_str(),
+            static_cast<unsigned long long>(mDroppedFrameCount.load(std::memory_order_relaxed)));
+}
+
+} // namespace intel_audio
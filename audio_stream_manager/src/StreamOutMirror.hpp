@@ -0,0 +1,103 @@
+/*
+ * Copyright (C) 2015 Intel Corporation
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#pragma once
+
+#include <TinyAlsaIoStream.hpp>
+#include <NonCopyable.hpp>
+#include <utils/Errors.h>
+#include <utils/Timers.h>
+#include <atomic>
+
+namespace intel_audio
+{
+
+class AudioConversion;
+
+/**
+ * Renders the frames of an output stream on an additional stream route, with its own conversion
+ * chain and audio device, so that a single output stream may be routed to several routes at once
+ * (fan-out) without the duplicating thread of AudioFlinger.
+ * The attributes considered by the route manager are the ones of the mirrored stream.
+ */
+class StreamOutMirror : public TinyAlsaIoStream, private audio_comms::utilities::NonCopyable
+{
+public:
+    /**
+     * @param[in] source stream whose frames are rendered by this mirror, already configured.
+     */
+    explicit StreamOutMirror(const IoStream &source);
+
+    virtual ~StreamOutMirror();
+
+    // From IoStream
+    virtual bool isOut() const { return true; }
+
+    virtual audio_port_role_t getRole() const { return AUDIO_PORT_ROLE_SOURCE; }
+
+    virtual bool isStarted() const { return mSource.isStarted(); }
+
+    virtual bool isRoutedByPolicy() const { return mSource.isRoutedByPolicy(); }
+
+    virtual uint32_t getFlagMask() const { return mSource.getFlagMask(); }
+
+    virtual uint32_t getUseCaseMask() const { return mSource.getUseCaseMask(); }
+
+    virtual const IoStream *getMirroredStream() const { return &mSource; }
+
+    /**
+     * Converts and writes frames of the mirrored stream to the audio device, if routed.
+     * Never blocks: the frames exceeding the room left in the device buffer are dropped, as are the
+     * frames written within a buffer duration after a write error. Errors are never reported to
+     * the mirrored stream, so that a failing or slower route does not delay the other ones.
+     *
+     * @param[in] buffer frames in the sample specification of the mirrored stream.
+     * @param[in] frames number of frames to write.
+     */
+    void write(const void *buffer, size_t frames);
+
+    /**
+     * Stops the audio device if routed, upon standby of the mirrored stream, which may be deferred
+     * with the route kept. Writes are no longer skipped after a previous error.
+     */
+    void stop();
+
+    /**
+     * Dumps the route and the conversion chain of the mirror.
+     *
+     * @param[in] fd file descriptor used as dump output.
+     */
+    void dump(int fd) const;
+
+protected:
+    /**
+     * Configures the conversion chain from the mirrored stream to the new route.
+     *
+     * @return OK if attached successfully to the route, error code otherwise.
+     */
+    virtual android::status_t attachRouteL();
+
+private:
+    const IoStream &mSource; /**< Stream whose frames are rendered by this mirror. */
+
+    AudioConversion *mAudioConversion; /**< Conversion from the mirrored stream to the route. */
+
+    nsecs_t mRetryTime; /**< Writes skipped until then after an error, audio thread only. */
+
+    /** Frames dropped upon errors or lack of room in the device buffer, read by the dump. */
+    std::atomic<uint64_t> mDroppedFrameCount;
+};
+
+} // namespace intel_audio
@@ -164,6 +164,17 @@ TEST_F(AudioHalTest, audioRecordingBufferSize)
     ASSERT_EQ(48u * 20 * 2 * 2, getDevice()->getInputBufferSize(config));
 }
 
+TEST_F(AudioHalTest, audioRecordingBufferSizeHighResolution)
+{
+    audio_config_t config;
+    // Expected size is the 20 ms period of the capture route * 48000 * frame size
+    setConfig(48000, AUDIO_CHANNEL_IN_STEREO, AUDIO_FORMAT_PCM_FLOAT, config);
+    EXPECT_EQ(48u * 20 * 2 * 4, getDevice()->getInputBufferSize(config));
+
+    setConfig(48000, AUDIO_CHANNEL_IN_STEREO, AUDIO_FORMAT_PCM_8_24_BIT, config);
+    EXPECT_EQ(48u * 20 * 2 * 4, getDevice()->getInputBufferSize(config));
+}
+
 TEST_P(AudioHalInputStreamSupportedInputSourceTest, inputSource)
 {
     audio_config_t config;
@@ -0,0 +1,138 @@
+/*
+ * Copyright (C) 2015 Intel Corporation
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <MaskAggregator.hpp>
+#include <RoutingParameters.hpp>
+#include <gtest/gtest.h>
+
+namespace intel_audio
+{
+
+TEST(MaskAggregator, Empty)
+{
+    MaskAggregator aggregator;
+    EXPECT_EQ(0u, aggregator.getMask());
+    EXPECT_FALSE(aggregator.add(0));
+    EXPECT_FALSE(aggregator.remove(0));
+    EXPECT_EQ(0u, aggregator.getMask());
+}
+
+TEST(MaskAggregator, OverlappingContributions)
+{
+    MaskAggregator aggregator;
+    EXPECT_TRUE(aggregator.add(0x3));
+    EXPECT_EQ(0x3u, aggregator.getMask());
+
+    // Bit 1 already contributed, bit 2 new.
+    EXPECT_TRUE(aggregator.add(0x6));
+    EXPECT_EQ(0x7u, aggregator.getMask());
+
+    // Bits already contributed only.
+    EXPECT_FALSE(aggregator.add(0x5));
+    EXPECT_EQ(0x7u, aggregator.getMask());
+
+    // Bit 0 still contributed by the third mask, bit 1 by the second one.
+    EXPECT_FALSE(aggregator.remove(0x3));
+    EXPECT_EQ(0x7u, aggregator.getMask());
+
+    // Bit 1 no longer contributed, bit 2 still by the third mask.
+    EXPECT_TRUE(aggregator.remove(0x6));
+    EXPECT_EQ(0x5u, aggregator.getMask());
+
+    EXPECT_TRUE(aggregator.remove(0x5));
+    EXPECT_EQ(0u, aggregator.getMask());
+}
+
+TEST(MaskAggregator, SameMaskContributedTwice)
+{
+    MaskAggregator aggregator;
+    EXPECT_TRUE(aggregator.add(0x80000001));
+    EXPECT_FALSE(aggregator.add(0x80000001));
+
+    EXPECT_FALSE(aggregator.remove(0x80000001));
+    EXPECT_EQ(0x80000001u, aggregator.getMask());
+    EXPECT_TRUE(aggregator.remove(0x80000001));
+    EXPECT_EQ(0u, aggregator.getMask());
+}
+
+TEST(MaskAggregatorDeathTest, RemoveMaskNotAdded)
+{
+    MaskAggregator aggregator;
+    aggregator.add(0x1);
+    EXPECT_DEATH(aggregator.remove(0x2), "");
+}
+
+/**
+ * Routing parameters of a direction are not applied again, i.e. the routing is not reconsidered,
+ * as long as the aggregation of the masks of the streams is unchanged.
+ */
+TEST(RoutingParameters, AppliedSkip)
+{
+    MaskAggregator devices;
+    RoutingParameters applied;
+    RoutingParameters parameters;
+    parameters.streams[Direction::Output].isSet = true;
+    devices.add(0x2);
+    parameters.streams[Direction::Output].devices = devices.getMask();
+
+    // Nothing applied yet.
+    EXPECT_FALSE(parameters.isApplied(Direction::Output, applied));
+    applied.setApplied(parameters);
+    EXPECT_TRUE(parameters.isApplied(Direction::Output, applied));
+
+    // Another stream on the same device, aggregation unchanged.
+    EXPECT_FALSE(devices.add(0x2));
+    parameters.streams[Direction::Output].devices = devices.getMask();
+    EXPECT_TRUE(parameters.isApplied(Direction::Output, applied));
+
+    // Input direction never applied.
+    EXPECT_FALSE(parameters.isApplied(Direction::Input, applied));
+
+    // Mode applied along with the output streams.
+    parameters.mode = 2;
+    EXPECT_FALSE(parameters.isApplied(Direction::Output, applied));
+    applied.setApplied(parameters);
+    EXPECT_TRUE(parameters.isApplied(Direction::Output, applied));
+
+    // New device contributed.
+    EXPECT_TRUE(devices.add(0x4));
+    parameters.streams[Direction::Output].devices = devices.getMask();
+    EXPECT_FALSE(parameters.isApplied(Direction::Output, applied));
+}
+
+TEST(RoutingParameters, AppliedPerDirection)
+{
+    RoutingParameters applied;
+    RoutingParameters input;
+    input.streams[Direction::Input].isSet = true;
+    input.streams[Direction::Input].devices = 0x4;
+    input.band = 1;
+    applied.setApplied(input);
+
+    // Only the directions set are recorded.
+    RoutingParameters output;
+    output.streams[Direction::Output].isSet = true;
+    output.mode = 3;
+    applied.setApplied(output);
+    EXPECT_TRUE(input.isApplied(Direction::Input, applied));
+    EXPECT_TRUE(output.isApplied(Direction::Output, applied));
+
+    // Band and pre processing applied along with the input streams.
+    input.preProcRequested = 0x1;
+    EXPECT_FALSE(input.isApplied(Direction::Input, applied));
+}
+
+} // namespace intel_audio
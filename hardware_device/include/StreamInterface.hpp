@@ -307,6 +307,17 @@ public:
      *         last call of this function.
      */
     virtual uint32_t getInputFramesLost() const = 0;
+
+    /** Get recent count of the number of audio frames received from the audio device and the
+     * time at which the last of them was captured.
+     * Frames still buffered within the HAL, i.e. not returned by read yet, are counted.
+     * The count is not reset to zero when input enters standby.
+     *
+     * @param[out] frames count of the number of audio frames received.
+     * @param[out] time value of CLOCK_MONOTONIC, in nanoseconds, as of this capture count.
+     * @return OK if succeed, error code else, e.g. if not capturing.
+     */
+    virtual android::status_t getCapturePosition(int64_t &frames, int64_t &time) const = 0;
 };
 
 } // namespace intel_audio
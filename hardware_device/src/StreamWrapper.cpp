@@ -124,6 +124,7 @@ InputStreamWrapper::InputStreamWrapper(StreamInInterface *cppInputStream)
     stream.set_gain = wrapSetGain;
     stream.read = wrapRead;
     stream.get_input_frames_lost = wrapGetInputFramesLost;
+    stream.get_capture_position = wrapGetCapturePosition;
 }
 
 int InputStreamWrapper::wrapSetGain(audio_stream_in_t *stream, float gain)
@@ -142,5 +143,14 @@ uint32_t InputStreamWrapper::wrapGetInputFramesLost(audio_stream_in_t *stream)
     return getCppStream(stream).getInputFramesLost();
 }
 
+int InputStreamWrapper::wrapGetCapturePosition(const audio_stream_in_t *stream,
+                                               int64_t *frames, int64_t *time)
+{
+    if (frames == NULL || time == NULL) {
+        return -EINVAL;
+    }
+    return static_cast<int>(getCppStream(stream).getCapturePosition(*frames, *time));
+}
+
 
 } // namespace intel_audio
@@ -279,3 +279,31 @@ TEST_F(DeviceTest, OutputStreamErrorHandling)
 
     mDevice->close_output_stream(mDevice, stream_out);
 }
+
+TEST_F(DeviceTest, InputStreamErrorHandling)
+{
+    audio_io_handle_t handle = static_cast<audio_io_handle_t>(0);
+    audio_devices_t devices = static_cast<audio_devices_t>(0);
+    audio_config_t config;
+    audio_stream_in *stream_in;
+    string deviceAddress("myCard:0,myDevice:1");
+
+    ASSERT_EQ(mDevice->open_input_stream(mDevice, handle, devices, &config, &stream_in,
+                                         AUDIO_INPUT_FLAG_NONE, deviceAddress.c_str(),
+                                         AUDIO_SOURCE_MIC), 0);
+
+    /** Check get capture position with NULL pointer error handling. */
+    int64_t *nullFrames = NULL;
+    int64_t *nullTime = NULL;
+    int64_t validFrames;
+    int64_t validTime;
+    EXPECT_EQ(stream_in->get_capture_position(stream_in, &validFrames, nullTime),
+              android::BAD_VALUE);
+    EXPECT_EQ(stream_in->get_capture_position(stream_in, nullFrames, &validTime),
+              android::BAD_VALUE);
+    EXPECT_EQ(stream_in->get_capture_position(stream_in, nullFrames, nullTime),
+              android::BAD_VALUE);
+    EXPECT_EQ(stream_in->get_capture_position(stream_in, &validFrames, &validTime), android::OK);
+
+    mDevice->close_input_stream(mDevice, stream_in);
+}
@@ -93,6 +93,10 @@ public:
     virtual android::status_t setGain(float gain) { return android::OK; }
     virtual android::status_t read(void *buffer, size_t &bytes) { return android::OK; }
     virtual uint32_t getInputFramesLost() const { return 15; }
+    virtual android::status_t getCapturePosition(int64_t &frames, int64_t &time) const
+    {
+        return android::OK;
+    }
 };
 
 } // namespace intel_audio
@@ -41,6 +41,11 @@ public:
      */
     const std::string &getName() const { return mName; }
 
+    /**
+     * @return true if the criterion type is inclusive, i.e. a bitfield, false if exclusive.
+     */
+    bool isInclusive() const { return mIsInclusive; }
+
     /**
      * Adds a value pair for this criterion type to the parameter manager.
      *
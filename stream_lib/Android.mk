@@ -25,9 +25,14 @@ component_export_include_dir := \
     $(LOCAL_PATH)/include \
 
 component_src_files :=  \
+    ClockDriftEstimator.cpp \
+    FrameRing.cpp \
     IoStream.cpp \
     TinyAlsaAudioDevice.cpp \
     StreamLib.cpp \
+    StreamStats.cpp \
+    TimingHistogram.cpp \
+    VirtualClock.cpp \
     TinyAlsaIoStream.cpp
 
 component_includes_common := \
@@ -103,3 +108,29 @@ LOCAL_MODULE_TAGS := optional
 include $(OPTIONAL_QUALITY_COVERAGE_JUMPER)
 
 include $(BUILD_STATIC_LIBRARY)
+
+#######################################################################
+# Component Functional Test Host Build
+
+include $(CLEAR_VARS)
+
+LOCAL_MODULE := stream_lib_fcttest_host
+LOCAL_MODULE_OWNER := intel
+LOCAL_MODULE_TAGS := optional
+
+LOCAL_SRC_FILES := test/FrameRingTest.cpp
+LOCAL_C_INCLUDES := \
+    $(component_includes_dir_host) \
+    external/gtest/include
+LOCAL_CFLAGS := $(component_cflags)
+LOCAL_STATIC_LIBRARIES := \
+    libstream_static_host \
+    $(component_static_lib_host) \
+    libgtest_host \
+    libgtest_main_host
+
+include $(OPTIONAL_QUALITY_COVERAGE_JUMPER)
+# Cannot use $(BUILD_HOST_NATIVE_TEST) because of compilation flag
+# misalignment against gtest mk files
+
+include $(BUILD_HOST_EXECUTABLE)
@@ -0,0 +1,156 @@
+/*
+ * Copyright (C) 2013-2015 Intel Corporation
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#include "ClockDriftEstimator.hpp"
+#include <math.h>
+
+using std::memory_order_acquire;
+using std::memory_order_relaxed;
+using std::memory_order_release;
+
+namespace intel_audio
+{
+
+/** Bandwidth of the loop: lower filters more jitter, higher tracks drift changes faster. */
+static const double gBandwidthHz = 0.2;
+
+/** Prediction error beyond which the position is taken for a discontinuity. */
+static const double gMaxErrorNs = 5000000.;
+
+static const double gNsecPerSec = 1000000000.;
+
+ClockDriftEstimator::ClockDriftEstimator()
+    : mSampleRate(0),
+      mUpdateCount(0),
+      mPosition(0),
+      mTime(0),
+      mNsPerFrame(0),
+      mSequence(0),
+      mPublishedSampleRate(0),
+      mPublishedIsLocked(false),
+      mPublishedPosition(0),
+      mPublishedTime(0),
+      mPublishedNsPerFrame(0)
+{
+}
+
+void ClockDriftEstimator::reset(uint32_t sampleRate)
+{
+    mSampleRate = sampleRate;
+    mUpdateCount = 0;
+    publish();
+}
+
+void ClockDriftEstimator::restart(uint64_t position, nsecs_t time)
+{
+    mPosition = position;
+    mTime = time;
+    mNsPerFrame = gNsecPerSec / mSampleRate;
+    mUpdateCount = 1;
+}
+
+void ClockDriftEstimator::update(uint64_t position, nsecs_t time)
+{
+    if (mSampleRate == 0) {
+        return;
+    }
+    if (mUpdateCount == 0) {
+        restart(position, time);
+        publish();
+        return;
+    }
+    if (position <= mPosition) {
+        // Hardware pointer did not move, nothing to learn from this timestamp.
+        return;
+    }
+    double frames = position - mPosition;
+    double predicted = mTime + frames * mNsPerFrame;
+    double error = time - predicted;
+    if (fabs(error) > gMaxErrorNs) {
+        restart(position, time);
+        publish();
+        return;
+    }
+    // Second order loop, critically damped, coefficients adapted to the elapsed time as the
+    // positions are not received periodically.
+    double omega = 2 * M_PI * gBandwidthHz * frames * mNsPerFrame / gNsecPerSec;
+    if (omega > 1) {
+        omega = 1;
+    }
+    mTime = predicted + sqrt(2) * omega * error;
+    mNsPerFrame += omega * omega * error / frames;
+    mPosition = position;
+    if (mUpdateCount < mLockUpdateCount) {
+        mUpdateCount++;
+    }
+    publish();
+}
+
+void ClockDriftEstimator::publish()
+{
+    uint32_t sequence = mSequence.load(memory_order_relaxed);
+    mSequence.store(sequence + 1, memory_order_relaxed);
+    std::atomic_thread_fence(memory_order_release);
+    mPublishedSampleRate.store(mSampleRate, memory_order_relaxed);
+    mPublishedIsLocked.store(mUpdateCount >= mLockUpdateCount, memory_order_relaxed);
+    mPublishedPosition.store(mPosition, memory_order_relaxed);
+    mPublishedTime.store(mTime, memory_order_relaxed);
+    mPublishedNsPerFrame.store(mNsPerFrame, memory_order_relaxed);
+    mSequence.store(sequence + 2, memory_order_release);
+}
+
+void ClockDriftEstimator::read(Estimation &estimation) const
+{
+    uint32_t sequence;
+    do {
+        sequence = mSequence.load(memory_order_acquire);
+        estimation.mSampleRate = mPublishedSampleRate.load(memory_order_relaxed);
+        estimation.mIsLocked = mPublishedIsLocked.load(memory_order_relaxed);
+        estimation.mPosition = mPublishedPosition.load(memory_order_relaxed);
+        estimation.mTime = mPublishedTime.load(memory_order_relaxed);
+        estimation.mNsPerFrame = mPublishedNsPerFrame.load(memory_order_relaxed);
+        std::atomic_thread_fence(memory_order_acquire);
+    } while ((sequence & 1) || sequence != mSequence.load(memory_order_relaxed));
+}
+
+bool ClockDriftEstimator::isLocked() const
+{
+    return mPublishedIsLocked.load(memory_order_acquire);
+}
+
+bool ClockDriftEstimator::getTimeOf(uint64_t position, nsecs_t &time) const
+{
+    Estimation estimation;
+    read(estimation);
+    if (!estimation.mIsLocked) {
+        return false;
+    }
+    double frames = static_cast<double>(position) - static_cast<double>(estimation.mPosition);
+    time = static_cast<nsecs_t>(estimation.mTime + frames * estimation.mNsPerFrame);
+    return true;
+}
+
+double ClockDriftEstimator::getDriftPpm() const
+{
+    Estimation estimation;
+    read(estimation);
+    if (!estimation.mIsLocked || estimation.mNsPerFrame <= 0) {
+        return 0;
+    }
+    double actualRate = gNsecPerSec / estimation.mNsPerFrame;
+    return (actualRate - estimation.mSampleRate) * 1000000. / estimation.mSampleRate;
+}
+
+} // namespace intel_audio
@@ -0,0 +1,100 @@
+/*
+ * Copyright (C) 2015 Intel Corporation
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#include "FrameRing.hpp"
+#include <algorithm>
+#include <stdlib.h>
+#include <string.h>
+
+namespace intel_audio
+{
+
+FrameRing::FrameRing()
+    : mBuffer(NULL),
+      mBufferSize(0),
+      mFrameSize(0),
+      mCapacity(0),
+      mReadIndex(0),
+      mFilledFrames(0)
+{
+}
+
+FrameRing::~FrameRing()
+{
+    free(mBuffer);
+}
+
+android::status_t FrameRing::reserve(size_t frames, size_t frameSize)
+{
+    clear();
+    size_t bytes = frames * frameSize;
+    if (bytes > mBufferSize) {
+        char *buffer = static_cast<char *>(realloc(mBuffer, bytes));
+        if (buffer == NULL) {
+            mCapacity = 0;
+            return android::NO_MEMORY;
+        }
+        mBuffer = buffer;
+        mBufferSize = bytes;
+    }
+    mFrameSize = frameSize;
+    mCapacity = frames;
+    return android::OK;
+}
+
+void *FrameRing::getWritePointer(size_t &frames)
+{
+    size_t writeIndex = (mReadIndex + mFilledFrames) % std::max(mCapacity, size_t(1));
+    frames = std::min(getWritableFrames(), mCapacity - writeIndex);
+    return frames == 0 ? NULL : getFrame(writeIndex);
+}
+
+void FrameRing::commitWrite(size_t frames)
+{
+    mFilledFrames += std::min(frames, getWritableFrames());
+}
+
+void *FrameRing::getReadPointer(size_t &frames)
+{
+    frames = std::min(mFilledFrames, mCapacity - mReadIndex);
+    return frames == 0 ? NULL : getFrame(mReadIndex);
+}
+
+void FrameRing::consume(size_t frames)
+{
+    frames = std::min(frames, mFilledFrames);
+    mFilledFrames -= frames;
+    mReadIndex = mFilledFrames == 0 ? 0 : (mReadIndex + frames) % mCapacity;
+}
+
+size_t FrameRing::read(void *buffer, size_t frames)
+{
+    char *dst = static_cast<char *>(buffer);
+    size_t copiedFrames = 0;
+    while (copiedFrames < frames) {
+        size_t contiguousFrames;
+        const void *src = getReadPointer(contiguousFrames);
+        contiguousFrames = std::min(contiguousFrames, frames - copiedFrames);
+        if (contiguousFrames == 0) {
+            break;
+        }
+        memcpy(dst + copiedFrames * mFrameSize, src, contiguousFrames * mFrameSize);
+        consume(contiguousFrames);
+        copiedFrames += contiguousFrames;
+    }
+    return copiedFrames;
+}
+
+} // namespace intel_audio
@@ -29,8 +29,7 @@ namespace intel_audio
 
 bool IoStream::isRouted() const
 {
-    AutoR lock(mStreamLock);
-    return isRoutedL();
+    return mIsRouted.load(std::memory_order_acquire);
 }
 
 bool IoStream::isRoutedL() const
@@ -65,6 +64,7 @@ android::status_t IoStream::attachRouteL()
     }
     setCurrentStreamRouteL(mNewStreamRoute);
     setRouteSampleSpecL(mCurrentStreamRoute->getSampleSpec());
+    mIsRouted.store(true, std::memory_order_release);
     return android::OK;
 }
 
@@ -72,6 +72,7 @@ android::status_t IoStream::attachRouteL()
 android::status_t IoStream::detachRouteL()
 {
     mCurrentStreamRoute = NULL;
+    mIsRouted.store(false, std::memory_order_release);
     return android::OK;
 }
 
@@ -0,0 +1,117 @@
+/*
+ * Copyright (C) 2013-2015 Intel Corporation
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#include "StreamStats.hpp"
+#include <sstream>
+
+using std::memory_order_relaxed;
+
+namespace intel_audio
+{
+
+StreamStats::StreamStats()
+    : mXrunCount(0),
+      mOverflowCount(0),
+      mRetryCount(0),
+      mRecoveryCount(0),
+      mFramesLost(0),
+      mPendingFramesLost(0),
+      mRecoveryStartTime(0),
+      mLastRecoveryDuration(0),
+      mMaxRecoveryDuration(0),
+      mLastEventTime(0)
+{
+    for (uint32_t level = 0; level < NbRecoveryLevels; level++) {
+        mRecoveryAttemptCount[level] = 0;
+    }
+}
+
+void StreamStats::stampEvent(nsecs_t time)
+{
+    mLastEventTime.store(time, memory_order_relaxed);
+}
+
+void StreamStats::onXrun(uint32_t framesLost)
+{
+    mXrunCount.fetch_add(1, memory_order_relaxed);
+    mFramesLost.fetch_add(framesLost, memory_order_relaxed);
+    mPendingFramesLost.fetch_add(framesLost, memory_order_relaxed);
+    stampEvent(systemTime());
+}
+
+void StreamStats::onOverflow(uint32_t framesDropped)
+{
+    mOverflowCount.fetch_add(1, memory_order_relaxed);
+    mFramesLost.fetch_add(framesDropped, memory_order_relaxed);
+    mPendingFramesLost.fetch_add(framesDropped, memory_order_relaxed);
+    stampEvent(systemTime());
+}
+
+void StreamStats::onRetry()
+{
+    mRetryCount.fetch_add(1, memory_order_relaxed);
+    stampEvent(systemTime());
+}
+
+void StreamStats::onRecoveryStarted(RecoveryLevel level)
+{
+    nsecs_t now = systemTime();
+    mRecoveryAttemptCount[level].fetch_add(1, memory_order_relaxed);
+    nsecs_t noRecovery = 0;
+    mRecoveryStartTime.compare_exchange_strong(noRecovery, now, memory_order_relaxed);
+    stampEvent(now);
+}
+
+void StreamStats::onIoDone()
+{
+    if (mRecoveryStartTime.load(memory_order_relaxed) == 0) {
+        // Fast path: no recovery pending
+        return;
+    }
+    nsecs_t now = systemTime();
+    nsecs_t duration = now - mRecoveryStartTime.exchange(0, memory_order_relaxed);
+
+    mRecoveryCount.fetch_add(1, memory_order_relaxed);
+    mLastRecoveryDuration.store(duration, memory_order_relaxed);
+    if (duration > mMaxRecoveryDuration.load(memory_order_relaxed)) {
+        // Single writer (stream audio thread), no need to loop on a CAS
+        mMaxRecoveryDuration.store(duration, memory_order_relaxed);
+    }
+    stampEvent(now);
+}
+
+uint32_t StreamStats::consumeFramesLost()
+{
+    return mPendingFramesLost.exchange(0, memory_order_relaxed);
+}
+
+std::string StreamStats::toString() const
+{
+    std::ostringstream stats;
+    stats << "xruns:" << getXrunCount()
+          << ",overflows:" << getOverflowCount()
+          << ",retries:" << getRetryCount()
+          << ",recoveries:" << getRecoveryCount()
+          << ",in_place:" << getRecoveryAttemptCount(RecoveryInPlace)
+          << ",reopen:" << getRecoveryAttemptCount(RecoveryReopen)
+          << ",reroute:" << getRecoveryAttemptCount(RecoveryReroute)
+          << ",frames_lost:" << getFramesLost()
+          << ",last_recovery_us:" << ns2us(getLastRecoveryDuration())
+          << ",max_recovery_us:" << ns2us(getMaxRecoveryDuration())
+          << ",last_event_ns:" << getLastEventTime();
+    return stats.str();
+}
+
+} // namespace intel_audio
@@ -0,0 +1,90 @@
+/*
+ * Copyright (C) 2013-2015 Intel Corporation
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#include "TimingHistogram.hpp"
+#include <sstream>
+
+using std::memory_order_relaxed;
+
+namespace intel_audio
+{
+
+TimingHistogram::TimingHistogram()
+{
+    reset();
+}
+
+void TimingHistogram::record(nsecs_t duration)
+{
+    if (duration < 0) {
+        duration = 0;
+    }
+    uint32_t bucket = 0;
+    nsecs_t bound = us2ns(mFirstBucketBoundUs);
+    while (bucket < mNbBuckets - 1 && duration >= bound) {
+        bound *= 2;
+        bucket++;
+    }
+    mBuckets[bucket].fetch_add(1, memory_order_relaxed);
+    mCount.fetch_add(1, memory_order_relaxed);
+    mSum.fetch_add(duration, memory_order_relaxed);
+    if (duration > mMax.load(memory_order_relaxed)) {
+        // Single writer (stream audio thread), no need to loop on a CAS
+        mMax.store(duration, memory_order_relaxed);
+    }
+}
+
+void TimingHistogram::reset()
+{
+    for (uint32_t bucket = 0; bucket < mNbBuckets; bucket++) {
+        mBuckets[bucket] = 0;
+    }
+    mCount = 0;
+    mSum = 0;
+    mMax = 0;
+}
+
+uint32_t TimingHistogram::getBucketBoundUs(uint32_t bucket)
+{
+    return bucket < mNbBuckets - 1 ? mFirstBucketBoundUs << bucket : 0;
+}
+
+nsecs_t TimingHistogram::getAverage() const
+{
+    uint32_t count = getCount();
+    return count == 0 ? 0 : mSum.load(memory_order_relaxed) / count;
+}
+
+std::string TimingHistogram::toString() const
+{
+    std::ostringstream histogram;
+    histogram << "count:" << getCount()
+              << " avg_us:" << ns2us(getAverage())
+              << " max_us:" << ns2us(getMax()) << " |";
+    for (uint32_t bucket = 0; bucket < mNbBuckets; bucket++) {
+        uint32_t count = getBucketCount(bucket);
+        if (count == 0) {
+            continue;
+        }
+        if (bucket < mNbBuckets - 1) {
+            histogram << " <" << getBucketBoundUs(bucket) << ":" << count;
+        } else {
+            histogram << " >=" << getBucketBoundUs(bucket - 1) << ":" << count;
+        }
+    }
+    return histogram.str();
+}
+
+} // namespace intel_audio
@@ -73,6 +73,10 @@ android::status_t TinyAlsaAudioDevice::open(const char *cardName,
     if (cardIndex < 0) {
         return android::BAD_VALUE;
     }
+    mCardIndex = cardIndex;
+    mDeviceId = deviceId;
+    mFlags = flags;
+    mConfig = config;
     mPcmDevice = pcm_open(cardIndex, deviceId, flags, &config);
     if (mPcmDevice && !pcm_is_ready(mPcmDevice)) {
         Log::Error() << __FUNCTION__
@@ -102,6 +106,27 @@ close_device:
     return android::NO_MEMORY;
 }
 
+android::status_t TinyAlsaAudioDevice::reopen()
+{
+    AUDIOCOMMS_ASSERT(mPcmDevice != NULL, "Tiny alsa device not opened");
+
+    Log::Debug() << __FUNCTION__ << ": card " << mCardIndex << ", device " << mDeviceId;
+    pcm_close(mPcmDevice);
+
+    // As for opening, tiny alsa guarantees a non NULL handle, so it is safe to close it later on.
+    mPcmDevice = pcm_open(mCardIndex, mDeviceId, mFlags, &mConfig);
+    if (!pcm_is_ready(mPcmDevice)) {
+        Log::Error() << __FUNCTION__ << ": Cannot reopen tinyalsa device (error="
+                     << pcm_get_error(mPcmDevice) << ")";
+        return android::NO_INIT;
+    }
+    if (pcm_prepare(mPcmDevice) != 0) {
+        Log::Error() << __FUNCTION__ << ": prepare failed with error " << pcm_get_error(mPcmDevice);
+        return android::NO_INIT;
+    }
+    return android::OK;
+}
+
 bool TinyAlsaAudioDevice::isOpened()
 {
     return mPcmDevice != NULL;
@@ -27,7 +27,11 @@ class TinyAlsaAudioDevice : public IAudioDevice
 {
 public:
     TinyAlsaAudioDevice()
-        : mPcmDevice(NULL) {}
+        : mPcmDevice(NULL),
+          mCardIndex(-1),
+          mDeviceId(0),
+          mFlags(0)
+    {}
 
     /**
      * Get the pcm device handle.
@@ -45,8 +49,27 @@ public:
 
     virtual android::status_t close();
 
+    /**
+     * Closes and opens again the pcm device with the configuration of the last opening.
+     * Used to recover a device that failed to be restarted in place.
+     * Must be called with the device opened.
+     *
+     * @return OK if the device is reopened and prepared, error code otherwise.
+     */
+    android::status_t reopen();
+
+    /**
+     * @return period size of the opened pcm device, in frames.
+     */
+    uint32_t getPeriodSize() const { return mConfig.period_size; }
+
 private:
     pcm *mPcmDevice; /**< Handle on tiny alsa PCM device. */
+
+    int mCardIndex; /**< card index of the opened pcm device. */
+    uint32_t mDeviceId; /**< device index of the opened pcm device. */
+    uint32_t mFlags; /**< flags used to open the pcm device. */
+    pcm_config mConfig; /**< configuration used to open the pcm device. */
 };
 
 } // namespace intel_audio
@@ -20,6 +20,8 @@
 #include <IStreamRoute.hpp>
 #include <AudioCommsAssert.hpp>
 #include <utilities/Log.hpp>
+#include <algorithm>
+#include <string.h>
 
 using audio_comms::utilities::Log;
 using std::string;
@@ -39,7 +41,17 @@ pcm *TinyAlsaIoStream::getPcmDevice() const
 android::status_t TinyAlsaIoStream::attachRouteL()
 {
     mDevice = static_cast<TinyAlsaAudioDevice *>(getNewStreamRoute()->getAudioDevice());
+    mIsPcmRunning = false;
+    mIsInXrun = false;
+    mTransferredFrames = 0;
+    // Escalation of a previous route not carried over to the new device.
+    mRecoveryAttempts = 0;
     IoStream::attachRouteL();
+    mClockDriftEstimator.reset(routeSampleSpec().getSampleRate());
+    if (isOut()) {
+        // Not to allocate from the audio thread upon recovery.
+        mSilence.assign(routeSampleSpec().convertFramesToBytes(getPeriodSizeInFrames()), 0);
+    }
     return OK;
 }
 
@@ -47,6 +59,7 @@ android::status_t TinyAlsaIoStream::detachRouteL()
 {
     IoStream::detachRouteL();
     mDevice = NULL;
+    mIsPcmRunning = false;
     return OK;
 }
 
@@ -57,6 +70,8 @@ status_t TinyAlsaIoStream::pcmReadFrames(void *buffer, size_t frames, string &er
         return android::BAD_VALUE;
     }
 
+    updateXrunStats();
+
     status_t ret;
     ret = pcm_read(getPcmDevice(),
                    (char *)buffer,
@@ -66,12 +81,16 @@ status_t TinyAlsaIoStream::pcmReadFrames(void *buffer, size_t frames, string &er
         error = pcm_get_error(getPcmDevice());
         return ret;
     }
+    mTransferredFrames += frames;
+    onIoDone();
 
     return OK;
 }
 
 status_t TinyAlsaIoStream::pcmWriteFrames(void *buffer, ssize_t frames, string &error) const
 {
+    updateXrunStats();
+
     status_t ret;
 
     ret = pcm_write(getPcmDevice(),
@@ -82,10 +101,144 @@ status_t TinyAlsaIoStream::pcmWriteFrames(void *buffer, ssize_t frames, string &
         error = pcm_get_error(getPcmDevice());
         return ret;
     }
+    mTransferredFrames += frames;
+    onIoDone();
 
     return OK;
 }
 
+void TinyAlsaIoStream::updateXrunStats() const
+{
+    unsigned int availFrames;
+    struct timespec tStamp;
+    size_t bufferSize = getBufferSizeInFrames();
+
+    if (pcm_get_htimestamp(getPcmDevice(), &availFrames, &tStamp) < 0) {
+        // Not running: either not started yet, or stopped by the driver on xrun.
+        if (mIsPcmRunning) {
+            // Estimate the lost frames from the time elapsed since the last I/O operation.
+            size_t elapsedFrames =
+                routeSampleSpec().convertUsecToframes(ns2us(systemTime() - mLastIoTime));
+            Log::Warning() << __FUNCTION__ << ": " << (isOut() ? "underrun" : "overrun")
+                           << " detected, pcm stopped by the driver";
+            onXrun(elapsedFrames > bufferSize ? elapsedFrames - bufferSize : 0);
+        }
+        mIsPcmRunning = false;
+        return;
+    }
+    if (!mIsPcmRunning) {
+        // (Re)started, the hardware position restarts from the frames transferred.
+        mClockDriftEstimator.reset(routeSampleSpec().getSampleRate());
+    }
+    mIsPcmRunning = true;
+
+    if (availFrames <= bufferSize) {
+        mIsInXrun = false;
+        mClockDriftEstimator.update(getHwPosition(availFrames),
+                                    seconds_to_nanoseconds(tStamp.tv_sec) + tStamp.tv_nsec);
+        return;
+    }
+    // Hardware position no longer consistent with the frames transferred.
+    mClockDriftEstimator.reset(routeSampleSpec().getSampleRate());
+    if (!mIsInXrun) {
+        mIsInXrun = true;
+        Log::Warning() << __FUNCTION__ << ": " << (isOut() ? "underrun" : "overrun")
+                       << " detected, " << availFrames - bufferSize << " frames lost";
+        onXrun(availFrames - bufferSize);
+    }
+}
+
+void TinyAlsaIoStream::onXrun(uint32_t framesLost) const
+{
+    mStats.onXrun(framesLost);
+    if (getCurrentStreamRoute()->onXrun()) {
+        // Routing can't be reconsidered from here: the stream lock is held for the I/O operation
+        mIsLatencyAdaptationRequested = true;
+    }
+}
+
+bool TinyAlsaIoStream::consumeLatencyAdaptationRequest()
+{
+    return mIsLatencyAdaptationRequested.exchange(false);
+}
+
+void TinyAlsaIoStream::onIoDone() const
+{
+    mLastIoTime = systemTime();
+    mRecoveryAttempts = 0;
+    mStats.onIoDone();
+}
+
+uint64_t TinyAlsaIoStream::getHwPosition(size_t avail) const
+{
+    uint64_t transferredFrames = mTransferredFrames;
+    if (!isOut()) {
+        // Frames captured, not read yet.
+        return transferredFrames + avail;
+    }
+    // Frames written, not played yet.
+    size_t queuedFrames = getBufferSizeInFrames() - avail;
+    return transferredFrames > queuedFrames ? transferredFrames - queuedFrames : 0;
+}
+
+status_t TinyAlsaIoStream::pcmRecover()
+{
+    // Recovering on purpose, shall not be taken for an xrun.
+    mIsPcmRunning = false;
+
+    if (mRecoveryAttempts < mMaxInPlaceRecoveries) {
+        ++mRecoveryAttempts;
+        mStats.onRecoveryStarted(StreamStats::RecoveryInPlace);
+        Log::Warning() << __FUNCTION__ << ": in place recovery, attempt " << mRecoveryAttempts;
+
+        if (pcm_prepare(getPcmDevice()) == 0 && pcmRestart() == OK) {
+            return OK;
+        }
+        Log::Error() << __FUNCTION__ << ": in place recovery failed: "
+                     << pcm_get_error(getPcmDevice());
+        // Escalate without waiting for the next failure.
+        mRecoveryAttempts = mMaxInPlaceRecoveries;
+    }
+    if (mRecoveryAttempts == mMaxInPlaceRecoveries) {
+        ++mRecoveryAttempts;
+        mStats.onRecoveryStarted(StreamStats::RecoveryReopen);
+        Log::Warning() << __FUNCTION__ << ": reopening audio device";
+
+        if (mDevice->reopen() == OK && pcmRestart() == OK) {
+            return OK;
+        }
+    }
+    Log::Error() << __FUNCTION__ << ": unable to recover audio device, reroute required";
+    return android::DEAD_OBJECT;
+}
+
+status_t TinyAlsaIoStream::pcmRestart()
+{
+    if (!isOut()) {
+        return pcm_start(getPcmDevice()) == 0 ? OK : INVALID_OPERATION;
+    }
+    // Prefill with a period of silence, playback will start as soon as start threshold is reached.
+    return pcm_write(getPcmDevice(), &mSilence[0], mSilence.size()) == 0 ? OK : INVALID_OPERATION;
+}
+
+status_t TinyAlsaIoStream::pcmWriteSilence(size_t frames, string &error)
+{
+    size_t periodSize = routeSampleSpec().convertBytesToFrames(mSilence.size());
+    if (periodSize == 0) {
+        error = "no silence allocated";
+        return INVALID_OPERATION;
+    }
+    while (frames != 0) {
+        size_t framesToWrite = std::min(frames, periodSize);
+        status_t status = pcmWriteFrames(&mSilence[0], framesToWrite, error);
+        if (status != OK) {
+            return status;
+        }
+        frames -= framesToWrite;
+    }
+    return OK;
+}
+
 uint32_t TinyAlsaIoStream::getBufferSizeInBytes() const
 {
     return pcm_frames_to_bytes(getPcmDevice(), getBufferSizeInFrames());
@@ -96,6 +249,12 @@ size_t TinyAlsaIoStream::getBufferSizeInFrames() const
     return pcm_get_buffer_size(getPcmDevice());
 }
 
+size_t TinyAlsaIoStream::getPeriodSizeInFrames() const
+{
+    AUDIOCOMMS_ASSERT(mDevice != NULL, "Null audio device attached to stream");
+    return mDevice->getPeriodSize();
+}
+
 status_t TinyAlsaIoStream::getFramesAvailable(size_t &avail, struct timespec &tStamp) const
 {
     unsigned int availFrames;
@@ -105,11 +264,32 @@ status_t TinyAlsaIoStream::getFramesAvailable(size_t &avail, struct timespec &tS
         return INVALID_OPERATION;
     }
     avail = availFrames;
+    nsecs_t smoothedTime;
+    if (availFrames <= getBufferSizeInFrames() &&
+        mClockDriftEstimator.getTimeOf(getHwPosition(availFrames), smoothedTime)) {
+        tStamp.tv_sec = nanoseconds_to_seconds(smoothedTime);
+        tStamp.tv_nsec = smoothedTime - seconds_to_nanoseconds(tStamp.tv_sec);
+    }
     return OK;
 }
 
+size_t TinyAlsaIoStream::getWritableFramesL() const
+{
+    // Unlike the timestamp, also valid while prepared, i.e. before the start threshold.
+    int availFrames = pcm_avail_update(getPcmDevice());
+    if (availFrames < 0) {
+        // Not logged, called for each write: the frames not written are accounted by the caller.
+        return 0;
+    }
+    // Beyond the ring buffer after an underrun, the ring is emptied when the pcm is prepared.
+    size_t bufferSize = getBufferSizeInFrames();
+    return static_cast<size_t>(availFrames) < bufferSize ? availFrames : bufferSize;
+}
+
 status_t TinyAlsaIoStream::pcmStop() const
 {
+    // Stopped on purpose, shall not be taken for an xrun.
+    mIsPcmRunning = false;
     return pcm_stop(getPcmDevice());
 }
 
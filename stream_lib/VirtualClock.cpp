@@ -0,0 +1,83 @@
+/*
+ * Copyright (C) 2013-2015 Intel Corporation
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#include "VirtualClock.hpp"
+#include <errno.h>
+#include <time.h>
+
+using android::Mutex;
+
+namespace intel_audio
+{
+
+static const nsecs_t gNsecPerSec = 1000000000LL;
+
+VirtualClock::VirtualClock()
+    : mIsRunning(false),
+      mAnchorFrames(0),
+      mAnchorTime(0),
+      mSampleRate(0)
+{
+}
+
+void VirtualClock::start(uint64_t frames, nsecs_t time, uint32_t sampleRate)
+{
+    Mutex::Autolock lock(mLock);
+    mAnchorFrames = frames;
+    mAnchorTime = time;
+    mSampleRate = sampleRate;
+    mIsRunning.store(sampleRate != 0, std::memory_order_release);
+}
+
+void VirtualClock::stop()
+{
+    Mutex::Autolock lock(mLock);
+    mIsRunning.store(false, std::memory_order_release);
+}
+
+uint64_t VirtualClock::getFramesAt(nsecs_t time) const
+{
+    Mutex::Autolock lock(mLock);
+    if (time <= mAnchorTime) {
+        return mAnchorFrames;
+    }
+    // Split seconds and remainder not to overflow on long running streams
+    uint64_t elapsed = time - mAnchorTime;
+    return mAnchorFrames + (elapsed / gNsecPerSec) * mSampleRate +
+           (elapsed % gNsecPerSec) * mSampleRate / gNsecPerSec;
+}
+
+nsecs_t VirtualClock::getTimeOf(uint64_t frames) const
+{
+    Mutex::Autolock lock(mLock);
+    if (frames <= mAnchorFrames || mSampleRate == 0) {
+        return mAnchorTime;
+    }
+    uint64_t pending = frames - mAnchorFrames;
+    // Round up, frames are consumed once their last sample is
+    return mAnchorTime + (pending / mSampleRate) * gNsecPerSec +
+           ((pending % mSampleRate) * gNsecPerSec + mSampleRate - 1) / mSampleRate;
+}
+
+void VirtualClock::sleepUntil(nsecs_t time)
+{
+    struct timespec deadline;
+    deadline.tv_sec = time / gNsecPerSec;
+    deadline.tv_nsec = time % gNsecPerSec;
+    while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &deadline, NULL) == EINTR) {
+    }
+}
+
+} // namespace intel_audio
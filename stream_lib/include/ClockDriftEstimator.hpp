@@ -0,0 +1,113 @@
+/*
+ * Copyright (C) 2013-2015 Intel Corporation
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#pragma once
+
+#include <utils/Timers.h>
+#include <atomic>
+#include <stdint.h>
+
+namespace intel_audio
+{
+
+/**
+ * Estimates the actual rate of the hardware clock of an audio device relative to CLOCK_MONOTONIC
+ * with a second order delay-locked loop, fed with the successive hardware positions and their
+ * timestamps.
+ * The loop filters the jitter of the timestamps, so that smoothed timestamps can be derived for
+ * any position, and gives the drift of the hardware clock from the nominal sample rate.
+ * The loop is fed by a single thread at a time, the I/O thread of the stream; its state is
+ * published with a sequence counter (odd while updated) so that any thread reads a consistent
+ * estimation without lock.
+ */
+class ClockDriftEstimator
+{
+public:
+    ClockDriftEstimator();
+
+    /**
+     * Restarts the estimation, e.g. upon discontinuity of the hardware position (start, xrun...).
+     *
+     * @param[in] sampleRate nominal rate of the hardware clock.
+     */
+    void reset(uint32_t sampleRate);
+
+    /**
+     * Feeds the loop with a hardware position.
+     * A position too far from the prediction is taken for a discontinuity and restarts the loop.
+     *
+     * @param[in] position of the hardware pointer, in frames.
+     * @param[in] time at which the position was reached, in nanoseconds on CLOCK_MONOTONIC.
+     */
+    void update(uint64_t position, nsecs_t time);
+
+    /**
+     * @return true if the loop received enough positions for its estimation to be relevant.
+     */
+    bool isLocked() const;
+
+    /**
+     * @param[in] position of the hardware pointer, in frames.
+     * @param[out] time smoothed time at which the position is reached, set only if locked.
+     *
+     * @return true if the loop is locked, false otherwise.
+     */
+    bool getTimeOf(uint64_t position, nsecs_t &time) const;
+
+    /**
+     * @return drift of the hardware clock from its nominal rate in parts per million, positive if
+     *         the hardware clock runs faster, 0 if not locked.
+     */
+    double getDriftPpm() const;
+
+private:
+    /** Loop state, as seen by the readers. */
+    struct Estimation
+    {
+        uint32_t mSampleRate;
+        bool mIsLocked;
+        uint64_t mPosition;
+        double mTime;
+        double mNsPerFrame;
+    };
+
+    /** Restarts the loop from a position. */
+    void restart(uint64_t position, nsecs_t time);
+
+    /** Publishes the loop state to the readers, called by the feeding thread. */
+    void publish();
+
+    /** Reads a consistent loop state, from any thread. */
+    void read(Estimation &estimation) const;
+
+    /** Owned by the feeding thread. */
+    uint32_t mSampleRate; /**< nominal rate, 0 if reset not called yet. */
+    uint32_t mUpdateCount; /**< positions received since last reset. */
+    uint64_t mPosition; /**< last position received. */
+    double mTime; /**< filtered time of the last position, in nanoseconds. */
+    double mNsPerFrame; /**< filtered period of the hardware clock. */
+
+    /** Published loop state. */
+    std::atomic<uint32_t> mSequence;
+    std::atomic<uint32_t> mPublishedSampleRate;
+    std::atomic<bool> mPublishedIsLocked;
+    std::atomic<uint64_t> mPublishedPosition;
+    std::atomic<double> mPublishedTime;
+    std::atomic<double> mPublishedNsPerFrame;
+
+    static const uint32_t mLockUpdateCount = 16; /**< updates before the loop is locked. */
+};
+
+} // namespace intel_audio
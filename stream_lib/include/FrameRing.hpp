@@ -0,0 +1,108 @@
+/*
+ * Copyright (C) 2015 Intel Corporation
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#pragma once
+
+#include <NonCopyable.hpp>
+#include <utils/Errors.h>
+#include <stddef.h>
+
+namespace intel_audio
+{
+
+/**
+ * Fixed capacity ring of frames between two stages of a stream running in the same thread.
+ * Memory is only allocated upon reserve, i.e. when the stream is configured, so that neither
+ * stage ever compacts nor reallocates. Stages access the frames through contiguous regions, a
+ * region stopping at the end of the ring.
+ */
+class FrameRing : private audio_comms::utilities::NonCopyable
+{
+public:
+    FrameRing();
+
+    ~FrameRing();
+
+    /**
+     * Sizes the ring and drops the frames it holds. Memory only grows.
+     *
+     * @param[in] frames capacity of the ring.
+     * @param[in] frameSize size of a frame in bytes.
+     *
+     * @return OK if successful, NO_MEMORY otherwise.
+     */
+    android::status_t reserve(size_t frames, size_t frameSize);
+
+    /**
+     * Drops the frames held by the ring.
+     */
+    void clear() { mReadIndex = mFilledFrames = 0; }
+
+    size_t getCapacity() const { return mCapacity; }
+
+    size_t getReadableFrames() const { return mFilledFrames; }
+
+    size_t getWritableFrames() const { return mCapacity - mFilledFrames; }
+
+    /**
+     * @param[out] frames writable contiguously from the returned pointer.
+     *
+     * @return first free frame of the ring.
+     */
+    void *getWritePointer(size_t &frames);
+
+    /**
+     * Makes frames written from the write pointer readable.
+     *
+     * @param[in] frames written, at most the contiguous frames of the write pointer.
+     */
+    void commitWrite(size_t frames);
+
+    /**
+     * @param[out] frames readable contiguously from the returned pointer.
+     *
+     * @return first readable frame of the ring.
+     */
+    void *getReadPointer(size_t &frames);
+
+    /**
+     * Frees frames read from the read pointer.
+     *
+     * @param[in] frames read, at most the readable frames.
+     */
+    void consume(size_t frames);
+
+    /**
+     * Copies and consumes readable frames, across the end of the ring if needed.
+     *
+     * @param[out] buffer destination of the frames.
+     * @param[in] frames requested.
+     *
+     * @return frames copied, at most the readable frames.
+     */
+    size_t read(void *buffer, size_t frames);
+
+private:
+    char *getFrame(size_t index) { return mBuffer + index * mFrameSize; }
+
+    char *mBuffer;
+    size_t mBufferSize; /**< allocated, in bytes. */
+    size_t mFrameSize; /**< in bytes. */
+    size_t mCapacity; /**< in frames. */
+    size_t mReadIndex; /**< index of the first readable frame. */
+    size_t mFilledFrames; /**< readable frames. */
+};
+
+} // namespace intel_audio
@@ -15,9 +15,11 @@
  */
 #pragma once
 
+#include "StreamStats.hpp"
 #include <SampleSpec.hpp>
 #include <system/audio.h>
 #include <utils/RWLock.h>
+#include <atomic>
 #include <string>
 
 typedef android::RWLock::AutoRLock AutoR;
@@ -35,11 +37,15 @@ public:
     IoStream()
         : mCurrentStreamRoute(NULL),
           mNewStreamRoute(NULL),
+          mIsRouted(false),
           mEffectsRequestedMask(0)
     {}
 
     /**
      * indicates if the stream has been routed (ie audio device available and the routing is done)
+     * Lock-free, intended to be used by the audio thread to skip the stream lock when the stream
+     * is not routed. The routed state must be checked again with the lock held (isRoutedL) before
+     * accessing the audio device.
      *
      * @return true if stream is routed, false otherwise
      */
@@ -115,6 +121,19 @@ public:
      */
     virtual uint32_t getUseCaseMask() const = 0;
 
+    /**
+     * Get a mirror of this stream not assigned to any route yet, i.e. a stream rendering the same
+     * frames on an additional route, so that this stream may be routed to several routes at once.
+     *
+     * @return available mirror, NULL if none or if this stream does not support fan-out.
+     */
+    virtual IoStream *getAvailableMirror() { return NULL; }
+
+    /**
+     * @return stream whose frames are rendered by this stream, i.e. itself unless it is a mirror.
+     */
+    virtual const IoStream *getMirroredStream() const { return this; }
+
     /**
      * Get output silence to be appended before playing.
      * Some route may require to append silence in the ring buffer as powering on of components
@@ -305,6 +324,14 @@ public:
 
     virtual android::status_t pcmStop() const = 0;
 
+    /**
+     * Recovers the audio device after a failed read / write operation, so that the operation may
+     * be retried without rerouting the stream.
+     *
+     * @return OK if the operation may be retried, DEAD_OBJECT if the stream needs to be rerouted.
+     */
+    virtual android::status_t pcmRecover() = 0;
+
     /**
      * Returns available frames in pcm buffer and corresponding time stamp.
      * For an input stream, frames available are frames ready for the
@@ -383,6 +410,12 @@ protected:
 
     SampleSpec mSampleSpec; /**< stream sample specifications. */
 
+    /**
+     * Xruns, retries and recoveries statistics.
+     * Lock-free, so it may be updated from const I/O accessors and read from any context.
+     */
+    mutable StreamStats mStats;
+
 private:
     void setCurrentStreamRouteL(IStreamRoute *currentStreamRoute);
 
@@ -397,6 +430,9 @@ private:
     IStreamRoute *mCurrentStreamRoute; /**< route assigned to the stream (routed yet). */
     IStreamRoute *mNewStreamRoute; /**< New route assigned to the stream (not routed yet). */
 
+    /** Routed state published to lock-free readers, updated with stream lock held. */
+    std::atomic<bool> mIsRouted;
+
     /**
      * Sample specifications of the route assigned to the stream.
      */
@@ -0,0 +1,143 @@
+/*
+ * Copyright (C) 2013-2015 Intel Corporation
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#pragma once
+
+#include <utils/Timers.h>
+#include <atomic>
+#include <string>
+#include <stdint.h>
+
+namespace intel_audio
+{
+
+/**
+ * Runtime statistics of a stream: xruns, I/O retries and recoveries.
+ * Counters are updated from the audio thread of the stream and may be read from any context
+ * (dump, getParameters), so they are lock-free and never block the I/O path.
+ */
+class StreamStats
+{
+public:
+    /**
+     * Recovery levels, from the cheapest to the most expensive one.
+     */
+    enum RecoveryLevel
+    {
+        RecoveryInPlace, /**< pcm prepared and restarted. */
+        RecoveryReopen, /**< pcm closed and reopened with the same configuration. */
+        RecoveryReroute, /**< stream put in standby, rerouted on next I/O. */
+        NbRecoveryLevels
+    };
+
+    StreamStats();
+
+    /**
+     * Accounts an xrun, i.e. an underrun for an output stream, an overrun for an input stream.
+     *
+     * @param[in] framesLost estimation of frames lost by the xrun, 0 if unknown.
+     */
+    void onXrun(uint32_t framesLost);
+
+    /**
+     * Accounts frames dropped by the stream itself, e.g. a capture prefetched faster than consumed
+     * by the client. Unlike xruns, the audio device did not lose any frame.
+     *
+     * @param[in] framesDropped number of frames dropped.
+     */
+    void onOverflow(uint32_t framesDropped);
+
+    /**
+     * Accounts a retry of a failed I/O operation.
+     */
+    void onRetry();
+
+    /**
+     * Flags a recovery attempt of the audio device.
+     * Only the first attempt starts the recovery, its duration is accounted once completed by
+     * a successful I/O, whatever the number of attempts and levels involved.
+     *
+     * @param[in] level of the recovery attempted.
+     */
+    void onRecoveryStarted(RecoveryLevel level);
+
+    /**
+     * Flags a successful I/O operation. If a recovery was pending, it is completed and its duration
+     * is accounted.
+     */
+    void onIoDone();
+
+    /**
+     * Get the frames lost since the previous call and reset the counter.
+     *
+     * @return frames lost since the previous call.
+     */
+    uint32_t consumeFramesLost();
+
+    uint32_t getXrunCount() const { return mXrunCount.load(std::memory_order_relaxed); }
+
+    uint32_t getOverflowCount() const { return mOverflowCount.load(std::memory_order_relaxed); }
+
+    uint32_t getRetryCount() const { return mRetryCount.load(std::memory_order_relaxed); }
+
+    uint32_t getRecoveryCount() const { return mRecoveryCount.load(std::memory_order_relaxed); }
+
+    uint32_t getRecoveryAttemptCount(RecoveryLevel level) const
+    {
+        return mRecoveryAttemptCount[level].load(std::memory_order_relaxed);
+    }
+
+    uint64_t getFramesLost() const { return mFramesLost.load(std::memory_order_relaxed); }
+
+    nsecs_t getLastRecoveryDuration() const
+    {
+        return mLastRecoveryDuration.load(std::memory_order_relaxed);
+    }
+
+    nsecs_t getMaxRecoveryDuration() const
+    {
+        return mMaxRecoveryDuration.load(std::memory_order_relaxed);
+    }
+
+    /**
+     * @return monotonic time of the last event (xrun, retry or recovery), 0 if none happened.
+     */
+    nsecs_t getLastEventTime() const { return mLastEventTime.load(std::memory_order_relaxed); }
+
+    /**
+     * Serializes the statistics as a comma separated list of name:value, so that it can be used
+     * as value of a {key, value} pair.
+     *
+     * @return statistics as string.
+     */
+    std::string toString() const;
+
+private:
+    void stampEvent(nsecs_t time);
+
+    std::atomic<uint32_t> mXrunCount; /**< underruns for output, overruns for input. */
+    std::atomic<uint32_t> mOverflowCount; /**< frames dropped by the stream itself. */
+    std::atomic<uint32_t> mRetryCount; /**< I/O operations retried. */
+    std::atomic<uint32_t> mRecoveryCount; /**< device recoveries completed. */
+    std::atomic<uint32_t> mRecoveryAttemptCount[NbRecoveryLevels]; /**< attempts per level. */
+    std::atomic<uint64_t> mFramesLost; /**< frames lost since stream creation. */
+    std::atomic<uint32_t> mPendingFramesLost; /**< frames lost since last consumption. */
+    std::atomic<nsecs_t> mRecoveryStartTime; /**< start of pending recovery, 0 if none. */
+    std::atomic<nsecs_t> mLastRecoveryDuration; /**< duration of the last recovery. */
+    std::atomic<nsecs_t> mMaxRecoveryDuration; /**< worst recovery duration. */
+    std::atomic<nsecs_t> mLastEventTime; /**< monotonic time of the last event. */
+};
+
+} // namespace intel_audio
@@ -0,0 +1,89 @@
+/*
+ * Copyright (C) 2013-2015 Intel Corporation
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#pragma once
+
+#include <utils/Timers.h>
+#include <atomic>
+#include <string>
+#include <stdint.h>
+
+namespace intel_audio
+{
+
+/**
+ * Histogram of durations with fixed buckets, from the first bucket bound up to a catch-all bucket.
+ * Each bucket bound doubles the previous one.
+ * Recording is lock-free and allocation-free, so that it can be used from the audio thread, while
+ * the histogram is dumped from any context.
+ */
+class TimingHistogram
+{
+public:
+    static const uint32_t mNbBuckets = 12; /**< including the catch-all bucket. */
+
+    TimingHistogram();
+
+    /**
+     * Accounts a duration in its bucket.
+     *
+     * @param[in] duration to account, in nanoseconds. Negative durations are accounted as 0.
+     */
+    void record(nsecs_t duration);
+
+    /**
+     * Clears all the buckets.
+     */
+    void reset();
+
+    /**
+     * @param[in] bucket index.
+     *
+     * @return upper bound (excluded) of the bucket in microseconds, 0 for the catch-all bucket.
+     */
+    static uint32_t getBucketBoundUs(uint32_t bucket);
+
+    uint32_t getBucketCount(uint32_t bucket) const
+    {
+        return mBuckets[bucket].load(std::memory_order_relaxed);
+    }
+
+    uint32_t getCount() const { return mCount.load(std::memory_order_relaxed); }
+
+    nsecs_t getMax() const { return mMax.load(std::memory_order_relaxed); }
+
+    /**
+     * @return average of the recorded durations in nanoseconds, 0 if none was recorded.
+     */
+    nsecs_t getAverage() const;
+
+    /**
+     * Serializes the non empty buckets as a space separated list of "<bound_us:count", with a
+     * summary of the count, average and max durations.
+     *
+     * @return histogram as a string.
+     */
+    std::string toString() const;
+
+private:
+    static const uint32_t mFirstBucketBoundUs = 125; /**< bound of the first bucket. */
+
+    std::atomic<uint32_t> mBuckets[mNbBuckets];
+    std::atomic<uint32_t> mCount; /**< number of durations recorded. */
+    std::atomic<uint64_t> mSum; /**< sum of durations recorded, in nanoseconds. */
+    std::atomic<nsecs_t> mMax; /**< longest duration recorded. */
+};
+
+} // namespace intel_audio
@@ -18,6 +18,11 @@
 #include "IoStream.hpp"
 #include <SampleSpec.hpp>
 #include <utils/RWLock.h>
+#include <utils/Timers.h>
+#include <ClockDriftEstimator.hpp>
+#include <atomic>
+#include <string>
+#include <vector>
 
 namespace intel_audio
 {
@@ -28,13 +33,25 @@ class TinyAlsaIoStream : public IoStream
 {
 public:
     TinyAlsaIoStream()
-        : IoStream::IoStream(), mDevice(NULL)
+        : IoStream::IoStream(),
+          mDevice(NULL),
+          mIsPcmRunning(false),
+          mIsInXrun(false),
+          mLastIoTime(0),
+          mRecoveryAttempts(0),
+          mIsLatencyAdaptationRequested(false),
+          mTransferredFrames(0)
     {}
 
     virtual uint32_t getBufferSizeInBytes() const;
 
     virtual size_t getBufferSizeInFrames() const;
 
+    /**
+     * @return period size of the ring buffer in frames.
+     */
+    size_t getPeriodSizeInFrames() const;
+
     virtual android::status_t pcmReadFrames(void *buffer, size_t frames, std::string &error) const;
 
     virtual android::status_t pcmWriteFrames(void *buffer, ssize_t frames,
@@ -42,15 +59,58 @@ public:
 
     virtual android::status_t pcmStop() const;
 
+    /**
+     * Recovery is escalated at each consecutive failure of I/O operations:
+     *  -in place: pcm prepared, then prefilled with a period of silence for playback or started
+     *             for capture, so that an xrun costs a single period of glitch,
+     *  -reopen: pcm closed and reopened with the same configuration,
+     *  -reroute: given up, the caller is expected to put the stream in standby.
+     * Escalation is reset by the first successful I/O operation.
+     */
+    virtual android::status_t pcmRecover();
+
     /**
      * Returns available frames in pcm buffer and corresponding time stamp.
      * For an input stream, frames available are frames ready for the
      * application to read.
      * For an output stream, frames available are the number of empty frames available
      * for the application to write.
+     * Once the hardware clock estimation is locked, the time stamp is smoothed by the estimator.
      */
     virtual android::status_t getFramesAvailable(size_t &avail, struct timespec &tStamp) const;
 
+    /**
+     * Must be called with stream lock held, for an output stream.
+     *
+     * The free room is read from the driver in any state, as a prepared pcm keeps filling its
+     * ring buffer until the start threshold is reached.
+     *
+     * @return frames that may be written without blocking, none if the driver can't tell.
+     */
+    size_t getWritableFramesL() const;
+
+    /**
+     * Must be called with stream lock held.
+     *
+     * @return true if the pcm was found running at the last I/O operation, false if it has not
+     *         been started yet, or was stopped since.
+     */
+    bool isPcmRunningL() const { return mIsPcmRunning.load(std::memory_order_relaxed); }
+
+    /**
+     * @return estimator of the hardware clock of the audio device, fed by the I/O operations.
+     */
+    const ClockDriftEstimator &getClockDriftEstimator() const { return mClockDriftEstimator; }
+
+    /**
+     * Checks if the route requested its latency to be adapted upon xruns detected by the I/O
+     * operations, and clears the request.
+     * The caller is expected to request a routing reconsideration, without the stream lock held.
+     *
+     * @return true if a latency adaptation was requested, false otherwise.
+     */
+    bool consumeLatencyAdaptationRequest();
+
 protected:
     /**
      * Attach the stream to its route.
@@ -69,6 +129,17 @@ protected:
      */
     virtual android::status_t detachRouteL();
 
+    /**
+     * Writes silence by chunks of a period, from the period of silence allocated upon routing.
+     * Must be called with stream lock held, for an output stream.
+     *
+     * @param[in] frames of silence to write, in the route sample specification.
+     * @param[out] error reported by the pcm device upon failure.
+     *
+     * @return OK if written, error code otherwise.
+     */
+    android::status_t pcmWriteSilence(size_t frames, std::string &error);
+
 private:
     /**
      * Get the pcm device handle.
@@ -79,8 +150,67 @@ private:
      */
     pcm *getPcmDevice() const;
 
+    /**
+     * Checks the state of the ring buffer before an I/O operation and accounts xruns.
+     * An xrun is detected either if the pcm left the running state since it was last seen running
+     * (tinyalsa restarts it silently within the next I/O operation), or if the hardware pointer
+     * went beyond the application pointer, i.e. available frames exceed the ring buffer size.
+     */
+    void updateXrunStats() const;
+
+    /**
+     * Accounts an xrun and notifies the stream route.
+     *
+     * @param[in] framesLost estimation of frames lost by the xrun.
+     */
+    void onXrun(uint32_t framesLost) const;
+
+    /**
+     * Accounts a successful I/O operation.
+     */
+    void onIoDone() const;
+
+    /**
+     * Get the position of the hardware pointer, from the frames transferred by the I/O operations
+     * since the route was attached.
+     *
+     * @param[in] avail frames available in the ring buffer.
+     *
+     * @return position in frames.
+     */
+    uint64_t getHwPosition(size_t avail) const;
+
+    /**
+     * Restarts a prepared pcm device: silence prefill for playback, explicit start for capture.
+     *
+     * @return OK if restarted, error code otherwise.
+     */
+    android::status_t pcmRestart();
+
     TinyAlsaAudioDevice *mDevice;
 
+    /**
+     * pcm was found running at last check.
+     * Updated by the I/O operations with the stream lock held in read mode only, so concurrently
+     * with the queries of the position.
+     */
+    mutable std::atomic<bool> mIsPcmRunning;
+    mutable bool mIsInXrun; /**< xrun ongoing, prevents from accounting it at each I/O. */
+    mutable nsecs_t mLastIoTime; /**< monotonic time of the last successful I/O operation. */
+    mutable uint32_t mRecoveryAttempts; /**< consecutive recovery attempts. */
+
+    /** Route requested to adapt its latency, set by the I/O operations. */
+    mutable std::atomic<bool> mIsLatencyAdaptationRequested;
+
+    mutable std::atomic<uint64_t> mTransferredFrames; /**< frames written / read since attach. */
+    mutable ClockDriftEstimator mClockDriftEstimator; /**< hardware clock estimation. */
+
+    /** A period of silence for output streams, allocated upon routing, in the route sample spec. */
+    std::vector<char> mSilence;
+
+    /** In place recovery attempts before reopening the device. */
+    static const uint32_t mMaxInPlaceRecoveries = 3;
+
     /** Ratio between microseconds and milliseconds */
     static const uint32_t mUsecPerMsec = 1000;
 };
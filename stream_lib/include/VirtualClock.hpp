@@ -0,0 +1,80 @@
+/*
+ * Copyright (C) 2013-2015 Intel Corporation
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#pragma once
+
+#include <utils/Mutex.h>
+#include <utils/Timers.h>
+#include <atomic>
+#include <stdint.h>
+
+namespace intel_audio
+{
+
+/**
+ * Clock consuming frames at a given sample rate, anchored on CLOCK_MONOTONIC.
+ * Used to pace and timestamp the audio of a stream when no audio device consumes it, e.g. when
+ * the stream is muted or not routed, so that the client sees a continuous flow of frames.
+ * Conversions are computed from the anchor, so that the clock does not drift whatever the number
+ * of requests.
+ */
+class VirtualClock
+{
+public:
+    VirtualClock();
+
+    /**
+     * Starts the clock, or restarts it on a new anchor.
+     *
+     * @param[in] frames consumed at the anchor time.
+     * @param[in] time of the anchor, in nanoseconds on CLOCK_MONOTONIC.
+     * @param[in] sampleRate rate at which frames are consumed.
+     */
+    void start(uint64_t frames, nsecs_t time, uint32_t sampleRate);
+
+    void stop();
+
+    bool isRunning() const { return mIsRunning.load(std::memory_order_acquire); }
+
+    /**
+     * @param[in] time in nanoseconds on CLOCK_MONOTONIC.
+     *
+     * @return frames consumed at the given time, frames of the anchor if the time precedes it.
+     */
+    uint64_t getFramesAt(nsecs_t time) const;
+
+    /**
+     * @param[in] frames to be consumed.
+     *
+     * @return time at which the frames are consumed, time of the anchor if the frames precede it.
+     */
+    nsecs_t getTimeOf(uint64_t frames) const;
+
+    /**
+     * Sleeps until an absolute time, not to accumulate the error of relative sleeps.
+     *
+     * @param[in] time to wake up at, in nanoseconds on CLOCK_MONOTONIC.
+     */
+    static void sleepUntil(nsecs_t time);
+
+private:
+    mutable android::Mutex mLock; /**< protects the anchor. */
+    std::atomic<bool> mIsRunning;
+    uint64_t mAnchorFrames;
+    nsecs_t mAnchorTime;
+    uint32_t mSampleRate;
+};
+
+} // namespace intel_audio
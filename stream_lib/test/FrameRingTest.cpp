@@ -0,0 +1,189 @@
+/*
+ * Copyright (C) 2015 Intel Corporation
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "FrameRing.hpp"
+#include <gtest/gtest.h>
+#include <stdint.h>
+#include <string.h>
+
+namespace intel_audio
+{
+
+static const size_t ringCapacity = 8;
+
+/**
+ * Ring of 8 frames of 32 bits, each frame holding its sequence number.
+ */
+class FrameRingTest : public ::testing::Test
+{
+protected:
+    FrameRingTest()
+        : mNextFrame(0)
+    {}
+
+    virtual void SetUp()
+    {
+        ASSERT_EQ(android::OK, mRing.reserve(ringCapacity, sizeof(uint32_t)));
+    }
+
+    /**
+     * Writes the next frames of the sequence through the write pointer.
+     *
+     * @param[in] frames to write, at most the contiguous writable frames.
+     */
+    void write(size_t frames)
+    {
+        size_t contiguousFrames;
+        uint32_t *dst = static_cast<uint32_t *>(mRing.getWritePointer(contiguousFrames));
+        ASSERT_LE(frames, contiguousFrames);
+        for (size_t i = 0; i < frames; i++) {
+            dst[i] = mNextFrame++;
+        }
+        mRing.commitWrite(frames);
+    }
+
+    FrameRing mRing;
+    uint32_t mNextFrame; /**< Sequence number of the next frame written. */
+};
+
+TEST_F(FrameRingTest, Empty)
+{
+    EXPECT_EQ(ringCapacity, mRing.getCapacity());
+    EXPECT_EQ(0u, mRing.getReadableFrames());
+    EXPECT_EQ(ringCapacity, mRing.getWritableFrames());
+
+    size_t frames;
+    EXPECT_EQ(NULL, mRing.getReadPointer(frames));
+    EXPECT_EQ(0u, frames);
+    EXPECT_NE(static_cast<void *>(NULL), mRing.getWritePointer(frames));
+    EXPECT_EQ(ringCapacity, frames);
+
+    uint32_t buffer[ringCapacity];
+    EXPECT_EQ(0u, mRing.read(buffer, ringCapacity));
+}
+
+TEST_F(FrameRingTest, Full)
+{
+    write(ringCapacity);
+    EXPECT_EQ(ringCapacity, mRing.getReadableFrames());
+    EXPECT_EQ(0u, mRing.getWritableFrames());
+
+    size_t frames;
+    EXPECT_EQ(NULL, mRing.getWritePointer(frames));
+    EXPECT_EQ(0u, frames);
+
+    // Commit beyond the free room is clipped.
+    mRing.commitWrite(1);
+    EXPECT_EQ(ringCapacity, mRing.getReadableFrames());
+
+    const uint32_t *src = static_cast<uint32_t *>(mRing.getReadPointer(frames));
+    ASSERT_EQ(ringCapacity, frames);
+    for (size_t i = 0; i < frames; i++) {
+        EXPECT_EQ(i, src[i]);
+    }
+}
+
+TEST_F(FrameRingTest, PartialRegions)
+{
+    write(3);
+    write(2);
+
+    size_t frames;
+    const uint32_t *src = static_cast<uint32_t *>(mRing.getReadPointer(frames));
+    ASSERT_EQ(5u, frames);
+    EXPECT_EQ(0u, src[0]);
+
+    mRing.consume(2);
+    src = static_cast<uint32_t *>(mRing.getReadPointer(frames));
+    ASSERT_EQ(3u, frames);
+    EXPECT_EQ(2u, src[0]);
+
+    // Free room from the write index up to the end of the ring only.
+    mRing.getWritePointer(frames);
+    EXPECT_EQ(ringCapacity - 5, frames);
+    EXPECT_EQ(ringCapacity - 3, mRing.getWritableFrames());
+}
+
+TEST_F(FrameRingTest, Wrap)
+{
+    write(6);
+    mRing.consume(4);
+
+    // Write region stops at the end of the ring, then restarts from its beginning.
+    size_t frames;
+    mRing.getWritePointer(frames);
+    EXPECT_EQ(2u, frames);
+    write(2);
+    mRing.getWritePointer(frames);
+    EXPECT_EQ(4u, frames);
+    write(3);
+    EXPECT_EQ(7u, mRing.getReadableFrames());
+
+    // Read region stops at the end of the ring.
+    const uint32_t *src = static_cast<uint32_t *>(mRing.getReadPointer(frames));
+    ASSERT_EQ(4u, frames);
+    EXPECT_EQ(4u, src[0]);
+
+    // Copy follows the sequence across the end of the ring.
+    uint32_t buffer[ringCapacity];
+    ASSERT_EQ(6u, mRing.read(buffer, 6));
+    for (uint32_t i = 0; i < 6; i++) {
+        EXPECT_EQ(4 + i, buffer[i]);
+    }
+    src = static_cast<uint32_t *>(mRing.getReadPointer(frames));
+    ASSERT_EQ(1u, frames);
+    EXPECT_EQ(10u, src[0]);
+}
+
+TEST_F(FrameRingTest, ReadMoreThanReadable)
+{
+    write(3);
+
+    uint32_t buffer[ringCapacity];
+    EXPECT_EQ(3u, mRing.read(buffer, ringCapacity));
+    EXPECT_EQ(0u, mRing.getReadableFrames());
+
+    // Consume beyond the readable frames is clipped.
+    write(2);
+    mRing.consume(ringCapacity);
+    EXPECT_EQ(0u, mRing.getReadableFrames());
+    EXPECT_EQ(ringCapacity, mRing.getWritableFrames());
+}
+
+TEST_F(FrameRingTest, EmptiedRingRestartsFromItsBeginning)
+{
+    write(5);
+    mRing.consume(5);
+
+    // Whole ring contiguous again once emptied.
+    size_t frames;
+    mRing.getWritePointer(frames);
+    EXPECT_EQ(ringCapacity, frames);
+}
+
+TEST_F(FrameRingTest, ReserveDropsFrames)
+{
+    write(5);
+    ASSERT_EQ(android::OK, mRing.reserve(4, sizeof(uint32_t)));
+    EXPECT_EQ(4u, mRing.getCapacity());
+    EXPECT_EQ(0u, mRing.getReadableFrames());
+    EXPECT_EQ(4u, mRing.getWritableFrames());
+
+    mRing.clear();
+    EXPECT_EQ(0u, mRing.getReadableFrames());
+}
+
+} // namespace intel_audio
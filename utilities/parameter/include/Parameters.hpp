@@ -56,6 +56,12 @@ public:
     /** PreProc Parameter Key. */
     static const std::string &gKeyPreProcRequested;
 
+    /** Stream statistics (xruns, retries, recoveries) Parameter Key. */
+    static const std::string &gKeyStreamStats;
+
+    /** Drift of the hardware clock of the stream route in ppm Parameter Key. */
+    static const std::string &gKeyClockDrift;
+
     /** Always Listening Route/VTSV Parameters Keys */
     static const std::string &gkeyAlwaysListeningRoute;
     static const std::string &gKeyLpalDevice;
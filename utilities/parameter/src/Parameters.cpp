@@ -39,6 +39,10 @@ const std::string &Parameters::gKeyVoipBandType = "voip_band_type";
 
 const std::string &Parameters::gKeyPreProcRequested = "pre_proc_requested";
 
+const std::string &Parameters::gKeyStreamStats = "stream_stats";
+
+const std::string &Parameters::gKeyClockDrift = "clock_drift_ppm";
+
 const std::string &Parameters::gkeyAlwaysListeningRoute = "vtsv_route";
 
 const std::string &Parameters::gKeyLpalDevice = "lpal_device";